@@ -0,0 +1,23 @@
+//
+// Created by dreamHuang on 2023/4/5.
+//
+
+#include "async_bridge.h"
+#include <sys/epoll.h>
+
+namespace hucoro {
+
+void FdAwaiter::await_suspend(std::coroutine_handle<> awaiting_coroutine) {
+    auto& driver = SingleThreadScheduler::io_driver();
+    std::uint32_t events = interest_ == Interest::READABLE ? EPOLLIN | EPOLLRDHUP : EPOLLOUT;
+    // registered after the fd is ready is fine, since it is level-triggered
+    driver.add(fd_, events | EPOLLONESHOT, this);
+    driver_ = &driver;
+    coroutine_ = awaiting_coroutine;
+    context_guard_.save(*this);
+    driver.suspend();
+}
+
+void FdAwaiter::on_event(std::uint32_t) { driver_->wake(coroutine_); }
+
+}// namespace hucoro
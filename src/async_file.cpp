@@ -0,0 +1,155 @@
+//
+// Created by dreamHuang on 2023/3/22.
+//
+
+#include "async_file.h"
+#include "exception.h"
+#include "single_thread_scheduler.h"
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace hucoro {
+namespace detail {
+    AioAwaiter::AioAwaiter(IoDriver& driver, std::uint16_t opcode, int fd, void* buf, std::size_t size,
+                           std::int64_t offset) noexcept
+        : driver_(driver) {
+        op_.prepare(opcode, fd, buf, size, offset);
+    }
+
+    AioAwaiter::~AioAwaiter() {
+        if (op_.submitted_ && !op_.done_) { driver_.aio().cancel(op_); }
+    }
+
+    bool AioAwaiter::await_suspend(std::coroutine_handle<> awaiting_coroutine) {
+        op_.waiter_ = &waiter_;
+        waiter_.remaining_ = 1;
+        driver_.aio().submit(&op_, 1);
+        // failed to submit, or completed by the reaping of submission
+        if (op_.done_) { return false; }
+        waiter_.context_guard_.save(*this);
+        waiter_.coroutine_ = awaiting_coroutine;
+        driver_.suspend();
+        return true;
+    }
+
+    std::size_t AioAwaiter::await_resume() {
+        waiter_.context_guard_.restore();
+        auto result = op_.result_;
+        auto opcode = op_.iocb_.aio_lio_opcode;
+        if (result == -EINVAL && (opcode == IOCB_CMD_FSYNC || opcode == IOCB_CMD_FDSYNC)) {
+            // many file systems do not support asynchronous fsync
+            int fd = static_cast<int>(op_.iocb_.aio_fildes);
+            result = (opcode == IOCB_CMD_FSYNC ? ::fsync(fd) : ::fdatasync(fd)) < 0 ? -errno : 0;
+        }
+        if (result < 0) {
+            throw std::system_error(static_cast<int>(-result), std::system_category(), "AsyncFile operation");
+        }
+        return static_cast<std::size_t>(result);
+    }
+}// namespace detail
+
+/*
+ * AsyncFile
+ */
+
+AsyncFile AsyncFile::open(const std::string& path, int flags, mode_t mode) {
+    int fd = ::open(path.c_str(), flags | O_CLOEXEC, mode);
+    if (fd < 0) { throw std::system_error(errno, std::system_category(), "open " + path); }
+    return AsyncFile{fd};
+}
+
+void AsyncFile::close() noexcept {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+std::int64_t AsyncFile::size() const {
+    struct stat st {};
+    if (::fstat(fd_, &st) < 0) { throw std::system_error(errno, std::system_category(), "fstat"); }
+    return st.st_size;
+}
+
+detail::AioAwaiter AsyncFile::read_at(void* buf, std::size_t size, std::int64_t offset) {
+    return {SingleThreadScheduler::io_driver(), IOCB_CMD_PREAD, fd_, buf, size, offset};
+}
+
+detail::AioAwaiter AsyncFile::write_at(const void* buf, std::size_t size, std::int64_t offset) {
+    return {SingleThreadScheduler::io_driver(), IOCB_CMD_PWRITE, fd_, const_cast<void*>(buf), size, offset};
+}
+
+detail::AioAwaiter AsyncFile::fsync() {
+    return {SingleThreadScheduler::io_driver(), IOCB_CMD_FSYNC, fd_, nullptr, 0, 0};
+}
+
+detail::AioAwaiter AsyncFile::fdatasync() {
+    return {SingleThreadScheduler::io_driver(), IOCB_CMD_FDSYNC, fd_, nullptr, 0, 0};
+}
+
+void AsyncFile::advise(std::int64_t offset, std::int64_t len, int advice) {
+    // posix_fadvise returns the error number instead of setting errno
+    if (int err = ::posix_fadvise(fd_, offset, len, advice)) {
+        throw std::system_error(err, std::system_category(), "posix_fadvise");
+    }
+}
+
+void AsyncFile::readahead(std::int64_t offset, std::size_t count) {
+    if (::readahead(fd_, offset, count) < 0) { throw std::system_error(errno, std::system_category(), "readahead"); }
+}
+
+/*
+ * IoBatch
+ */
+
+IoBatch::~IoBatch() {
+    // the operations refer to the memory of this batch, and the awaiting coroutine may have been
+    // destroyed (e.g. cancelled by the shutdown of scheduler)
+    waiter_.coroutine_ = nullptr;
+    while (submitted_ && waiter_.remaining_ > 0) { driver_->aio().reap(true); }
+}
+
+std::size_t IoBatch::read_at(AsyncFile& file, void* buf, std::size_t size, std::int64_t offset) {
+    return add(IOCB_CMD_PREAD, file, buf, size, offset);
+}
+
+std::size_t IoBatch::write_at(AsyncFile& file, const void* buf, std::size_t size, std::int64_t offset) {
+    return add(IOCB_CMD_PWRITE, file, const_cast<void*>(buf), size, offset);
+}
+
+std::size_t IoBatch::add(std::uint16_t opcode, AsyncFile& file, void* buf, std::size_t size, std::int64_t offset) {
+    if (submitted_) { throw HuCoroGeneralErr("Try add operation to an IoBatch which has been submitted"); }
+    auto& op = ops_.emplace_back();
+    op.prepare(opcode, file.fd(), buf, size, offset);
+    op.index_ = ops_.size() - 1;
+    return op.index_;
+}
+
+void IoBatch::submit() {
+    submitted_ = true;
+    if (ops_.empty()) { return; }
+    driver_ = &SingleThreadScheduler::io_driver();
+    waiter_.remaining_ = ops_.size();
+    for (auto& op: ops_) { op.waiter_ = &waiter_; }
+    driver_->aio().submit(ops_.data(), ops_.size());
+}
+
+bool IoBatch::AwaiterBase::await_ready() const noexcept {
+    if (!batch_.submitted_) { return false; }
+    return batch_.waiter_.remaining_ == 0 || (wait_any_ && batch_.waiter_.first_done_ != SIZE_MAX);
+}
+
+bool IoBatch::AwaiterBase::await_suspend(std::coroutine_handle<> awaiting_coroutine) {
+    if (!batch_.submitted_) { batch_.submit(); }
+    if (await_ready()) { return false; }
+    auto& waiter = batch_.waiter_;
+    waiter.wait_any_ = wait_any_;
+    waiter.context_guard_.save(*this);
+    waiter.coroutine_ = awaiting_coroutine;
+    batch_.driver_->suspend();
+    return true;
+}
+}// namespace hucoro
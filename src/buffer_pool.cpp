@@ -0,0 +1,108 @@
+//
+// Created by dreamHuang on 2023/3/20.
+//
+
+#include "buffer_pool.h"
+#include "exception.h"
+#include <cassert>
+#include <cstdlib>
+#include <new>
+#include <unistd.h>
+
+namespace hucoro {
+std::size_t BufferPool::page_size() noexcept {
+    static const std::size_t page_size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    return page_size;
+}
+
+BufferPool::BufferPool(std::size_t buffer_size, std::size_t buffers_per_chunk)
+    : buffers_per_chunk_(buffers_per_chunk), owner_(std::this_thread::get_id()) {
+    if (buffer_size == 0 || buffers_per_chunk == 0) {
+        throw HuCoroGeneralErr("The buffer size and buffers per chunk of BufferPool should not be 0");
+    }
+    auto page = page_size();
+    buffer_size_ = (buffer_size + page - 1) / page * page;
+}
+
+BufferPool::~BufferPool() {
+    drain_remote();
+    assert(free_num_ == total_buffers() && "some buffers outlive the BufferPool");
+    for (auto* chunk: chunks_) { std::free(chunk); }
+}
+
+BufferRef BufferPool::allocate() {
+    assert(std::this_thread::get_id() == owner_ && "BufferPool::allocate can only be called by the owner thread");
+    if (!free_list_) { drain_remote(); }
+    if (!free_list_) { grow(); }
+
+    detail::PooledBuffer* buffer = free_list_;
+    free_list_ = buffer->next_;
+    free_num_ -= 1;
+    buffer->next_ = nullptr;
+    buffer->ref_count_.store(1, std::memory_order_relaxed);
+    return BufferRef{buffer};
+}
+
+std::size_t BufferPool::free_buffers() const noexcept {
+    return free_num_ + remote_free_num_.load(std::memory_order_relaxed);
+}
+
+std::vector<std::span<std::byte>> BufferPool::regions() const {
+    std::vector<std::span<std::byte>> regions;
+    regions.reserve(chunks_.size());
+    for (auto* chunk: chunks_) { regions.emplace_back(chunk, buffer_size_ * buffers_per_chunk_); }
+    return regions;
+}
+
+void BufferPool::release(detail::PooledBuffer* buffer) noexcept {
+    if (std::this_thread::get_id() == owner_) {
+        buffer->next_ = free_list_;
+        free_list_ = buffer;
+        free_num_ += 1;
+        return;
+    }
+    // Only the owner thread pops (by taking the whole list), so there is no ABA problem
+    detail::PooledBuffer* head = remote_free_.load(std::memory_order_relaxed);
+    do {
+        buffer->next_ = head;
+    } while (!remote_free_.compare_exchange_weak(head, buffer, std::memory_order_release, std::memory_order_relaxed));
+    remote_free_num_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void BufferPool::grow() {
+    // owned here until it is stored, so nothing leaks if the allocations below throw
+    std::unique_ptr<std::byte, decltype(&std::free)> chunk{
+            static_cast<std::byte*>(std::aligned_alloc(page_size(), buffer_size_ * buffers_per_chunk_)), &std::free};
+    if (!chunk) { throw std::bad_alloc(); }
+    auto headers = std::make_unique<detail::PooledBuffer[]>(buffers_per_chunk_);
+    chunks_.reserve(chunks_.size() + 1);
+    headers_.reserve(headers_.size() + 1);
+
+    auto first_index = static_cast<std::uint32_t>(total_buffers());
+    // link in reverse order, so that the buffers are allocated in address order
+    for (std::size_t i = buffers_per_chunk_; i > 0; --i) {
+        auto& header = headers[i - 1];
+        header.data_ = chunk.get() + (i - 1) * buffer_size_;
+        header.pool_ = this;
+        header.index_ = first_index + static_cast<std::uint32_t>(i - 1);
+        header.next_ = free_list_;
+        free_list_ = &header;
+    }
+    free_num_ += buffers_per_chunk_;
+    // no throw after reserving
+    chunks_.push_back(chunk.release());
+    headers_.push_back(std::move(headers));
+}
+
+void BufferPool::drain_remote() noexcept {
+    detail::PooledBuffer* buffer = remote_free_.exchange(nullptr, std::memory_order_acquire);
+    while (buffer) {
+        detail::PooledBuffer* next = buffer->next_;
+        buffer->next_ = free_list_;
+        free_list_ = buffer;
+        free_num_ += 1;
+        remote_free_num_.fetch_sub(1, std::memory_order_relaxed);
+        buffer = next;
+    }
+}
+}// namespace hucoro
@@ -0,0 +1,10 @@
+//
+// Created by dreamHuang on 2023/3/10.
+//
+
+#include "clock.h"
+
+namespace hucoro {
+thread_local bool RuntimeClock::CACHED = false;
+thread_local RuntimeClock::time_point RuntimeClock::CACHED_NOW{};
+}// namespace hucoro
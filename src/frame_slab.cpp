@@ -0,0 +1,90 @@
+//
+// Created by dreamHuang on 2023/3/12.
+//
+
+#include "frame_slab.h"
+#include <new>
+
+namespace hucoro {
+namespace detail {
+    namespace {
+        // The header before each frame, keep the frame aligned as `operator new` does
+        struct alignas(alignof(std::max_align_t)) FrameHeader {
+            FrameSlab* slab_;
+        };
+
+        constexpr std::size_t HEADER_SIZE = sizeof(FrameHeader);
+
+        constexpr std::size_t align_up(std::size_t size) {
+            constexpr std::size_t align = alignof(std::max_align_t);
+            return (size + align - 1) / align * align;
+        }
+
+        // the chunks start after the slab object
+        constexpr std::size_t SLAB_SIZE = align_up(sizeof(FrameSlab));
+    }// namespace
+
+    std::atomic<std::size_t> FrameSlab::ALIVE_NUM = 0;
+
+    FrameSlab::FrameSlab(std::size_t chunk_size, std::size_t capacity) noexcept
+        : chunk_size_(chunk_size), capacity_(capacity), ref_count_(1) {}
+
+    FrameSlab* FrameSlab::create(std::size_t frame_size, std::size_t capacity) {
+        std::size_t chunk_size = HEADER_SIZE + align_up(frame_size);
+        void* mem = ::operator new(SLAB_SIZE + chunk_size * capacity);
+        ALIVE_NUM.fetch_add(1, std::memory_order_relaxed);
+        return new (mem) FrameSlab(chunk_size, capacity);
+    }
+
+    void* FrameSlab::try_allocate(std::size_t size) noexcept {
+        if (allocated_ == capacity_ || HEADER_SIZE + align_up(size) != chunk_size_) { return nullptr; }
+        auto* chunk = reinterpret_cast<std::byte*>(this) + SLAB_SIZE + chunk_size_ * allocated_;
+        allocated_ += 1;
+        ref_count_.fetch_add(1, std::memory_order_relaxed);
+        return chunk;
+    }
+
+    void FrameSlab::release() noexcept {
+        if (ref_count_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            this->~FrameSlab();
+            ::operator delete(static_cast<void*>(this));
+            ALIVE_NUM.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    thread_local FrameSlabScope* FrameSlabScope::CURRENT_SCOPE = nullptr;
+
+    FrameSlabScope::FrameSlabScope(std::size_t capacity) noexcept : capacity_(capacity), prev_(CURRENT_SCOPE) {
+        CURRENT_SCOPE = this;
+    }
+
+    FrameSlabScope::~FrameSlabScope() {
+        CURRENT_SCOPE = prev_;
+        // the scope itself holds a reference
+        if (slab_) { slab_->release(); }
+    }
+
+    void* allocate_frame(std::size_t size) {
+        void* mem = nullptr;
+        FrameSlab* slab = nullptr;
+        FrameSlabScope* scope = FrameSlabScope::CURRENT_SCOPE;
+        if (scope) {
+            if (!scope->slab_ && scope->capacity_ > 1) { scope->slab_ = FrameSlab::create(size, scope->capacity_); }
+            if (scope->slab_ && (mem = scope->slab_->try_allocate(size))) { slab = scope->slab_; }
+        }
+        if (!mem) { mem = ::operator new(HEADER_SIZE + size); }
+        auto* header = new (mem) FrameHeader{slab};
+        return reinterpret_cast<std::byte*>(header) + HEADER_SIZE;
+    }
+
+    void deallocate_frame(void* ptr) noexcept {
+        auto* header = reinterpret_cast<FrameHeader*>(static_cast<std::byte*>(ptr) - HEADER_SIZE);
+        FrameSlab* slab = header->slab_;
+        if (slab) {
+            slab->release();
+        } else {
+            ::operator delete(static_cast<void*>(header));
+        }
+    }
+}// namespace detail
+}// namespace hucoro
@@ -0,0 +1,345 @@
+//
+// Created by dreamHuang on 2023/4/5.
+//
+
+#ifndef HUCORO_ASYNC_BRIDGE_H
+#define HUCORO_ASYNC_BRIDGE_H
+
+#include "config.h"
+#include "exception.h"
+#include "io_driver.h"
+#include "single_thread_scheduler.h"
+#include "task_local.h"
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <future>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+/// Bridges from the APIs which are not coroutine based, without allocation or a thread per wait:
+/// 1. `async_from_callback` for the APIs with completion callbacks, which may complete on any thread.
+/// 2. `from_future` / `poll_until` for the things can only be polled (e.g. std::future).
+/// 3. `wait_fd` for the fds owned by others (e.g. the notification fd of a library).
+namespace hucoro {
+namespace detail {
+    /// The completion state of `async_from_callback`, which is the base of the awaiter
+    /// (i.e. it lives in the frame of the suspended coroutine).
+    ///
+    /// If the task is cancelled while suspended (see `SingleThreadScheduler::shutdown`), the state
+    /// becomes ABANDONED and keeps the frame alive, then the completer drops the reference of the
+    /// cancellation (which usually destroys the frame) instead of resuming it.
+    template<typename T>
+    class CallbackState : public PendingCompletion {
+    public:
+        CallbackState() noexcept { abandon_ = &abandon; }
+        CallbackState(const CallbackState&) = delete;
+        CallbackState& operator=(const CallbackState&) = delete;
+        ~CallbackState() { unregister(); }
+
+        template<typename... Args>
+        void set_value(Args&&... args) noexcept {
+            try {
+                result_.template emplace<1>(std::forward<Args>(args)...);
+            } catch (...) { result_.template emplace<2>(std::current_exception()); }
+            complete();
+        }
+
+        void set_error(std::exception_ptr error) noexcept {
+            result_.template emplace<2>(std::move(error));
+            complete();
+        }
+
+    protected:
+        enum Phase : int {
+            INITIATING,
+            SUSPENDED,
+            COMPLETED,
+            // the task has been cancelled while suspended
+            ABANDONED,
+        };
+
+        void complete() noexcept {
+            int prev_phase = phase_.exchange(COMPLETED, std::memory_order_acq_rel);
+            if (prev_phase == ABANDONED) {
+                // nobody else touches the frame, and it may be destroyed here
+                auto* task = task_;
+                if (task->release()) { task->frame_.destroy(); }
+                return;
+            }
+            // completed inside the initiating function, the coroutine is not suspended
+            if (prev_phase != SUSPENDED) { return; }
+            if (SingleThreadScheduler::CURRENT_SCHEDULER == scheduler_) {
+                driver_->wake(node_.coroutine_);
+            } else {
+                // `this` may be destroyed once the node is published
+                auto* driver = driver_;
+                driver->remote_wake(node_);
+            }
+        }
+
+        /// Register to the task suspended on this, so that the cancellation can abandon it
+        void register_to(TaskLocalContext* context) noexcept {
+            if (!context) { return; }
+            context_ = context;
+            context->add_pending(*this);
+        }
+
+        void unregister() noexcept {
+            if (context_) { std::exchange(context_, nullptr)->remove_pending(*this); }
+        }
+
+        std::variant<std::monostate, std::conditional_t<std::is_void_v<T>, std::monostate, T>, std::exception_ptr>
+                result_;
+        std::atomic<int> phase_ = INITIATING;
+        SingleThreadScheduler* scheduler_ = nullptr;
+        IoDriver* driver_ = nullptr;
+        RemoteWakeNode node_;
+        TaskLocalGuard context_guard_;
+        // the context of the suspended task (if registered), and the task after abandoned
+        TaskLocalContext* context_ = nullptr;
+        SpawnTaskPromiseState* task_ = nullptr;
+
+    private:
+        static bool abandon(PendingCompletion* node, SpawnTaskPromiseState& task) noexcept {
+            auto* state = static_cast<CallbackState*>(node);
+            state->task_ = &task;
+            int expected = SUSPENDED;
+            if (state->phase_.compare_exchange_strong(expected, ABANDONED, std::memory_order_acq_rel)) {
+                return true;
+            }
+            // completed, wait until the completer publishes the wake, which is its last touch
+            while (!state->driver_->woken(state->node_.coroutine_)) { std::this_thread::yield(); }
+            return false;
+        }
+    };
+}// namespace detail
+
+/// The completion handle passed to the initiating function of `async_from_callback`.
+/// It must be completed exactly once by `set_value` / `set_error` (or calling it), from any thread.
+///
+/// For the C style callbacks, pass `user_data()` as the context pointer and recover the handle
+/// in the callback by `Completion<T>::from_user_data`.
+template<typename T>
+class Completion {
+public:
+    template<typename... Args>
+    void set_value(Args&&... args) noexcept {
+        state_->set_value(std::forward<Args>(args)...);
+    }
+
+    void set_error(std::exception_ptr error) noexcept { state_->set_error(std::move(error)); }
+
+    template<typename... Args>
+    void operator()(Args&&... args) noexcept {
+        state_->set_value(std::forward<Args>(args)...);
+    }
+
+    void* user_data() const noexcept { return state_; }
+
+    static Completion from_user_data(void* user_data) noexcept {
+        return Completion{static_cast<detail::CallbackState<T>*>(user_data)};
+    }
+
+private:
+    template<typename U, typename Initiate>
+    friend class CallbackAwaiter;
+
+    explicit Completion(detail::CallbackState<T>* state) noexcept : state_(state) {}
+
+    detail::CallbackState<T>* state_;
+};
+
+/// The awaiter of `async_from_callback`, see below
+template<typename T, typename Initiate>
+class CallbackAwaiter : detail::CallbackState<T> {
+    using Phase = typename detail::CallbackState<T>::Phase;
+
+public:
+    explicit CallbackAwaiter(Initiate initiate) : initiate_(std::move(initiate)) {}
+    CallbackAwaiter(const CallbackAwaiter&) = delete;
+    CallbackAwaiter& operator=(const CallbackAwaiter&) = delete;
+
+    bool await_ready() const noexcept { return false; }
+
+    bool await_suspend(std::coroutine_handle<> awaiting_coroutine) {
+        this->scheduler_ = SingleThreadScheduler::CURRENT_SCHEDULER;
+        if (!this->scheduler_) {
+            throw HuCoroGeneralErr("Try async_from_callback out side the scope of scheduler");
+        }
+        this->driver_ = &SingleThreadScheduler::io_driver();
+        this->node_.coroutine_ = awaiting_coroutine;
+        this->context_guard_.save(*this);
+        std::invoke(initiate_, Completion<T>{this});
+
+        int expected = Phase::INITIATING;
+        if (!this->phase_.compare_exchange_strong(expected, Phase::SUSPENDED, std::memory_order_acq_rel)) {
+            // completed inline
+            return false;
+        }
+        // a remote completion is resumed by the poll of this thread, so it can not happen before this
+        this->driver_->suspend();
+        this->register_to(detail::TaskLocalContext::current());
+        return true;
+    }
+
+    T await_resume() {
+        this->context_guard_.restore();
+        this->unregister();
+        switch (this->result_.index()) {
+            case 1:
+                if constexpr (std::is_void_v<T>) {
+                    return;
+                } else {
+                    return std::move(std::get<1>(this->result_));
+                }
+            case 2:
+                std::rethrow_exception(std::get<2>(this->result_));
+            default:
+                __builtin_unreachable();
+        }
+    }
+
+private:
+    Initiate initiate_;
+};
+
+/// Adapt a callback based API, e.g.
+///
+///     int n = co_await async_from_callback<int>([&](Completion<int> completion) {
+///         client.get(key, [completion](int result) mutable { completion(result); });
+///     });
+///
+/// `initiate` is called when the coroutine is suspending, and the completion may happen inside it,
+/// on the scheduler thread or any other thread (the coroutine is resumed by the scheduler thread).
+/// The completion state lives in the awaiter, so it does not allocate.
+template<typename T, typename Initiate>
+CallbackAwaiter<T, std::decay_t<Initiate>> async_from_callback(Initiate&& initiate) {
+    return CallbackAwaiter<T, std::decay_t<Initiate>>{std::forward<Initiate>(initiate)};
+}
+
+
+namespace detail {
+    /// The awaiter suspended until `Derived::is_ready()` returns true, which is checked by every
+    /// `IoDriver::poll`
+    template<typename Derived>
+    class PollAwaiterBase : protected PollableNode {
+    public:
+        PollAwaiterBase() = default;
+        PollAwaiterBase(const PollAwaiterBase&) = delete;
+        PollAwaiterBase& operator=(const PollAwaiterBase&) = delete;
+        ~PollAwaiterBase() {
+            // the coroutine is destroyed while waiting
+            if (is_ready_) { driver_->remove_pollable(*this); }
+        }
+
+        bool await_ready() { return static_cast<Derived*>(this)->is_ready(); }
+
+        void await_suspend(std::coroutine_handle<> awaiting_coroutine) {
+            driver_ = &SingleThreadScheduler::io_driver();
+            coroutine_ = awaiting_coroutine;
+            is_ready_ = &check;
+            context_guard_.save(*this);
+            driver_->add_pollable(*this);
+            driver_->suspend();
+        }
+
+    protected:
+        TaskLocalGuard context_guard_;
+
+    private:
+        static bool check(PollableNode* node) { return static_cast<Derived*>(node)->is_ready(); }
+
+        IoDriver* driver_ = nullptr;
+    };
+}// namespace detail
+
+/// The awaiter of `poll_until`
+template<typename Pred>
+class PollUntilAwaiter : public detail::PollAwaiterBase<PollUntilAwaiter<Pred>> {
+public:
+    explicit PollUntilAwaiter(Pred pred) : pred_(std::move(pred)) {}
+
+    bool is_ready() { return static_cast<bool>(std::invoke(pred_)); }
+    void await_resume() const noexcept { this->context_guard_.restore(); }
+
+private:
+    Pred pred_;
+};
+
+/// Suspend until `pred()` returns true, it is checked by the reactor of scheduler (at least every
+/// IoDriver::POLLABLE_INTERVAL_MS), so `pred` should be cheap and non-blocking.
+template<typename Pred>
+PollUntilAwaiter<std::decay_t<Pred>> poll_until(Pred&& pred) {
+    return PollUntilAwaiter<std::decay_t<Pred>>{std::forward<Pred>(pred)};
+}
+
+/// The awaiter of `from_future`
+template<typename Future>
+class FutureAwaiter : public detail::PollAwaiterBase<FutureAwaiter<Future>> {
+public:
+    explicit FutureAwaiter(Future future) : future_(std::move(future)) {}
+
+    bool is_ready() const { return future_.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }
+
+    decltype(auto) await_resume() {
+        this->context_guard_.restore();
+        return future_.get();
+    }
+
+private:
+    Future future_;
+};
+
+/// `co_await from_future(std::move(future))` returns (or throws) what `future.get()` does, without
+/// blocking the scheduler thread. It is polled (see `poll_until`), so prefer `async_from_callback`
+/// if the producer can complete a callback instead.
+template<typename T>
+FutureAwaiter<std::future<T>> from_future(std::future<T> future) {
+    return FutureAwaiter<std::future<T>>{std::move(future)};
+}
+
+template<typename T>
+FutureAwaiter<std::shared_future<T>> from_future(std::shared_future<T> future) {
+    return FutureAwaiter<std::shared_future<T>>{std::move(future)};
+}
+
+
+/// The awaiter of `wait_fd`
+class FdAwaiter : detail::IoSource {
+public:
+    FdAwaiter(int fd, Interest interest) noexcept : fd_(fd), interest_(interest) {}
+    FdAwaiter(const FdAwaiter&) = delete;
+    FdAwaiter& operator=(const FdAwaiter&) = delete;
+    ~FdAwaiter() override {
+        if (driver_) { driver_->remove(fd_); }
+    }
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> awaiting_coroutine);
+    void await_resume() noexcept {
+        context_guard_.restore();
+        driver_->remove(fd_);
+        driver_ = nullptr;
+    }
+
+    void on_event(std::uint32_t events) override;
+
+private:
+    int fd_;
+    Interest interest_;
+    IoDriver* driver_ = nullptr;
+    std::coroutine_handle<> coroutine_ = nullptr;
+    detail::TaskLocalGuard context_guard_;
+};
+
+/// Wait until `fd` is ready for `interest` (level-triggered) without owning it, e.g. the fd exposed
+/// by a library for its own event loop. The fd is registered for this wait only, so it must not be
+/// registered to the IoDriver by others at the same time (use AsyncFd for the fds owned by you).
+inline FdAwaiter wait_fd(int fd, Interest interest) noexcept { return FdAwaiter{fd, interest}; }
+}// namespace hucoro
+
+#endif//HUCORO_ASYNC_BRIDGE_H
@@ -0,0 +1,271 @@
+//
+// Created by dreamHuang on 2023/3/10.
+//
+
+#ifndef HUCORO_ASYNC_CACHE_H
+#define HUCORO_ASYNC_CACHE_H
+
+#include "clock.h"
+#include "config.h"
+#include "exception.h"
+#include "shared_task.h"
+#include "task.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace hucoro {
+
+/// Counters of AsyncCache (a snapshot)
+struct CacheStats {
+    // the value is ready in cache
+    std::size_t hits = 0;
+    // no entry in cache, the caller start a loader
+    std::size_t misses = 0;
+    // the entry is loading, the caller wait for the in-flight loader (single-flight)
+    std::size_t coalesced = 0;
+    // evicted because of the byte budget
+    std::size_t evictions = 0;
+    // dropped because of the TTL
+    std::size_t expirations = 0;
+
+    CacheStats& operator+=(const CacheStats& other) {
+        hits += other.hits;
+        misses += other.misses;
+        coalesced += other.coalesced;
+        evictions += other.evictions;
+        expirations += other.expirations;
+        return *this;
+    }
+};
+
+/// AsyncCache<K, V> is a single-flight cache:
+/// 1. `co_await cache.get_or_load(key, loader)` return a copy of the cached value.
+/// 2. When the key is missing, `loader()` (which returns an awaitable of V) is wrapped into
+/// a SharedTask, so that the concurrent requests of the same key will wait for the same loader
+/// instead of calling loader again.
+/// 3. Entry expires `ttl` after it is loaded, according to `Clock` (RuntimeClock by default).
+/// 4. Loaded entries are evicted in LRU order when the total charge exceeds `byte_budget`.
+/// The in-flight entries are never evicted and their charge is 0 until loaded.
+/// 5. The failure of loader is not cached, all the waiting coroutines will get the exception.
+///
+/// It is protected by a mutex (which is never held across `co_await`), so it can be shared
+/// between threads. Use `ShardedAsyncCache` to reduce contention.
+///
+/// NOTE: the cache must outlive all the in-flight loads.
+template<typename K, typename V, typename Clock = RuntimeClock, typename Hash = std::hash<K>>
+class AsyncCache {
+public:
+    using duration = typename Clock::duration;
+    using time_point = typename Clock::time_point;
+    using sizer_t = std::function<std::size_t(const K&, const V&)>;
+
+    struct Options {
+        duration ttl = duration::max();
+        std::size_t byte_budget = std::numeric_limits<std::size_t>::max();
+        // charge of an entry, default is sizeof(K) + sizeof(V)
+        sizer_t sizer = nullptr;
+    };
+
+    AsyncCache() : AsyncCache(Options{}) {}
+    explicit AsyncCache(Options options) : options_(std::move(options)) {
+        if (!options_.sizer) {
+            options_.sizer = [](const K&, const V&) { return sizeof(K) + sizeof(V); };
+        }
+    }
+
+    AsyncCache(const AsyncCache&) = delete;
+    AsyncCache& operator=(const AsyncCache&) = delete;
+
+    /// `loader` is a callable returning an awaitable whose await return type is convertible to V.
+    /// It is only called on miss, and moved into the loading coroutine.
+    template<typename Loader>
+    Task<V> get_or_load(K key, Loader loader) {
+        SharedTask<V> task;
+        {
+            std::lock_guard guard(mutex_);
+            auto it = index_.find(key);
+            if (it != index_.end()) {
+                auto entry = it->second;
+                if (entry->loaded_ && Clock::now() >= entry->expire_at_) {
+                    expirations_.fetch_add(1, std::memory_order_relaxed);
+                    erase(entry);
+                } else {
+                    (entry->loaded_ ? hits_ : coalesced_).fetch_add(1, std::memory_order_relaxed);
+                    lru_.splice(lru_.begin(), lru_, entry);
+                    task = entry->task_;
+                }
+            }
+
+            if (!task.valid()) {
+                misses_.fetch_add(1, std::memory_order_relaxed);
+                auto id = next_id_++;
+                task = load(key, id, std::move(loader));
+                lru_.push_front(Entry{key, task, id});
+                index_.emplace(std::move(key), lru_.begin());
+            }
+        }
+        co_return co_await task;
+    }
+
+    /// Drop the entry of `key` (if any). The coroutines waiting on it are not affected.
+    void invalidate(const K& key) {
+        std::lock_guard guard(mutex_);
+        auto it = index_.find(key);
+        if (it != index_.end()) { erase(it->second); }
+    }
+
+    std::size_t size() const {
+        std::lock_guard guard(mutex_);
+        return index_.size();
+    }
+
+    std::size_t bytes() const {
+        std::lock_guard guard(mutex_);
+        return bytes_;
+    }
+
+    CacheStats stats() const {
+        CacheStats stats;
+        stats.hits = hits_.load(std::memory_order_relaxed);
+        stats.misses = misses_.load(std::memory_order_relaxed);
+        stats.coalesced = coalesced_.load(std::memory_order_relaxed);
+        stats.evictions = evictions_.load(std::memory_order_relaxed);
+        stats.expirations = expirations_.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    struct Entry {
+        K key_;
+        SharedTask<V> task_;
+        // used to identify the entry, since the key may be reloaded after invalidate
+        std::uint64_t id_;
+        bool loaded_ = false;
+        time_point expire_at_ = time_point::max();
+        std::size_t charge_ = 0;
+    };
+    using entry_iter_t = typename std::list<Entry>::iterator;
+
+    /// The coroutine is executed only once, no matter how many coroutines await it.
+    template<typename Loader>
+    SharedTask<V> load(K key, std::uint64_t id, Loader loader) {
+        try {
+            co_return on_loaded(key, id, co_await loader());
+        } catch (...) {
+            // do not cache the failure
+            std::lock_guard guard(mutex_);
+            auto it = index_.find(key);
+            if (it != index_.end() && it->second->id_ == id) { erase(it->second); }
+            throw;
+        }
+    }
+
+    V on_loaded(const K& key, std::uint64_t id, V value) {
+        std::lock_guard guard(mutex_);
+        auto it = index_.find(key);
+        // the entry may have been invalidated during loading
+        if (it == index_.end() || it->second->id_ != id) { return value; }
+
+        auto entry = it->second;
+        entry->loaded_ = true;
+        auto now = Clock::now();
+        entry->expire_at_ = (options_.ttl >= time_point::max() - now) ? time_point::max() : now + options_.ttl;
+        entry->charge_ = options_.sizer(key, value);
+        bytes_ += entry->charge_;
+        evict();
+        return value;
+    }
+
+    /// evict the least recently used loaded entries until under budget (lock held)
+    void evict() {
+        auto it = lru_.end();
+        while (bytes_ > options_.byte_budget && it != lru_.begin()) {
+            --it;
+            if (!it->loaded_) { continue; }
+            evictions_.fetch_add(1, std::memory_order_relaxed);
+            it = erase(it);
+        }
+    }
+
+    /// lock held
+    entry_iter_t erase(entry_iter_t entry) {
+        bytes_ -= entry->charge_;
+        index_.erase(entry->key_);
+        return lru_.erase(entry);
+    }
+
+    Options options_;
+    mutable std::mutex mutex_;
+    // front is the most recently used
+    std::list<Entry> lru_;
+    std::unordered_map<K, entry_iter_t, Hash> index_;
+    std::size_t bytes_ = 0;
+    std::uint64_t next_id_ = 0;
+
+    std::atomic<std::size_t> hits_ = 0;
+    std::atomic<std::size_t> misses_ = 0;
+    std::atomic<std::size_t> coalesced_ = 0;
+    std::atomic<std::size_t> evictions_ = 0;
+    std::atomic<std::size_t> expirations_ = 0;
+};
+
+/// Split keys into several independent AsyncCache by hash to reduce lock contention when
+/// it is accessed by many threads. The byte budget is divided evenly between shards.
+template<typename K, typename V, typename Clock = RuntimeClock, typename Hash = std::hash<K>>
+class ShardedAsyncCache {
+public:
+    using cache_t = AsyncCache<K, V, Clock, Hash>;
+    using Options = typename cache_t::Options;
+
+    explicit ShardedAsyncCache(std::size_t shard_num = 16, Options options = {}) {
+        if (shard_num == 0) { throw HuCoroGeneralErr("ShardedAsyncCache need at least one shard"); }
+        if (options.byte_budget != std::numeric_limits<std::size_t>::max()) { options.byte_budget /= shard_num; }
+        shards_.reserve(shard_num);
+        for (std::size_t i = 0; i < shard_num; ++i) { shards_.push_back(std::make_unique<cache_t>(options)); }
+    }
+
+    template<typename Loader>
+    Task<V> get_or_load(K key, Loader loader) {
+        auto& shard = shard_of(key);
+        return shard.get_or_load(std::move(key), std::move(loader));
+    }
+
+    void invalidate(const K& key) { shard_of(key).invalidate(key); }
+
+    std::size_t size() const {
+        std::size_t size = 0;
+        for (auto& shard: shards_) { size += shard->size(); }
+        return size;
+    }
+
+    std::size_t bytes() const {
+        std::size_t bytes = 0;
+        for (auto& shard: shards_) { bytes += shard->bytes(); }
+        return bytes;
+    }
+
+    CacheStats stats() const {
+        CacheStats stats;
+        for (auto& shard: shards_) { stats += shard->stats(); }
+        return stats;
+    }
+
+private:
+    cache_t& shard_of(const K& key) { return *shards_[hasher_(key) % shards_.size()]; }
+
+    Hash hasher_;
+    std::vector<std::unique_ptr<cache_t>> shards_;
+};
+
+}// namespace hucoro
+
+#endif//HUCORO_ASYNC_CACHE_H
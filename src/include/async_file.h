@@ -0,0 +1,164 @@
+//
+// Created by dreamHuang on 2023/3/22.
+//
+
+#ifndef HUCORO_ASYNC_FILE_H
+#define HUCORO_ASYNC_FILE_H
+
+#include "config.h"
+#include "io_driver.h"
+#include "task_local.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+#include <utility>
+#include <vector>
+
+namespace hucoro {
+class AsyncFile;
+
+namespace detail {
+    /// The awaiter of a single file operation of AsyncFile, the AIO operation is stored in it
+    /// (i.e. in the frame of awaiting coroutine), so no allocation is needed.
+    /// `co_await` returns the number of bytes transferred, or throws std::system_error.
+    class AioAwaiter {
+    public:
+        AioAwaiter(IoDriver& driver, std::uint16_t opcode, int fd, void* buf, std::size_t size,
+                   std::int64_t offset) noexcept;
+        AioAwaiter(const AioAwaiter&) = delete;
+        AioAwaiter& operator=(const AioAwaiter&) = delete;
+        /// The coroutine is destroyed while waiting (e.g. cancelled by the shutdown of scheduler),
+        /// the operation is cancelled or waited for, since the kernel writes to it
+        ~AioAwaiter();
+
+        bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> awaiting_coroutine);
+        std::size_t await_resume();
+
+    private:
+        IoDriver& driver_;
+        AioOperation op_;
+        AioWaiter waiter_;
+    };
+}// namespace detail
+
+/// AsyncFile is a file whose reads and writes are submitted to the Linux AIO of the IoDriver of
+/// current scheduler, so that they do not block the scheduler thread.
+///
+/// 1. Open it with `O_DIRECT` to bypass the page cache (otherwise the kernel may complete the
+/// operation synchronously inside `io_submit`). The buffers, offsets and sizes must then be
+/// aligned to the logical block size, the page aligned buffers of BufferPool satisfy it.
+/// 2. Use IoBatch to submit many operations in one syscall.
+/// 3. `advise` / `readahead` control the readahead of the page cache (for buffered I/O).
+class AsyncFile {
+public:
+    AsyncFile() noexcept = default;
+    /// take the ownership of `fd`
+    explicit AsyncFile(int fd) noexcept : fd_(fd) {}
+    AsyncFile(AsyncFile&& other) noexcept : fd_(std::exchange(other.fd_, -1)) {}
+    AsyncFile& operator=(AsyncFile&& other) noexcept {
+        if (this != &other) {
+            close();
+            fd_ = std::exchange(other.fd_, -1);
+        }
+        return *this;
+    }
+    AsyncFile(const AsyncFile&) = delete;
+    AsyncFile& operator=(const AsyncFile&) = delete;
+    ~AsyncFile() { close(); }
+
+    /// `flags` is the same as open(2), throws std::system_error on failure
+    static AsyncFile open(const std::string& path, int flags, mode_t mode = 0644);
+
+    int fd() const noexcept { return fd_; }
+    bool is_open() const noexcept { return fd_ >= 0; }
+    void close() noexcept;
+
+    std::int64_t size() const;
+
+    /// must be awaited inside the scope of scheduler
+    detail::AioAwaiter read_at(void* buf, std::size_t size, std::int64_t offset);
+    detail::AioAwaiter write_at(const void* buf, std::size_t size, std::int64_t offset);
+    detail::AioAwaiter fsync();
+    detail::AioAwaiter fdatasync();
+
+    /// posix_fadvise, e.g. POSIX_FADV_SEQUENTIAL (larger readahead), POSIX_FADV_RANDOM (no readahead)
+    void advise(std::int64_t offset, std::int64_t len, int advice);
+    /// Populate the page cache of [offset, offset + count) in background
+    void readahead(std::int64_t offset, std::size_t count);
+
+private:
+    int fd_ = -1;
+};
+
+/// IoBatch collects file operations and submits all of them with one `io_submit` when it is
+/// awaited by `all()` or `any()`.
+///
+///     IoBatch batch;
+///     for (...) { batch.read_at(file, buf, size, offset); }
+///     co_await batch.all();
+///     batch.result(i); // bytes or -errno
+///
+/// Operations can not be added after submission. If the batch is destroyed before all the
+/// operations complete (e.g. after `any()`), the destructor blocks until they complete.
+class IoBatch {
+public:
+    explicit IoBatch(std::size_t capacity = 0) { ops_.reserve(capacity); }
+    IoBatch(const IoBatch&) = delete;
+    IoBatch& operator=(const IoBatch&) = delete;
+    ~IoBatch();
+
+    /// return the index of the operation in the batch
+    std::size_t read_at(AsyncFile& file, void* buf, std::size_t size, std::int64_t offset);
+    std::size_t write_at(AsyncFile& file, const void* buf, std::size_t size, std::int64_t offset);
+
+    std::size_t size() const noexcept { return ops_.size(); }
+    bool done(std::size_t idx) const noexcept { return ops_[idx].done_; }
+    /// the bytes transferred, or -errno
+    std::int64_t result(std::size_t idx) const noexcept { return ops_[idx].result_; }
+
+    class AwaiterBase {
+    public:
+        AwaiterBase(IoBatch& batch, bool wait_any) noexcept : batch_(batch), wait_any_(wait_any) {}
+        bool await_ready() const noexcept;
+        bool await_suspend(std::coroutine_handle<> awaiting_coroutine);
+
+    protected:
+        IoBatch& batch_;
+        bool wait_any_;
+    };
+
+    class AllAwaiter : public AwaiterBase {
+    public:
+        explicit AllAwaiter(IoBatch& batch) noexcept : AwaiterBase(batch, false) {}
+        void await_resume() const noexcept { batch_.waiter_.context_guard_.restore(); }
+    };
+
+    class AnyAwaiter : public AwaiterBase {
+    public:
+        explicit AnyAwaiter(IoBatch& batch) noexcept : AwaiterBase(batch, true) {}
+        /// the index of the first completed operation
+        std::size_t await_resume() const noexcept {
+            batch_.waiter_.context_guard_.restore();
+            return batch_.waiter_.first_done_;
+        }
+    };
+
+    /// resume when all the operations complete
+    AllAwaiter all() noexcept { return AllAwaiter{*this}; }
+    /// resume when any of the operations complete
+    AnyAwaiter any() noexcept { return AnyAwaiter{*this}; }
+
+private:
+    std::size_t add(std::uint16_t opcode, AsyncFile& file, void* buf, std::size_t size, std::int64_t offset);
+    void submit();
+
+    std::vector<detail::AioOperation> ops_;
+    detail::AioWaiter waiter_;
+    IoDriver* driver_ = nullptr;
+    bool submitted_ = false;
+};
+}// namespace hucoro
+
+#endif//HUCORO_ASYNC_FILE_H
@@ -0,0 +1,493 @@
+//
+// Created by dreamHuang on 2023/4/8.
+//
+
+#ifndef HUCORO_ASYNC_POOL_H
+#define HUCORO_ASYNC_POOL_H
+
+#include "clock.h"
+#include "config.h"
+#include "exception.h"
+#include "io_driver.h"
+#include "single_thread_scheduler.h"
+#include "task.h"
+#include "task_local.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+namespace hucoro {
+
+/// Gauges and counters of AsyncPool (a snapshot)
+struct PoolStats {
+    // the objects owned by the pool, including the leased and the ones being created
+    std::size_t size = 0;
+    std::size_t idle = 0;
+    std::size_t leased = 0;
+    // the suspended acquirers
+    std::size_t waiting = 0;
+    std::size_t max_size = 0;
+
+    // the leases handed out, and how many of them had to wait
+    std::size_t acquired = 0;
+    std::size_t waited = 0;
+    std::size_t created = 0;
+    std::size_t create_failures = 0;
+    // destroyed because of idle for too long
+    std::size_t evicted = 0;
+    // destroyed because of failing the health checks, or discarded by the lease
+    std::size_t discarded = 0;
+
+    std::chrono::nanoseconds total_wait{0};
+    std::chrono::nanoseconds max_wait{0};
+    // the total time of the returned leases, `total_lease / (elapsed * max_size)` is the average utilization
+    std::chrono::nanoseconds total_lease{0};
+
+    /// The fraction of `max_size` being leased now
+    double utilization() const noexcept {
+        return max_size == 0 ? 0.0 : static_cast<double>(leased) / static_cast<double>(max_size);
+    }
+
+    std::chrono::nanoseconds mean_wait() const noexcept {
+        return waited == 0 ? std::chrono::nanoseconds{0} : total_wait / static_cast<std::int64_t>(waited);
+    }
+};
+
+/// AsyncPool<T> lends reusable objects (e.g. backend connections, big scratch buffers):
+///
+///     auto lease = co_await pool.acquire();
+///     co_await lease->query(...);
+///     // returned to the pool when the lease is destroyed
+///
+/// 1. The idle objects are reused in LIFO order (the warm ones first). When there is none, a new one
+/// is created by `factory()` (a Task<T>) if the pool has less than `max_size` objects, otherwise the
+/// acquirer waits. The factory runs in a task spawned on the scheduler of acquirer, and the created
+/// object goes to the longest waiter. A failed creation is thrown to the longest waiter.
+/// 2. The waiters queue intrusively (the node is the awaiter) in FIFO order, and a returned object is
+/// handed to the first waiter directly, so a newcomer never overtakes them.
+/// 3. The objects idle for `idle_timeout` (by `Clock`, RuntimeClock by default) are destroyed by the
+/// next operation of pool or `evict_idle`, but the pool keeps at least `min_size` objects (see
+/// `warm_up` to create them eagerly).
+/// 4. `check_on_acquire` is called on an idle object before it is leased, and `check_on_release` on
+/// a returned object (e.g. to reset it). The object is destroyed if the check returns false or throws.
+///
+/// It is protected by a mutex (which is never held across `co_await` or the hooks), so it can be
+/// shared between scheduler threads: the waiters on other threads are woken by `IoDriver::remote_wake`.
+/// When an object is dropped on a thread without scheduler, the new objects for the waiters are
+/// created by the next operation on a scheduler thread.
+///
+/// NOTE: the pool must outlive all the leases, waiters and in-flight creations.
+template<typename T, typename Clock = RuntimeClock>
+class AsyncPool {
+public:
+    using duration = typename Clock::duration;
+    using time_point = typename Clock::time_point;
+
+    struct Options {
+        std::size_t min_size = 0;
+        std::size_t max_size = 16;
+        std::function<Task<T>()> factory;
+        duration idle_timeout = duration::max();
+        std::function<bool(T&)> check_on_acquire = nullptr;
+        std::function<bool(T&)> check_on_release = nullptr;
+    };
+
+    /// The RAII handle of a leased object, which returns the object to the pool when destroyed
+    class Lease {
+    public:
+        Lease() noexcept = default;
+        Lease(Lease&& other) noexcept
+            : pool_(std::exchange(other.pool_, nullptr)), object_(std::move(other.object_)),
+              acquired_at_(other.acquired_at_) {}
+        Lease& operator=(Lease&& other) noexcept {
+            if (this != &other) {
+                release();
+                pool_ = std::exchange(other.pool_, nullptr);
+                object_ = std::move(other.object_);
+                acquired_at_ = other.acquired_at_;
+            }
+            return *this;
+        }
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        ~Lease() { release(); }
+
+        T& operator*() const noexcept { return *object_; }
+        T* operator->() const noexcept { return object_.get(); }
+        T* get() const noexcept { return object_.get(); }
+        explicit operator bool() const noexcept { return pool_ != nullptr; }
+
+        /// Return the object to the pool now
+        void release() noexcept {
+            if (pool_) { std::exchange(pool_, nullptr)->give_back(std::move(object_), acquired_at_, false); }
+        }
+
+        /// Destroy the object instead of returning it (e.g. a broken connection)
+        void discard() noexcept {
+            if (pool_) { std::exchange(pool_, nullptr)->give_back(std::move(object_), acquired_at_, true); }
+        }
+
+    private:
+        friend class AsyncPool;
+        Lease(AsyncPool& pool, std::unique_ptr<T> object) noexcept
+            : pool_(&pool), object_(std::move(object)), acquired_at_(Clock::now()) {}
+
+        AsyncPool* pool_ = nullptr;
+        std::unique_ptr<T> object_;
+        time_point acquired_at_{};
+    };
+
+    /// The awaiter of `acquire`, which is also the node in the queue of waiters
+    class AcquireAwaiter {
+    public:
+        explicit AcquireAwaiter(AsyncPool& pool) noexcept : pool_(pool) {}
+        AcquireAwaiter(const AcquireAwaiter&) = delete;
+        AcquireAwaiter& operator=(const AcquireAwaiter&) = delete;
+        ~AcquireAwaiter() {
+            // the coroutine is destroyed while waiting, or before taking the handed object
+            if (queued_ || object_) { pool_.abandon(*this); }
+        }
+
+        bool await_ready() { return pool_.take_idle(object_); }
+
+        bool await_suspend(std::coroutine_handle<> awaiting_coroutine) {
+            scheduler_ = SingleThreadScheduler::CURRENT_SCHEDULER;
+            if (!scheduler_) { throw HuCoroGeneralErr("Try acquire from AsyncPool out side the scope of scheduler"); }
+            driver_ = &SingleThreadScheduler::io_driver();
+            node_.coroutine_ = awaiting_coroutine;
+            context_guard_.save(*this);
+            enqueued_at_ = Clock::now();
+            return pool_.enqueue(*this);
+        }
+
+        Lease await_resume() {
+            context_guard_.restore();
+            if (error_) { std::rethrow_exception(error_); }
+            pool_.on_acquired(waited_ ? Clock::now() - enqueued_at_ : duration::zero(), waited_);
+            return Lease{pool_, std::move(object_)};
+        }
+
+    private:
+        friend class AsyncPool;
+
+        AsyncPool& pool_;
+        AcquireAwaiter* next_ = nullptr;
+        AcquireAwaiter* prev_ = nullptr;
+        bool queued_ = false;
+        bool waited_ = false;
+        // set by the one who wakes it
+        std::unique_ptr<T> object_;
+        std::exception_ptr error_;
+        SingleThreadScheduler* scheduler_ = nullptr;
+        IoDriver* driver_ = nullptr;
+        detail::RemoteWakeNode node_;
+        time_point enqueued_at_{};
+        detail::TaskLocalGuard context_guard_;
+    };
+
+    explicit AsyncPool(Options options) : options_(std::move(options)) {
+        if (!options_.factory) { throw HuCoroGeneralErr("AsyncPool need a factory"); }
+        if (options_.max_size == 0 || options_.min_size > options_.max_size) {
+            throw HuCoroGeneralErr("AsyncPool need 0 < max_size and min_size <= max_size");
+        }
+    }
+    AsyncPool(const AsyncPool&) = delete;
+    AsyncPool& operator=(const AsyncPool&) = delete;
+
+    /// `co_await pool.acquire()` returns a Lease, or throws the failure of factory
+    AcquireAwaiter acquire() noexcept { return AcquireAwaiter{*this}; }
+
+    /// Create objects until there are `min_size`, the failure of factory is thrown
+    Task<void> warm_up() {
+        while (true) {
+            {
+                std::lock_guard guard(mutex_);
+                if (size_ >= options_.min_size) { break; }
+                size_ += 1;
+                creating_ += 1;
+            }
+            co_await create(true);
+        }
+    }
+
+    /// Destroy the objects idle for `idle_timeout` (beyond `min_size`), return the number of them
+    std::size_t evict_idle() {
+        std::lock_guard guard(mutex_);
+        return evict(Clock::now());
+    }
+
+    const Options& options() const noexcept { return options_; }
+
+    PoolStats stats() const {
+        PoolStats stats;
+        {
+            std::lock_guard guard(mutex_);
+            stats.size = size_;
+            stats.idle = idle_.size();
+            stats.leased = leased_;
+            stats.waiting = waiting_;
+        }
+        stats.max_size = options_.max_size;
+        stats.acquired = acquired_.load(std::memory_order_relaxed);
+        stats.waited = waited_.load(std::memory_order_relaxed);
+        stats.created = created_.load(std::memory_order_relaxed);
+        stats.create_failures = create_failures_.load(std::memory_order_relaxed);
+        stats.evicted = evicted_.load(std::memory_order_relaxed);
+        stats.discarded = discarded_.load(std::memory_order_relaxed);
+        stats.total_wait = std::chrono::nanoseconds{total_wait_ns_.load(std::memory_order_relaxed)};
+        stats.max_wait = std::chrono::nanoseconds{max_wait_ns_.load(std::memory_order_relaxed)};
+        stats.total_lease = std::chrono::nanoseconds{total_lease_ns_.load(std::memory_order_relaxed)};
+        return stats;
+    }
+
+private:
+    struct IdleObject {
+        std::unique_ptr<T> object_;
+        time_point since_;
+    };
+
+    static bool check(const std::function<bool(T&)>& hook, T& object) noexcept {
+        if (!hook) { return true; }
+        try {
+            return hook(object);
+        } catch (...) { return false; }
+    }
+
+    /// Take the most recently returned idle object which passes `check_on_acquire`
+    bool take_idle(std::unique_ptr<T>& object) {
+        while (true) {
+            {
+                std::lock_guard guard(mutex_);
+                evict(Clock::now());
+                if (idle_.empty()) { return false; }
+                object = std::move(idle_.back().object_);
+                idle_.pop_back();
+                leased_ += 1;
+            }
+            if (check(options_.check_on_acquire, *object)) { return true; }
+            object.reset();
+            drop(true);
+        }
+    }
+
+    /// Queue `waiter`, or return false if there are idle objects again
+    bool enqueue(AcquireAwaiter& waiter) {
+        while (true) {
+            bool queued = false;
+            std::size_t creators = 0;
+            {
+                std::lock_guard guard(mutex_);
+                if (idle_.empty()) {
+                    queued = true;
+                    waiter.prev_ = tail_;
+                    waiter.next_ = nullptr;
+                    (tail_ ? tail_->next_ : head_) = &waiter;
+                    tail_ = &waiter;
+                    waiter.queued_ = true;
+                    waiter.waited_ = true;
+                    waiting_ += 1;
+                    // it will be resumed by the poll of current thread
+                    waiter.driver_->suspend();
+                    creators = reserve_creators();
+                }
+            }
+            if (!queued) {
+                // some objects were returned before locking
+                if (take_idle(waiter.object_)) { return false; }
+                continue;
+            }
+            start_creators(creators);
+            return true;
+        }
+    }
+
+    /// The number of creations needed by the waiters, which are reserved (lock held)
+    std::size_t reserve_creators() noexcept {
+        if (!SingleThreadScheduler::CURRENT_SCHEDULER || waiting_ <= creating_) { return 0; }
+        auto num = std::min(waiting_ - creating_, options_.max_size - size_);
+        size_ += num;
+        creating_ += num;
+        return num;
+    }
+
+    void start_creators(std::size_t num) noexcept {
+        for (std::size_t i = 0; i < num; ++i) {
+            try {
+                SingleThreadScheduler::spawn([this]() { return create(false); });
+            } catch (...) {
+                // e.g. the scheduler is shutting down
+                fail_creation(std::current_exception());
+            }
+        }
+    }
+
+    /// The reservation of the creation has been made
+    Task<void> create(bool rethrow) {
+        std::unique_ptr<T> object;
+        std::exception_ptr error;
+        try {
+            object = std::make_unique<T>(co_await options_.factory());
+        } catch (...) { error = std::current_exception(); }
+        if (error) {
+            if (rethrow) {
+                fail_creation(nullptr);
+                std::rethrow_exception(error);
+            }
+            fail_creation(error);
+            co_return;
+        }
+        created_.fetch_add(1, std::memory_order_relaxed);
+        put(std::move(object), false);
+    }
+
+    /// Cancel a reserved creation, and throw `error` to the first waiter (if any)
+    void fail_creation(std::exception_ptr error) noexcept {
+        AcquireAwaiter* waiter = nullptr;
+        {
+            std::lock_guard guard(mutex_);
+            size_ -= 1;
+            creating_ -= 1;
+            create_failures_.fetch_add(1, std::memory_order_relaxed);
+            if (error && head_) {
+                waiter = pop_waiter();
+                waiter->error_ = std::move(error);
+            }
+        }
+        if (waiter) { wake(*waiter); }
+    }
+
+    /// Put a leased (or just created) object back, which is handed to the first waiter if any
+    void put(std::unique_ptr<T> object, bool leased) noexcept {
+        AcquireAwaiter* waiter = nullptr;
+        {
+            std::lock_guard guard(mutex_);
+            (leased ? leased_ : creating_) -= 1;
+            if (head_) {
+                waiter = pop_waiter();
+                waiter->object_ = std::move(object);
+                leased_ += 1;
+            } else {
+                auto now = Clock::now();
+                idle_.push_back(IdleObject{std::move(object), now});
+                evict(now);
+            }
+        }
+        if (waiter) { wake(*waiter); }
+    }
+
+    /// Forget a destroyed object, and create another one for the waiters
+    void drop(bool leased) noexcept {
+        std::size_t creators = 0;
+        {
+            std::lock_guard guard(mutex_);
+            if (leased) { leased_ -= 1; }
+            size_ -= 1;
+            discarded_.fetch_add(1, std::memory_order_relaxed);
+            creators = reserve_creators();
+        }
+        start_creators(creators);
+    }
+
+    void give_back(std::unique_ptr<T> object, time_point acquired_at, bool discard) noexcept {
+        auto lease_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - acquired_at).count();
+        total_lease_ns_.fetch_add(lease_ns, std::memory_order_relaxed);
+        if (discard || !check(options_.check_on_release, *object)) {
+            object.reset();
+            drop(true);
+            return;
+        }
+        put(std::move(object), true);
+    }
+
+    void on_acquired(duration wait, bool waited) noexcept {
+        acquired_.fetch_add(1, std::memory_order_relaxed);
+        if (!waited) { return; }
+        waited_.fetch_add(1, std::memory_order_relaxed);
+        auto wait_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(wait).count();
+        total_wait_ns_.fetch_add(wait_ns, std::memory_order_relaxed);
+        auto max = max_wait_ns_.load(std::memory_order_relaxed);
+        while (wait_ns > max && !max_wait_ns_.compare_exchange_weak(max, wait_ns, std::memory_order_relaxed)) {}
+    }
+
+    /// The coroutine of `waiter` is destroyed without taking its object
+    void abandon(AcquireAwaiter& waiter) noexcept {
+        std::unique_ptr<T> object;
+        {
+            std::lock_guard guard(mutex_);
+            if (waiter.queued_) { unlink(waiter); }
+            object = std::move(waiter.object_);
+        }
+        if (object) { put(std::move(object), true); }
+    }
+
+    /// Resume the coroutine of a popped waiter on its own thread. `waiter` is invalid after this
+    static void wake(AcquireAwaiter& waiter) noexcept {
+        if (SingleThreadScheduler::CURRENT_SCHEDULER == waiter.scheduler_) {
+            waiter.driver_->wake(waiter.node_.coroutine_);
+        } else {
+            waiter.driver_->remote_wake(waiter.node_);
+        }
+    }
+
+    /// lock held
+    AcquireAwaiter* pop_waiter() noexcept {
+        auto* waiter = head_;
+        unlink(*waiter);
+        return waiter;
+    }
+
+    /// lock held
+    void unlink(AcquireAwaiter& waiter) noexcept {
+        (waiter.prev_ ? waiter.prev_->next_ : head_) = waiter.next_;
+        (waiter.next_ ? waiter.next_->prev_ : tail_) = waiter.prev_;
+        waiter.prev_ = waiter.next_ = nullptr;
+        waiter.queued_ = false;
+        waiting_ -= 1;
+    }
+
+    /// Destroy the objects idle for `idle_timeout` from the least recently used, lock held
+    std::size_t evict(time_point now) {
+        if (options_.idle_timeout == duration::max()) { return 0; }
+        std::size_t evicted = 0;
+        while (!idle_.empty() && size_ > options_.min_size && now - idle_.front().since_ >= options_.idle_timeout) {
+            idle_.pop_front();
+            size_ -= 1;
+            evicted += 1;
+        }
+        evicted_.fetch_add(evicted, std::memory_order_relaxed);
+        return evicted;
+    }
+
+    Options options_;
+    mutable std::mutex mutex_;
+    // the back is the most recently returned
+    std::deque<IdleObject> idle_;
+    // the FIFO queue of waiters
+    AcquireAwaiter* head_ = nullptr;
+    AcquireAwaiter* tail_ = nullptr;
+    std::size_t waiting_ = 0;
+    std::size_t size_ = 0;
+    std::size_t creating_ = 0;
+    std::size_t leased_ = 0;
+
+    std::atomic<std::size_t> acquired_ = 0;
+    std::atomic<std::size_t> waited_ = 0;
+    std::atomic<std::size_t> created_ = 0;
+    std::atomic<std::size_t> create_failures_ = 0;
+    std::atomic<std::size_t> evicted_ = 0;
+    std::atomic<std::size_t> discarded_ = 0;
+    std::atomic<std::int64_t> total_wait_ns_ = 0;
+    std::atomic<std::int64_t> max_wait_ns_ = 0;
+    std::atomic<std::int64_t> total_lease_ns_ = 0;
+};
+}// namespace hucoro
+
+#endif//HUCORO_ASYNC_POOL_H
@@ -0,0 +1,150 @@
+//
+// Created by dreamHuang on 2023/3/20.
+//
+
+#ifndef HUCORO_BUFFER_POOL_H
+#define HUCORO_BUFFER_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace hucoro {
+class BufferPool;
+class BufferRef;
+
+namespace detail {
+    /// The header of a buffer in BufferPool. The headers are stored apart from the data,
+    /// so that the data of every buffer is page aligned and exactly `buffer_size` bytes
+    /// (e.g. can be used with O_DIRECT, or registered to io_uring).
+    class PooledBuffer {
+    public:
+        std::byte* data() const noexcept { return data_; }
+        /// The index in the pool, which can be used as the buffer id of io_uring provided buffers
+        std::uint32_t index() const noexcept { return index_; }
+        BufferPool& pool() const noexcept { return *pool_; }
+        std::uint32_t ref_count() const noexcept { return ref_count_.load(std::memory_order_acquire); }
+
+    private:
+        friend class hucoro::BufferPool;
+        friend class hucoro::BufferRef;
+
+        std::byte* data_ = nullptr;
+        BufferPool* pool_ = nullptr;
+        std::uint32_t index_ = 0;
+        std::atomic<std::uint32_t> ref_count_ = 0;
+        // the link of the free list
+        PooledBuffer* next_ = nullptr;
+    };
+}// namespace detail
+
+/// A reference counted handle of a buffer in BufferPool, the buffer will be returned
+/// to its pool when the last reference is dropped (on any thread).
+class BufferRef {
+public:
+    BufferRef() noexcept = default;
+    BufferRef(const BufferRef& other) noexcept : buffer_(other.buffer_) {
+        if (buffer_) { buffer_->ref_count_.fetch_add(1, std::memory_order_relaxed); }
+    }
+    BufferRef(BufferRef&& other) noexcept : buffer_(std::exchange(other.buffer_, nullptr)) {}
+    BufferRef& operator=(BufferRef other) noexcept {
+        std::swap(buffer_, other.buffer_);
+        return *this;
+    }
+    ~BufferRef() { reset(); }
+
+    void reset() noexcept;
+
+    explicit operator bool() const noexcept { return buffer_ != nullptr; }
+    std::byte* data() const noexcept { return buffer_->data(); }
+    std::size_t capacity() const noexcept;
+    /// true if this is the only reference (i.e. it is safe to write)
+    bool unique() const noexcept { return buffer_->ref_count() == 1; }
+    detail::PooledBuffer* get() const noexcept { return buffer_; }
+
+private:
+    friend class BufferPool;
+    explicit BufferRef(detail::PooledBuffer* buffer) noexcept : buffer_(buffer) {}
+
+    detail::PooledBuffer* buffer_ = nullptr;
+};
+
+/// BufferPool is a pool of fixed-size, page-aligned buffers, which is owned by one thread
+/// (the thread creating it, e.g. the thread of scheduler).
+///
+/// 1. The buffers are allocated in chunks of `buffers_per_chunk` contiguous buffers, the
+/// chunks (`regions()`) can be registered to io_uring as fixed buffers, and `index()` of
+/// buffer can be used as the buffer id of provided buffers.
+/// 2. `allocate` can only be called by the owner thread, while buffers can be released on
+/// any thread: they are pushed into a lock-free list, which is drained by the owner
+/// thread when its local free list is empty.
+///
+/// NOTE: the pool must outlive all the buffers allocated from it.
+class BufferPool {
+public:
+    static constexpr std::size_t DEFAULT_BUFFER_SIZE = 16 * 1024;
+    static constexpr std::size_t DEFAULT_BUFFERS_PER_CHUNK = 64;
+
+    /// `buffer_size` is rounded up to the multiple of page size
+    explicit BufferPool(std::size_t buffer_size = DEFAULT_BUFFER_SIZE,
+                        std::size_t buffers_per_chunk = DEFAULT_BUFFERS_PER_CHUNK);
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+    ~BufferPool();
+
+    BufferRef allocate();
+
+    std::size_t buffer_size() const noexcept { return buffer_size_; }
+    /// The number of buffers owned by the pool (including the ones in use)
+    std::size_t total_buffers() const noexcept { return chunks_.size() * buffers_per_chunk_; }
+    /// The number of buffers ready for `allocate` (only accurate on the owner thread)
+    std::size_t free_buffers() const noexcept;
+
+    detail::PooledBuffer& buffer(std::uint32_t index) noexcept {
+        return headers_[index / buffers_per_chunk_][index % buffers_per_chunk_];
+    }
+
+    /// The contiguous memory regions of all the buffers
+    std::vector<std::span<std::byte>> regions() const;
+
+    static std::size_t page_size() noexcept;
+
+private:
+    friend class BufferRef;
+
+    void release(detail::PooledBuffer* buffer) noexcept;
+    void grow();
+    void drain_remote() noexcept;
+
+    std::size_t buffer_size_;
+    std::size_t buffers_per_chunk_;
+    std::thread::id owner_;
+
+    std::vector<std::byte*> chunks_;
+    std::vector<std::unique_ptr<detail::PooledBuffer[]>> headers_;
+
+    // only accessed by the owner thread
+    detail::PooledBuffer* free_list_ = nullptr;
+    std::size_t free_num_ = 0;
+    // the buffers released by other threads
+    std::atomic<detail::PooledBuffer*> remote_free_ = nullptr;
+    std::atomic<std::size_t> remote_free_num_ = 0;
+};
+
+inline void BufferRef::reset() noexcept {
+    if (buffer_ && buffer_->ref_count_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        buffer_->pool_->release(buffer_);
+    }
+    buffer_ = nullptr;
+}
+
+inline std::size_t BufferRef::capacity() const noexcept { return buffer_->pool().buffer_size(); }
+
+}// namespace hucoro
+
+#endif//HUCORO_BUFFER_POOL_H
@@ -0,0 +1,41 @@
+//
+// Created by dreamHuang on 2023/3/10.
+//
+
+#ifndef HUCORO_CLOCK_H
+#define HUCORO_CLOCK_H
+
+#include <chrono>
+
+namespace hucoro {
+/// The clock of the runtime, which satisfies the requirement of std `Clock`.
+///
+/// To avoid calling `steady_clock::now()` again and again in the hot path (e.g. TTL check),
+/// the scheduler will refresh a thread local cached time point once per loop iteration.
+/// Out of the scope of scheduler, it falls back to `std::chrono::steady_clock`.
+struct RuntimeClock {
+    using underlying_clock = std::chrono::steady_clock;
+    using duration = underlying_clock::duration;
+    using rep = underlying_clock::rep;
+    using period = underlying_clock::period;
+    using time_point = underlying_clock::time_point;
+    static constexpr bool is_steady = true;
+
+    static time_point now() noexcept { return CACHED ? CACHED_NOW : underlying_clock::now(); }
+
+    /// Refresh the cached time point of current thread (called by scheduler)
+    static void refresh() noexcept {
+        CACHED_NOW = underlying_clock::now();
+        CACHED = true;
+    }
+
+    /// Stop caching, `now()` will read the underlying clock directly
+    static void reset() noexcept { CACHED = false; }
+
+private:
+    thread_local static bool CACHED;
+    thread_local static time_point CACHED_NOW;
+};
+}// namespace hucoro
+
+#endif//HUCORO_CLOCK_H
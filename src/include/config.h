@@ -44,4 +44,9 @@ static_assert(false, "could not found coroutine header in clang");
 
 #endif
 
+// The max number of TaskLocal variables in a program (see task_local.h)
+#ifndef HUCORO_TASK_LOCAL_SLOTS
+#    define HUCORO_TASK_LOCAL_SLOTS 16
+#endif
+
 #endif//HUCORO_CONFIG_H
@@ -0,0 +1,739 @@
+//
+// Created by dreamHuang on 2023/4/2.
+//
+
+#ifndef HUCORO_EXECUTION_H
+#define HUCORO_EXECUTION_H
+
+#include "config.h"
+#include "exception.h"
+#include "hucoro_traits.h"
+#include "single_thread_scheduler.h"
+#include "task.h"
+#include "task_local.h"
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+// The max size of the coroutine frame which adapts an awaitable to a sender (see `execution::connect`),
+// the frame is embedded in the operation state if it fits, otherwise it is allocated.
+#ifndef HUCORO_AWAITABLE_SENDER_FRAME_SIZE
+#    define HUCORO_AWAITABLE_SENDER_FRAME_SIZE 256
+#endif
+
+/// A sender/receiver layer in the shape of std::execution (P2300), so that Task, JoinHandle and
+/// the scheduler can take part in sender pipelines, and senders can be `co_await`ed in Task.
+///
+/// It is a subset of P2300 with the customizations by member functions (instead of tag_invoke):
+/// 1. A sender declares `using sender_concept = execution::sender_t;`, `value_type` (void or
+/// the only value it sends) and `connect(receiver) &&` which returns an operation state.
+/// 2. An operation state is neither copyable nor movable, it has `start() noexcept`.
+/// 3. A receiver has `set_value(value)` (or `set_value()` for void), `set_error(std::exception_ptr)`
+/// and `set_stopped()`, all of them are noexcept.
+/// 4. Every awaitable (e.g. Task<T>, JoinHandle<T>, SharedTask<T>) is a sender, which sends the
+/// result of `co_await` (decayed).
+///
+/// None of the algorithms (`then`, `bulk`, `when_all`) allocates: the operation states of the
+/// children are embedded in the parent's.
+namespace hucoro::execution {
+/// The tag of senders
+struct sender_t {};
+
+template<typename S, typename = void>
+struct is_sender : std::false_type {};
+
+template<typename S>
+struct is_sender<S, std::enable_if_t<std::is_same_v<typename S::sender_concept, sender_t>>> : std::true_type {};
+
+template<typename S>
+inline constexpr bool is_sender_v = is_sender<std::remove_cvref_t<S>>::value;
+
+/// The value sent by a sender or an awaitable
+template<typename S, typename = void>
+struct sender_traits {};
+
+template<typename S>
+struct sender_traits<S, std::enable_if_t<is_sender_v<S>>> {
+    using value_type = typename std::remove_cvref_t<S>::value_type;
+};
+
+template<typename S>
+struct sender_traits<S, std::enable_if_t<std::conjunction_v<std::negation<is_sender<std::remove_cvref_t<S>>>,
+                                                             is_awaitable<std::remove_cvref_t<S>>>>> {
+    using value_type = std::remove_cvref_t<typename awaitable_traits<std::remove_cvref_t<S>>::await_return_type>;
+};
+
+template<typename S>
+using sender_value_t = typename sender_traits<S>::value_type;
+
+template<typename S, typename = void>
+inline constexpr bool is_sender_or_awaitable_v = false;
+
+template<typename S>
+inline constexpr bool is_sender_or_awaitable_v<S, std::void_t<sender_value_t<S>>> = true;
+
+namespace detail {
+    /// void can not be stored, so it is replaced by std::monostate
+    template<typename T>
+    using value_or_monostate_t = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+    template<typename Awaitable, typename Receiver>
+    class AwaitableOperation;
+
+    template<typename Op>
+    class AwaitableBridge;
+}// namespace detail
+
+/// Connect `sender` (or an awaitable) with `receiver`, the returned operation state must not be
+/// moved, so it should be used to initialize a variable / member directly.
+template<typename S, typename Receiver>
+auto connect(S&& sender, Receiver receiver) {
+    if constexpr (is_sender_v<S>) {
+        return std::forward<S>(sender).connect(std::move(receiver));
+    } else {
+        static_assert(is_awaitable_v<std::remove_cvref_t<S>>, "connect requires a sender or an awaitable");
+        return detail::AwaitableOperation<std::remove_cvref_t<S>, Receiver>{std::forward<S>(sender),
+                                                                             std::move(receiver)};
+    }
+}
+
+template<typename S, typename Receiver>
+using connect_result_t = decltype(execution::connect(std::declval<S>(), std::declval<Receiver>()));
+
+template<typename Operation>
+void start(Operation& operation) noexcept {
+    operation.start();
+}
+
+namespace detail {
+    /// The coroutine which awaits the awaitable of AwaitableOperation, whose frame is placed
+    /// in the operation state (if it fits)
+    template<typename Op>
+    class AwaitableBridge {
+    public:
+        class promise_type {
+        public:
+            explicit promise_type(Op& op) noexcept : op_(op) {}
+
+            static void* operator new(std::size_t size, Op& op) {
+                return size <= sizeof(op.frame_) ? static_cast<void*>(op.frame_) : ::operator new(size);
+            }
+            static void operator delete(void* ptr, std::size_t size) noexcept {
+                if (size > HUCORO_AWAITABLE_SENDER_FRAME_SIZE) { ::operator delete(ptr); }
+            }
+
+            AwaitableBridge get_return_object() noexcept {
+                return AwaitableBridge{std::coroutine_handle<promise_type>::from_promise(*this)};
+            }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+
+            /// Complete the receiver after the bridge is suspended, since the receiver may
+            /// destroy the operation state (and the frame) at once
+            auto final_suspend() noexcept {
+                struct CompleteAwaiter {
+                    bool await_ready() noexcept { return false; }
+                    void await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+                        handle.promise().op_.complete();
+                    }
+                    void await_resume() noexcept {}
+                };
+                return CompleteAwaiter{};
+            }
+
+            void return_void() noexcept {}
+            void unhandled_exception() noexcept { op_.error_ = std::current_exception(); }
+
+        private:
+            Op& op_;
+        };
+
+        std::coroutine_handle<> handle() const noexcept { return handle_; }
+
+    private:
+        explicit AwaitableBridge(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle) {}
+
+        std::coroutine_handle<promise_type> handle_;
+    };
+
+    template<typename Op>
+    AwaitableBridge<Op> await_into(Op& op) {
+        if constexpr (std::is_void_v<typename Op::value_type>) {
+            co_await std::move(op.awaitable_);
+        } else {
+            op.value_.emplace(co_await std::move(op.awaitable_));
+        }
+    }
+
+    /// The operation state which adapts an awaitable to a sender
+    template<typename Awaitable, typename Receiver>
+    class AwaitableOperation {
+        template<typename Op>
+        friend class AwaitableBridge;
+        template<typename Op>
+        friend AwaitableBridge<Op> await_into(Op& op);
+
+    public:
+        using value_type = sender_value_t<Awaitable>;
+
+        template<typename A>
+        AwaitableOperation(A&& awaitable, Receiver receiver)
+            : awaitable_(std::forward<A>(awaitable)), receiver_(std::move(receiver)) {}
+        AwaitableOperation(const AwaitableOperation&) = delete;
+        AwaitableOperation& operator=(const AwaitableOperation&) = delete;
+        ~AwaitableOperation() {
+            if (bridge_) { bridge_.destroy(); }
+        }
+
+        void start() noexcept {
+            try {
+                bridge_ = await_into(*this).handle();
+            } catch (...) {
+                // failed to allocate the frame
+                receiver_.set_error(std::current_exception());
+                return;
+            }
+            bridge_.resume();
+        }
+
+    private:
+        void complete() noexcept {
+            if (error_) {
+                receiver_.set_error(std::move(error_));
+            } else if constexpr (std::is_void_v<value_type>) {
+                receiver_.set_value();
+            } else {
+                receiver_.set_value(std::move(*value_));
+            }
+        }
+
+        Awaitable awaitable_;
+        Receiver receiver_;
+        std::optional<value_or_monostate_t<value_type>> value_;
+        std::exception_ptr error_;
+        std::coroutine_handle<> bridge_;
+        alignas(std::max_align_t) unsigned char frame_[HUCORO_AWAITABLE_SENDER_FRAME_SIZE];
+    };
+
+    /// The awaiter of `co_await sender`, the operation state is embedded in it
+    template<typename S>
+    class SenderAwaiter {
+    public:
+        using value_type = sender_value_t<S>;
+
+    private:
+        class Receiver {
+        public:
+            explicit Receiver(SenderAwaiter* awaiter) noexcept : awaiter_(awaiter) {}
+
+            template<typename... Args>
+            void set_value(Args&&... args) noexcept {
+                try {
+                    awaiter_->result_.template emplace<1>(std::forward<Args>(args)...);
+                } catch (...) { awaiter_->result_.template emplace<2>(std::current_exception()); }
+                awaiter_->complete();
+            }
+            void set_error(std::exception_ptr error) noexcept {
+                awaiter_->result_.template emplace<2>(std::move(error));
+                awaiter_->complete();
+            }
+            void set_stopped() noexcept { awaiter_->complete(); }
+
+        private:
+            SenderAwaiter* awaiter_;
+        };
+
+    public:
+        explicit SenderAwaiter(S sender) : op_(execution::connect(std::move(sender), Receiver{this})) {}
+        SenderAwaiter(const SenderAwaiter&) = delete;
+        SenderAwaiter& operator=(const SenderAwaiter&) = delete;
+
+        bool await_ready() noexcept { return false; }
+
+        bool await_suspend(std::coroutine_handle<> awaiting_coroutine) noexcept {
+            coroutine_ = awaiting_coroutine;
+            // the receiver may be completed by another task (e.g. the scheduler)
+            context_guard_.save(*this);
+            execution::start(op_);
+            // false if it has completed inline, then continue without suspending
+            return !completed_.exchange(true, std::memory_order_acq_rel);
+        }
+
+        value_type await_resume() {
+            context_guard_.restore();
+            switch (result_.index()) {
+                case 0:
+                    throw HuCoroGeneralErr("The awaited sender is stopped");
+                case 1:
+                    if constexpr (std::is_void_v<value_type>) {
+                        return;
+                    } else {
+                        return std::move(std::get<1>(result_));
+                    }
+                case 2:
+                    std::rethrow_exception(std::get<2>(result_));
+                default:
+                    __builtin_unreachable();
+            }
+        }
+
+    private:
+        void complete() noexcept {
+            if (completed_.exchange(true, std::memory_order_acq_rel)) { coroutine_.resume(); }
+        }
+
+        std::variant<std::monostate, value_or_monostate_t<value_type>, std::exception_ptr> result_;
+        std::coroutine_handle<> coroutine_;
+        hucoro::detail::TaskLocalGuard context_guard_;
+        std::atomic<bool> completed_ = false;
+        connect_result_t<S, Receiver> op_;
+    };
+}// namespace detail
+
+/// `co_await sender` in any coroutine (e.g. Task), the lvalue sender is copied
+template<typename S, std::enable_if_t<is_sender_v<S>, int> = 0>
+detail::SenderAwaiter<std::remove_cvref_t<S>> operator co_await(S&& sender) {
+    return detail::SenderAwaiter<std::remove_cvref_t<S>>{std::forward<S>(sender)};
+}
+
+
+/* just */
+
+template<typename T>
+class JustSender {
+public:
+    using sender_concept = sender_t;
+    using value_type = T;
+
+    explicit JustSender(T value) : value_(std::move(value)) {}
+
+    template<typename Receiver>
+    class Operation {
+    public:
+        Operation(T value, Receiver receiver) : value_(std::move(value)), receiver_(std::move(receiver)) {}
+        Operation(const Operation&) = delete;
+        Operation& operator=(const Operation&) = delete;
+
+        void start() noexcept { receiver_.set_value(std::move(value_)); }
+
+    private:
+        T value_;
+        Receiver receiver_;
+    };
+
+    template<typename Receiver>
+    Operation<Receiver> connect(Receiver receiver) && {
+        return {std::move(value_), std::move(receiver)};
+    }
+
+    template<typename Receiver>
+    Operation<Receiver> connect(Receiver receiver) const& {
+        return {value_, std::move(receiver)};
+    }
+
+private:
+    T value_;
+};
+
+template<>
+class JustSender<void> {
+public:
+    using sender_concept = sender_t;
+    using value_type = void;
+
+    template<typename Receiver>
+    class Operation {
+    public:
+        explicit Operation(Receiver receiver) : receiver_(std::move(receiver)) {}
+        Operation(const Operation&) = delete;
+        Operation& operator=(const Operation&) = delete;
+
+        void start() noexcept { receiver_.set_value(); }
+
+    private:
+        Receiver receiver_;
+    };
+
+    template<typename Receiver>
+    Operation<Receiver> connect(Receiver receiver) const {
+        return Operation<Receiver>{std::move(receiver)};
+    }
+};
+
+inline JustSender<void> just() noexcept { return {}; }
+
+template<typename T>
+JustSender<std::decay_t<T>> just(T&& value) {
+    return JustSender<std::decay_t<T>>{std::forward<T>(value)};
+}
+
+
+/* scheduler */
+
+/// The P2300 scheduler of SingleThreadScheduler (by `get_scheduler()`), which is a cheap handle.
+/// The sender of `schedule()` completes in the next iteration of `block_on`, its operation state
+/// is linked into the scheduler directly (no allocation). It can be started on any thread, which
+/// moves the work onto the scheduler thread (see `SingleThreadScheduler::schedule(ScheduleNode&)`).
+class Scheduler {
+public:
+    explicit Scheduler(SingleThreadScheduler& scheduler) noexcept : scheduler_(&scheduler) {}
+
+    class ScheduleSender {
+    public:
+        using sender_concept = sender_t;
+        using value_type = void;
+
+        template<typename Receiver>
+        class Operation : hucoro::detail::ScheduleNode {
+        public:
+            Operation(SingleThreadScheduler* scheduler, Receiver receiver)
+                : scheduler_(scheduler), receiver_(std::move(receiver)) {}
+            Operation(const Operation&) = delete;
+            Operation& operator=(const Operation&) = delete;
+
+            void start() noexcept {
+                execute_ = &execute;
+                scheduler_->schedule(*this);
+            }
+
+        private:
+            static void execute(hucoro::detail::ScheduleNode* node) noexcept {
+                static_cast<Operation*>(node)->receiver_.set_value();
+            }
+
+            SingleThreadScheduler* scheduler_;
+            Receiver receiver_;
+        };
+
+        explicit ScheduleSender(SingleThreadScheduler* scheduler) noexcept : scheduler_(scheduler) {}
+
+        template<typename Receiver>
+        Operation<Receiver> connect(Receiver receiver) const {
+            return {scheduler_, std::move(receiver)};
+        }
+
+    private:
+        SingleThreadScheduler* scheduler_;
+    };
+
+    ScheduleSender schedule() const noexcept { return ScheduleSender{scheduler_}; }
+
+    friend bool operator==(const Scheduler& lhs, const Scheduler& rhs) noexcept {
+        return lhs.scheduler_ == rhs.scheduler_;
+    }
+
+private:
+    SingleThreadScheduler* scheduler_;
+};
+
+
+/* then */
+
+template<typename S, typename F>
+class ThenSender {
+    template<typename Receiver>
+    class ThenReceiver {
+    public:
+        ThenReceiver(Receiver receiver, F func) : receiver_(std::move(receiver)), func_(std::move(func)) {}
+
+        template<typename... Args>
+        void set_value(Args&&... args) noexcept {
+            try {
+                if constexpr (std::is_void_v<std::invoke_result_t<F, Args...>>) {
+                    std::invoke(func_, std::forward<Args>(args)...);
+                    receiver_.set_value();
+                } else {
+                    receiver_.set_value(std::invoke(func_, std::forward<Args>(args)...));
+                }
+            } catch (...) { receiver_.set_error(std::current_exception()); }
+        }
+        void set_error(std::exception_ptr error) noexcept { receiver_.set_error(std::move(error)); }
+        void set_stopped() noexcept { receiver_.set_stopped(); }
+
+    private:
+        Receiver receiver_;
+        F func_;
+    };
+
+    using input_t = sender_value_t<S>;
+
+public:
+    using sender_concept = sender_t;
+    using value_type = typename std::conditional_t<std::is_void_v<input_t>, std::invoke_result<F>,
+                                                   std::invoke_result<F, input_t>>::type;
+
+    ThenSender(S sender, F func) : sender_(std::move(sender)), func_(std::move(func)) {}
+
+    template<typename Receiver>
+    auto connect(Receiver receiver) && {
+        return execution::connect(std::move(sender_), ThenReceiver<Receiver>{std::move(receiver), std::move(func_)});
+    }
+
+    template<typename Receiver>
+    auto connect(Receiver receiver) const& {
+        return execution::connect(sender_, ThenReceiver<Receiver>{std::move(receiver), func_});
+    }
+
+private:
+    S sender_;
+    F func_;
+};
+
+namespace detail {
+    template<typename F>
+    struct ThenClosure {
+        F func_;
+
+        template<typename S, std::enable_if_t<is_sender_or_awaitable_v<S>, int> = 0>
+        friend ThenSender<std::remove_cvref_t<S>, F> operator|(S&& sender, ThenClosure closure) {
+            return {std::forward<S>(sender), std::move(closure.func_)};
+        }
+    };
+}// namespace detail
+
+/// Send `func(value)` (or `func()` if `sender` sends void), an exception thrown by `func` is sent as error
+template<typename S, typename F, std::enable_if_t<is_sender_or_awaitable_v<S>, int> = 0>
+ThenSender<std::remove_cvref_t<S>, std::decay_t<F>> then(S&& sender, F&& func) {
+    return {std::forward<S>(sender), std::forward<F>(func)};
+}
+
+/// `sender | then(func)`
+template<typename F>
+detail::ThenClosure<std::decay_t<F>> then(F&& func) {
+    return {std::forward<F>(func)};
+}
+
+
+/* bulk */
+
+template<typename S, typename F>
+class BulkSender {
+    template<typename Receiver>
+    class BulkReceiver {
+    public:
+        BulkReceiver(Receiver receiver, std::size_t shape, F func)
+            : receiver_(std::move(receiver)), shape_(shape), func_(std::move(func)) {}
+
+        template<typename... Args>
+        void set_value(Args&&... args) noexcept {
+            try {
+                for (std::size_t i = 0; i < shape_; ++i) { std::invoke(func_, i, args...); }
+            } catch (...) {
+                receiver_.set_error(std::current_exception());
+                return;
+            }
+            receiver_.set_value(std::forward<Args>(args)...);
+        }
+        void set_error(std::exception_ptr error) noexcept { receiver_.set_error(std::move(error)); }
+        void set_stopped() noexcept { receiver_.set_stopped(); }
+
+    private:
+        Receiver receiver_;
+        std::size_t shape_;
+        F func_;
+    };
+
+public:
+    using sender_concept = sender_t;
+    using value_type = sender_value_t<S>;
+
+    BulkSender(S sender, std::size_t shape, F func) : sender_(std::move(sender)), shape_(shape), func_(std::move(func)) {}
+
+    template<typename Receiver>
+    auto connect(Receiver receiver) && {
+        return execution::connect(std::move(sender_),
+                                  BulkReceiver<Receiver>{std::move(receiver), shape_, std::move(func_)});
+    }
+
+    template<typename Receiver>
+    auto connect(Receiver receiver) const& {
+        return execution::connect(sender_, BulkReceiver<Receiver>{std::move(receiver), shape_, func_});
+    }
+
+private:
+    S sender_;
+    std::size_t shape_;
+    F func_;
+};
+
+namespace detail {
+    template<typename F>
+    struct BulkClosure {
+        std::size_t shape_;
+        F func_;
+
+        template<typename S, std::enable_if_t<is_sender_or_awaitable_v<S>, int> = 0>
+        friend BulkSender<std::remove_cvref_t<S>, F> operator|(S&& sender, BulkClosure closure) {
+            return {std::forward<S>(sender), closure.shape_, std::move(closure.func_)};
+        }
+    };
+}// namespace detail
+
+/// Call `func(i, value)` (or `func(i)` if `sender` sends void) for i in [0, shape), then send the value.
+/// The calls run in order on the completing thread, since the scheduler has only one worker.
+template<typename S, typename F, std::enable_if_t<is_sender_or_awaitable_v<S>, int> = 0>
+BulkSender<std::remove_cvref_t<S>, std::decay_t<F>> bulk(S&& sender, std::size_t shape, F&& func) {
+    return {std::forward<S>(sender), shape, std::forward<F>(func)};
+}
+
+/// `sender | bulk(shape, func)`
+template<typename F>
+detail::BulkClosure<std::decay_t<F>> bulk(std::size_t shape, F&& func) {
+    return {shape, std::forward<F>(func)};
+}
+
+
+/* when_all */
+
+template<typename... Ss>
+class WhenAllSender {
+public:
+    using sender_concept = sender_t;
+    /// the value of a void sender is std::monostate
+    using value_type = std::tuple<detail::value_or_monostate_t<sender_value_t<Ss>>...>;
+
+    template<typename Receiver>
+    class Operation {
+        template<std::size_t I>
+        class ChildReceiver {
+        public:
+            explicit ChildReceiver(Operation* op) noexcept : op_(op) {}
+
+            template<typename... Args>
+            void set_value(Args&&... args) noexcept {
+                try {
+                    std::get<I>(op_->values_).emplace(std::forward<Args>(args)...);
+                } catch (...) {
+                    op_->set_error(std::current_exception());
+                    return;
+                }
+                op_->arrive();
+            }
+            void set_error(std::exception_ptr error) noexcept { op_->set_error(std::move(error)); }
+            void set_stopped() noexcept {
+                op_->stopped_.store(true, std::memory_order_relaxed);
+                op_->arrive();
+            }
+
+        private:
+            Operation* op_;
+        };
+
+        /// The operation state of a child, which is constructed in place (it is not movable)
+        template<std::size_t I>
+        struct Child {
+            template<typename Make>
+            explicit Child(Make make) : op_(make()) {}
+
+            connect_result_t<std::tuple_element_t<I, std::tuple<Ss...>>, ChildReceiver<I>> op_;
+        };
+
+        template<typename Indices>
+        struct Children;
+
+        template<std::size_t... Is>
+        struct Children<std::index_sequence<Is...>> {
+            using type = std::tuple<Child<Is>...>;
+        };
+
+    public:
+        Operation(std::tuple<Ss...>&& senders, Receiver receiver)
+            : Operation(std::move(senders), std::move(receiver), std::index_sequence_for<Ss...>{}) {}
+        Operation(const Operation&) = delete;
+        Operation& operator=(const Operation&) = delete;
+
+        void start() noexcept {
+            if constexpr (sizeof...(Ss) == 0) {
+                finish();
+            } else {
+                // the last completed child may destroy `this`, so do not touch it after that
+                std::apply([](auto&... children) { (execution::start(children.op_), ...); }, children_);
+            }
+        }
+
+    private:
+        template<std::size_t... Is>
+        Operation(std::tuple<Ss...>&& senders, Receiver receiver, std::index_sequence<Is...>)
+            : receiver_(std::move(receiver)),
+              children_([&]() {
+                  return execution::connect(std::move(std::get<Is>(senders)), ChildReceiver<Is>{this});
+              }...) {}
+
+        void set_error(std::exception_ptr error) noexcept {
+            if (!failed_.exchange(true, std::memory_order_relaxed)) { error_ = std::move(error); }
+            arrive();
+        }
+
+        void arrive() noexcept {
+            if (remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1) { finish(); }
+        }
+
+        void finish() noexcept {
+            if (failed_.load(std::memory_order_relaxed)) {
+                receiver_.set_error(std::move(error_));
+            } else if (stopped_.load(std::memory_order_relaxed)) {
+                receiver_.set_stopped();
+            } else {
+                try {
+                    auto value = std::apply(
+                            [](auto&... values) { return value_type{std::move(*values)...}; }, values_);
+                    receiver_.set_value(std::move(value));
+                } catch (...) { receiver_.set_error(std::current_exception()); }
+            }
+        }
+
+        Receiver receiver_;
+        std::atomic<std::size_t> remaining_ = sizeof...(Ss);
+        std::atomic<bool> failed_ = false;
+        std::atomic<bool> stopped_ = false;
+        std::exception_ptr error_;
+        std::tuple<std::optional<detail::value_or_monostate_t<sender_value_t<Ss>>>...> values_;
+        typename Children<std::index_sequence_for<Ss...>>::type children_;
+    };
+
+    explicit WhenAllSender(Ss... senders) : senders_(std::move(senders)...) {}
+
+    template<typename Receiver>
+    Operation<Receiver> connect(Receiver receiver) && {
+        return {std::move(senders_), std::move(receiver)};
+    }
+
+private:
+    std::tuple<Ss...> senders_;
+};
+
+/// Send the values of all `senders` in a tuple when all of them complete. If any of them fails,
+/// the (first) error is sent after all of them complete, the others are not cancelled.
+template<typename... Ss, std::enable_if_t<(is_sender_or_awaitable_v<Ss> && ...), int> = 0>
+WhenAllSender<std::remove_cvref_t<Ss>...> when_all(Ss&&... senders) {
+    return WhenAllSender<std::remove_cvref_t<Ss>...>{std::forward<Ss>(senders)...};
+}
+
+
+/* sync_wait */
+
+namespace detail {
+    template<typename S>
+    Task<sender_value_t<S>> as_task(S sender) {
+        co_return co_await std::move(sender);
+    }
+}// namespace detail
+
+/// Run `scheduler` until `sender` (or an awaitable) completes, return the value or rethrow the error
+template<typename S>
+auto sync_wait(SingleThreadScheduler& scheduler, S&& sender) {
+    return scheduler.block_on(
+            [&]() { return detail::as_task<std::remove_cvref_t<S>>(std::forward<S>(sender)); });
+}
+}// namespace hucoro::execution
+
+namespace hucoro {
+inline execution::Scheduler SingleThreadScheduler::get_scheduler() noexcept { return execution::Scheduler{*this}; }
+}// namespace hucoro
+
+#endif//HUCORO_EXECUTION_H
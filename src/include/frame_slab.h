@@ -0,0 +1,77 @@
+//
+// Created by dreamHuang on 2023/3/12.
+//
+
+#ifndef HUCORO_FRAME_SLAB_H
+#define HUCORO_FRAME_SLAB_H
+
+#include <atomic>
+#include <cstddef>
+
+namespace hucoro {
+namespace detail {
+    /// FrameSlab is a contiguous memory block which holds a batch of coroutine frames
+    /// of the same size (e.g. the frames created by `spawn_n`), so that a large fan-out
+    /// pays one allocation instead of one per frame.
+    ///
+    /// The slab is reference counted by the frames allocated from it (and the scope
+    /// allocating from it), the memory is released when the last frame is freed,
+    /// which may happen on any thread.
+    class FrameSlab {
+    public:
+        FrameSlab(const FrameSlab&) = delete;
+        FrameSlab& operator=(const FrameSlab&) = delete;
+
+        /// Return nullptr if the slab is full or `size` is not the frame size of this slab
+        void* try_allocate(std::size_t size) noexcept;
+
+        void release() noexcept;
+
+        /// The number of slabs not released yet (e.g. for tests to check the frames of a batch
+        /// share one slab and it is freed with the last frame)
+        static std::size_t alive_num() noexcept { return ALIVE_NUM.load(std::memory_order_relaxed); }
+
+    private:
+        friend void* allocate_frame(std::size_t size);
+        FrameSlab(std::size_t chunk_size, std::size_t capacity) noexcept;
+
+        static FrameSlab* create(std::size_t frame_size, std::size_t capacity);
+
+        std::size_t chunk_size_;
+        std::size_t capacity_;
+        std::size_t allocated_ = 0;
+        std::atomic<std::size_t> ref_count_;
+        // the chunks follow this object in the same allocation
+
+        static std::atomic<std::size_t> ALIVE_NUM;
+    };
+
+    /// While a FrameSlabScope is alive, the frames allocated by `allocate_frame` in
+    /// current thread come from one slab with room for `capacity` frames. The slab is
+    /// created lazily by the first allocation, whose size decides the frame size.
+    /// Frames of other sizes (or beyond capacity) fall back to the global allocator.
+    class FrameSlabScope {
+    public:
+        explicit FrameSlabScope(std::size_t capacity) noexcept;
+        FrameSlabScope(const FrameSlabScope&) = delete;
+        FrameSlabScope& operator=(const FrameSlabScope&) = delete;
+        ~FrameSlabScope();
+
+    private:
+        friend void* allocate_frame(std::size_t size);
+
+        std::size_t capacity_;
+        FrameSlab* slab_ = nullptr;
+        FrameSlabScope* prev_;
+
+        thread_local static FrameSlabScope* CURRENT_SCOPE;
+    };
+
+    /// Used by the `operator new / delete` of promise types.
+    /// Every frame is prefixed with a small header recording the slab it belongs to.
+    void* allocate_frame(std::size_t size);
+    void deallocate_frame(void* ptr) noexcept;
+}// namespace detail
+}// namespace hucoro
+
+#endif//HUCORO_FRAME_SLAB_H
@@ -39,25 +39,40 @@ template<typename T, typename U = void>
 inline constexpr bool is_awaiter_v = is_awaiter<T, U>::value;
 
 
+template<typename T, typename = void>
+struct has_member_co_await : std::false_type {};
+
+template<typename T>
+struct has_member_co_await<T, std::enable_if_t<is_awaiter_v<decltype(std::declval<T>().operator co_await())>>>
+    : std::true_type {};
+
+template<typename T, typename = void>
+struct has_free_co_await : std::false_type {};
+
+template<typename T>
+struct has_free_co_await<T, std::enable_if_t<is_awaiter_v<decltype(operator co_await(std::declval<T>()))>>>
+    : std::true_type {};
+
+
 template<typename T, typename = void>
 struct awaitable_traits {};
 
 template<typename T>
-struct awaitable_traits<T, std::enable_if_t<is_awaiter_v<decltype(std::declval<T>().operator co_await())>>> {
+struct awaitable_traits<T, std::enable_if_t<has_member_co_await<T>::value>> {
     using awaiter_type = decltype(std::declval<T>().operator co_await());
     using await_return_type = typename is_awaiter<awaiter_type>::await_return_type;
 };
 
 template<typename T>
-struct awaitable_traits<T, std::enable_if_t<is_awaiter_v<decltype(operator co_await(std::declval<T>()))>>> {
+struct awaitable_traits<T, std::enable_if_t<has_free_co_await<T>::value>> {
     using awaiter_type = decltype(operator co_await(std::declval<T>()));
     using await_return_type = typename is_awaiter<awaiter_type>::await_return_type;
 };
 
+/// An awaiter (e.g. JoinHandle) is also an awaitable
 template<typename T>
 struct awaitable_traits<
-        T, std::enable_if_t<!is_awaiter_v<decltype(std::declval<T>().operator co_await())> &&
-                            !is_awaiter_v<decltype(operator co_await(std::declval<T>()))> && is_awaiter_v<T>>> {
+        T, std::enable_if_t<!has_member_co_await<T>::value && !has_free_co_await<T>::value && is_awaiter_v<T>>> {
     using awaiter_type = T;
     using await_return_type = typename is_awaiter<T>::await_return_type;
 };
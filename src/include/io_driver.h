@@ -0,0 +1,273 @@
+//
+// Created by dreamHuang on 2023/3/22.
+//
+
+#ifndef HUCORO_IO_DRIVER_H
+#define HUCORO_IO_DRIVER_H
+
+#include "config.h"
+#include "exception.h"
+#include "task_local.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <linux/aio_abi.h>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace hucoro {
+class IoDriver;
+
+namespace detail {
+    /// Something registered to the epoll of IoDriver
+    class IoSource {
+    public:
+        virtual ~IoSource() = default;
+        virtual void on_event(std::uint32_t events) = 0;
+    };
+
+    class AioContext;
+    struct AioWaiter;
+
+    /// A coroutine woken from another thread (see `IoDriver::remote_wake`), which usually lives
+    /// in the frame of the suspended coroutine
+    struct RemoteWakeNode {
+        RemoteWakeNode* next_ = nullptr;
+        std::coroutine_handle<> coroutine_ = nullptr;
+    };
+
+    /// Something without fd whose readiness is checked by every `IoDriver::poll` (e.g. std::future),
+    /// `is_ready_` is reset to null when it is ready and removed
+    struct PollableNode {
+        PollableNode* prev_ = nullptr;
+        PollableNode* next_ = nullptr;
+        bool (*is_ready_)(PollableNode* node) = nullptr;
+        std::coroutine_handle<> coroutine_ = nullptr;
+    };
+}// namespace detail
+
+enum class Interest {
+    READABLE,
+    WRITABLE,
+};
+
+/// IoRegistration registers a non-blocking fd to the IoDriver (edge-triggered), and records
+/// its readiness. The usual pattern is:
+///
+///     while ((n = ::read(fd, ...)) < 0 && errno == EAGAIN) {
+///         registration.clear_ready(Interest::READABLE);
+///         co_await registration.ready(Interest::READABLE);
+///     }
+///
+/// At most one coroutine can wait for each interest at the same time.
+/// The registration does not own the fd, and it must be destroyed before the fd is closed.
+class IoRegistration : public detail::IoSource {
+public:
+    IoRegistration(IoDriver& driver, int fd);
+    IoRegistration(const IoRegistration&) = delete;
+    IoRegistration& operator=(const IoRegistration&) = delete;
+    ~IoRegistration() override;
+
+    int fd() const noexcept { return fd_; }
+    IoDriver& driver() const noexcept { return *driver_; }
+
+    bool is_ready(Interest interest) const noexcept { return ready_[index(interest)]; }
+    void clear_ready(Interest interest) noexcept { ready_[index(interest)] = false; }
+
+    class ReadyAwaiter {
+    public:
+        ReadyAwaiter(IoRegistration& registration, Interest interest) noexcept
+            : registration_(registration), interest_(interest) {}
+        bool await_ready() const noexcept { return registration_.is_ready(interest_); }
+        void await_suspend(std::coroutine_handle<> awaiting_coroutine);
+        void await_resume() const noexcept { context_guard_.restore(); }
+
+    private:
+        IoRegistration& registration_;
+        Interest interest_;
+        detail::TaskLocalGuard context_guard_;
+    };
+
+    /// Wait until the fd is ready for `interest` (or hang up / error)
+    ReadyAwaiter ready(Interest interest) noexcept { return {*this, interest}; }
+
+    void on_event(std::uint32_t events) override;
+
+private:
+    static std::size_t index(Interest interest) noexcept { return static_cast<std::size_t>(interest); }
+
+    IoDriver* driver_;
+    int fd_;
+    bool ready_[2] = {false, false};
+    std::coroutine_handle<> waiters_[2] = {nullptr, nullptr};
+};
+
+/// AsyncFd owns a non-blocking fd, which is registered to the IoDriver of current scheduler by
+/// the first `wait`. So it must be used by one scheduler thread, it must be destroyed before that
+/// scheduler, and it must not be moved while a coroutine is waiting on it.
+class AsyncFd {
+public:
+    AsyncFd() noexcept = default;
+    /// take the ownership of `fd`, which will be set to non-blocking
+    explicit AsyncFd(int fd);
+    AsyncFd(AsyncFd&& other) noexcept
+        : fd_(std::exchange(other.fd_, -1)), registration_(std::move(other.registration_)) {}
+    AsyncFd& operator=(AsyncFd&& other) noexcept {
+        if (this != &other) {
+            close();
+            fd_ = std::exchange(other.fd_, -1);
+            registration_ = std::move(other.registration_);
+        }
+        return *this;
+    }
+    AsyncFd(const AsyncFd&) = delete;
+    AsyncFd& operator=(const AsyncFd&) = delete;
+    ~AsyncFd() { close(); }
+
+    int fd() const noexcept { return fd_; }
+    bool is_open() const noexcept { return fd_ >= 0; }
+    void close() noexcept;
+
+    /// Wait for the next edge of `interest`, i.e. after the last operation returned EAGAIN
+    IoRegistration::ReadyAwaiter wait(Interest interest);
+
+private:
+    int fd_ = -1;
+    // IoRegistration can not be moved, since its address is registered in epoll
+    std::unique_ptr<IoRegistration> registration_;
+};
+
+/// IoDriver is the reactor of scheduler (one per scheduler thread), which is driven by the
+/// `block_on` loop through `poll`. It is based on epoll for the readiness of fds, and Linux
+/// native AIO (whose completion is notified by an eventfd in the epoll) for files.
+///
+/// The coroutines are not resumed inside the handling of events, they are collected and
+/// resumed after all the events of one `epoll_wait` have been handled.
+///
+/// Other threads can only use `remote_wake` / `notify`, which interrupt the `epoll_wait` by an eventfd.
+class IoDriver {
+public:
+    IoDriver();
+    IoDriver(const IoDriver&) = delete;
+    IoDriver& operator=(const IoDriver&) = delete;
+    ~IoDriver();
+
+    /// Wait at most `timeout_ms` (-1 means infinite) for events, and resume the coroutines
+    /// whose events are ready. Return the number of coroutines resumed.
+    std::size_t poll(int timeout_ms);
+
+    /// The number of coroutines suspended on this driver (including the woken but not resumed)
+    std::size_t waiting() const noexcept { return waiting_; }
+
+    /// The AIO context is created lazily by the first file operation
+    detail::AioContext& aio();
+
+    int epoll_fd() const noexcept { return epoll_fd_; }
+
+    /* used by the io sources */
+    void add(int fd, std::uint32_t events, detail::IoSource* source);
+    void remove(int fd) noexcept;
+    void suspend() noexcept { waiting_ += 1; }
+    /// The coroutine will be resumed by the current (or next) `poll`
+    void wake(std::coroutine_handle<> coroutine);
+
+    /// Thread safe, interrupt the current (or next) `poll` without resuming any coroutine
+    void notify() noexcept;
+
+    /// Thread safe version of `wake`, the coroutine of `node` will be resumed by the next `poll`.
+    /// `node` must not be touched after this call, since the coroutine may have been resumed.
+    void remote_wake(detail::RemoteWakeNode& node) noexcept;
+
+    /// Whether `coroutine` has been woken but not resumed (the remote wakes are taken first), e.g.
+    /// to wait until a remote completion stops touching the frame before destroying it
+    bool woken(std::coroutine_handle<> coroutine);
+
+    /// `node` is checked by every `poll` until it is ready (then woken) or removed. When there is
+    /// any pollable, `poll` waits at most POLLABLE_INTERVAL_MS, which bounds the latency of them.
+    void add_pollable(detail::PollableNode& node) noexcept;
+    void remove_pollable(detail::PollableNode& node) noexcept;
+
+    static constexpr int POLLABLE_INTERVAL_MS = 1;
+
+private:
+    void drain_remote();
+    void check_pollables();
+
+    int epoll_fd_;
+    // the eventfd written by `remote_wake`
+    int wake_fd_;
+    std::atomic<detail::RemoteWakeNode*> remote_head_ = nullptr;
+    // the number of running `remote_wake`, which must be 0 before destruction
+    std::atomic<int> remote_wakers_ = 0;
+    detail::PollableNode* pollable_head_ = nullptr;
+    std::size_t waiting_ = 0;
+    std::vector<std::coroutine_handle<>> ready_;
+    // swapped with `ready_` in `poll`, to reuse the memory
+    std::vector<std::coroutine_handle<>> resuming_;
+    std::unique_ptr<detail::AioContext> aio_;
+};
+
+namespace detail {
+    /// One AIO operation (e.g. a read), which usually lives in the frame of awaiting coroutine
+    struct AioOperation {
+        struct iocb iocb_ {};
+        // the index in its group (see AioWaiter::first_done_)
+        std::size_t index_ = 0;
+        // bytes transferred, or -errno
+        std::int64_t result_ = 0;
+        bool submitted_ = false;
+        bool done_ = false;
+        AioWaiter* waiter_ = nullptr;
+
+        void prepare(std::uint16_t opcode, int fd, void* buf, std::size_t size, std::int64_t offset) noexcept;
+    };
+
+    /// The coroutine waiting for a group of AioOperation (all or any of them)
+    struct AioWaiter {
+        std::coroutine_handle<> coroutine_ = nullptr;
+        // the operations have not completed
+        std::size_t remaining_ = 0;
+        bool wait_any_ = false;
+        std::size_t first_done_ = SIZE_MAX;
+        TaskLocalGuard context_guard_;
+    };
+
+    class AioContext : public IoSource {
+    public:
+        static constexpr unsigned MAX_EVENTS = 256;
+
+        explicit AioContext(IoDriver& driver);
+        AioContext(const AioContext&) = delete;
+        AioContext& operator=(const AioContext&) = delete;
+        ~AioContext() override;
+
+        /// Submit all the operations in one `io_submit` (as far as possible). The operations
+        /// failed to submit are completed immediately with -errno.
+        void submit(AioOperation* ops, std::size_t num);
+
+        /// Handle the completed operations, block until at least one completed if `blocking`
+        void reap(bool blocking);
+
+        /// Cancel the submitted `op` (if supported by the kernel, e.g. a poll), and wait until it
+        /// completes, so that its memory can be released. Its waiter is not woken.
+        void cancel(AioOperation& op);
+
+        /// The number of submitted but not completed operations
+        std::size_t in_flight() const noexcept { return in_flight_; }
+
+        void on_event(std::uint32_t events) override;
+
+    private:
+        /// mark `op` as done, and wake its waiter if the waiting condition is satisfied
+        void complete(AioOperation& op, std::int64_t result);
+
+        IoDriver& driver_;
+        aio_context_t context_ = 0;
+        int event_fd_ = -1;
+        std::size_t in_flight_ = 0;
+    };
+}// namespace detail
+}// namespace hucoro
+
+#endif//HUCORO_IO_DRIVER_H
@@ -0,0 +1,80 @@
+//
+// Created by dreamHuang on 2023/3/20.
+//
+
+#ifndef HUCORO_IOBUF_H
+#define HUCORO_IOBUF_H
+
+#include "buffer_pool.h"
+#include <cstddef>
+#include <deque>
+#include <span>
+#include <string>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+namespace hucoro {
+/// IOBuf is a chain of byte ranges in the buffers of BufferPool.
+///
+/// The ranges refer to the buffers by BufferRef, so splitting, appending and cloning only
+/// move the references instead of copying the bytes, and the chain can be written with
+/// one `writev`. A buffer may be shared by several IOBufs, it is only written (by
+/// `prepare` / `commit`) when it is not shared.
+class IOBuf {
+public:
+    IOBuf() = default;
+    IOBuf(IOBuf&& other) noexcept;
+    IOBuf& operator=(IOBuf&& other) noexcept;
+    // use `clone()` to share the buffers explicitly
+    IOBuf(const IOBuf&) = delete;
+    IOBuf& operator=(const IOBuf&) = delete;
+
+    /// Another IOBuf refer to the same bytes (without copy)
+    IOBuf clone() const;
+
+    std::size_t length() const noexcept { return length_; }
+    bool empty() const noexcept { return length_ == 0; }
+    std::size_t segment_num() const noexcept { return segments_.size(); }
+
+    /// Writable space at the tail, which will allocate a new buffer from `pool` if the
+    /// tail buffer is full or shared. The space is appended to the chain by `commit`.
+    std::span<std::byte> prepare(BufferPool& pool);
+    void commit(std::size_t n);
+
+    /// Copy the bytes into the buffers of `pool`
+    void append(const void* data, std::size_t size, BufferPool& pool);
+    /// Move the segments of `other` to the tail of this one
+    void append(IOBuf&& other);
+
+    /// Remove the first `n` bytes and return them as a new IOBuf
+    IOBuf split(std::size_t n);
+    void trim_front(std::size_t n);
+
+    /// Fill at most `max_iov` iovec with the segments, return the number of iovec used
+    std::size_t to_iovec(struct iovec* iov, std::size_t max_iov) const noexcept;
+
+    /// Copy at most `size` bytes from the front, return the number of bytes copied
+    std::size_t copy_to(void* dest, std::size_t size) const noexcept;
+    std::string to_string() const;
+
+    /// `read` once from `fd` into `prepare(pool)`, return the same as `read`
+    ssize_t read_from(int fd, BufferPool& pool);
+    /// `writev` once to `fd` and drop the bytes written, return the same as `writev`
+    ssize_t write_to(int fd);
+
+private:
+    struct Segment {
+        BufferRef buffer_;
+        std::size_t offset_;
+        std::size_t length_;
+    };
+
+    std::deque<Segment> segments_;
+    std::size_t length_ = 0;
+    // the tail buffer returned by the last `prepare`
+    BufferRef pending_;
+    std::size_t pending_offset_ = 0;
+};
+}// namespace hucoro
+
+#endif//HUCORO_IOBUF_H
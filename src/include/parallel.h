@@ -0,0 +1,168 @@
+//
+// Created by dreamHuang on 2023/3/14.
+//
+
+#ifndef HUCORO_PARALLEL_H
+#define HUCORO_PARALLEL_H
+
+#include "config.h"
+#include "single_thread_scheduler.h"
+#include "task.h"
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <utility>
+
+/// Data parallel algorithms built on top of `spawn`.
+///
+/// The work is split recursively into halves: one half is spawned and the other half is
+/// processed by current coroutine, until the size reaches the grain. When `grain == 0`,
+/// it is chosen adaptively to produce about `4 * concurrency` chunks.
+///
+/// When the current scheduler can not run tasks in parallel (e.g. SingleThreadScheduler,
+/// or there is no scheduler at all), they degrade to sequential code without spawning.
+///
+/// If any part throws, the other parts are still joined before the exception is rethrown,
+/// since the spawned parts refer to the arguments (e.g. `body`) in the frame of the caller.
+namespace hucoro {
+namespace detail {
+    /// While alive, the parallel algorithms of current thread see `concurrency` instead of the one
+    /// of current scheduler, so the split path can be exercised on a SingleThreadScheduler (e.g. tests)
+    class ConcurrencyOverride {
+    public:
+        explicit ConcurrencyOverride(std::size_t concurrency) noexcept
+            : prev_(std::exchange(CURRENT, concurrency)) {}
+        ConcurrencyOverride(const ConcurrencyOverride&) = delete;
+        ConcurrencyOverride& operator=(const ConcurrencyOverride&) = delete;
+        ~ConcurrencyOverride() { CURRENT = prev_; }
+
+        /// 0 if not overridden
+        static std::size_t current() noexcept { return CURRENT; }
+
+    private:
+        std::size_t prev_;
+
+        inline thread_local static std::size_t CURRENT = 0;
+    };
+
+    inline std::size_t parallel_concurrency() noexcept {
+        auto overridden = ConcurrencyOverride::current();
+        return overridden != 0 ? overridden : SingleThreadScheduler::concurrency();
+    }
+
+    inline bool run_sequential(std::size_t size, std::size_t grain) {
+        return size <= grain || parallel_concurrency() <= 1;
+    }
+
+    inline std::size_t adaptive_grain(std::size_t size, std::size_t grain) {
+        if (grain != 0) { return grain; }
+        return std::max<std::size_t>(1, size / (4 * parallel_concurrency()));
+    }
+
+    /// Join the spawned half after the inline half threw, then rethrow `error`
+    template<typename Result>
+    Task<void> join_and_rethrow(JoinHandle<Result>& left, std::exception_ptr error) {
+        try {
+            co_await left;
+        } catch (...) {
+            // only the first error is reported
+        }
+        std::rethrow_exception(error);
+    }
+
+    template<typename It, typename Body>
+    Task<void> parallel_for_impl(It first, It last, std::size_t grain, Body& body) {
+        auto size = static_cast<std::size_t>(last - first);
+        if (run_sequential(size, grain)) {
+            for (; first != last; ++first) { body(*first); }
+            co_return;
+        }
+        It mid = first + size / 2;
+        auto left = SingleThreadScheduler::spawn(
+                [first, mid, grain, &body]() { return parallel_for_impl(first, mid, grain, body); });
+        std::exception_ptr error;
+        try {
+            co_await parallel_for_impl(mid, last, grain, body);
+        } catch (...) { error = std::current_exception(); }
+        if (error) { co_await join_and_rethrow(left, std::move(error)); }
+        co_await left;
+    }
+
+    template<typename It, typename T, typename Reduce, typename Transform>
+    Task<T> parallel_transform_reduce_impl(It first, It last, T init, std::size_t grain, Reduce& reduce,
+                                           Transform& transform) {
+        auto size = static_cast<std::size_t>(last - first);
+        if (run_sequential(size, grain)) {
+            for (; first != last; ++first) { init = reduce(std::move(init), transform(*first)); }
+            co_return init;
+        }
+        It mid = first + size / 2;
+        // the spawned half start from its first element, so that `init` is only used once
+        auto left = SingleThreadScheduler::spawn([first, mid, grain, &reduce, &transform]() {
+            return parallel_transform_reduce_impl(std::next(first), mid, T(transform(*first)), grain, reduce,
+                                                  transform);
+        });
+        std::optional<T> right;
+        std::exception_ptr error;
+        try {
+            right.emplace(co_await parallel_transform_reduce_impl(mid, last, std::move(init), grain, reduce, transform));
+        } catch (...) { error = std::current_exception(); }
+        if (error) { co_await join_and_rethrow(left, std::move(error)); }
+        co_return reduce(std::move(co_await left), std::move(*right));
+    }
+
+    template<typename It, typename Compare>
+    Task<void> parallel_sort_impl(It first, It last, std::size_t grain, Compare& comp) {
+        auto size = static_cast<std::size_t>(last - first);
+        if (run_sequential(size, grain)) {
+            std::sort(first, last, comp);
+            co_return;
+        }
+        It mid = first + size / 2;
+        auto left = SingleThreadScheduler::spawn(
+                [first, mid, grain, &comp]() { return parallel_sort_impl(first, mid, grain, comp); });
+        std::exception_ptr error;
+        try {
+            co_await parallel_sort_impl(mid, last, grain, comp);
+        } catch (...) { error = std::current_exception(); }
+        if (error) { co_await join_and_rethrow(left, std::move(error)); }
+        co_await left;
+        std::inplace_merge(first, mid, last, comp);
+    }
+}// namespace detail
+
+/// Call `body(element)` for every element of the random access `range`.
+/// `body` may be called concurrently on different elements.
+template<typename Range, typename Body>
+Task<void> parallel_for(Range& range, std::size_t grain, Body body) {
+    auto first = std::begin(range);
+    auto last = std::end(range);
+    grain = detail::adaptive_grain(static_cast<std::size_t>(last - first), grain);
+    co_await detail::parallel_for_impl(first, last, grain, body);
+}
+
+/// Return `reduce(... reduce(init, transform(e0)) ..., transform(eN))`, while the order of
+/// reduction is unspecified (i.e. `reduce` should be associative and commutative).
+template<typename Range, typename T, typename Reduce, typename Transform>
+Task<T> parallel_transform_reduce(Range& range, T init, Reduce reduce, Transform transform, std::size_t grain = 0) {
+    auto first = std::begin(range);
+    auto last = std::end(range);
+    grain = detail::adaptive_grain(static_cast<std::size_t>(last - first), grain);
+    co_return co_await detail::parallel_transform_reduce_impl(first, last, std::move(init), grain, reduce, transform);
+}
+
+/// Sort the random access `range`, it is not stable.
+template<typename Range, typename Compare = std::less<>>
+Task<void> parallel_sort(Range& range, Compare comp = {}, std::size_t grain = 0) {
+    auto first = std::begin(range);
+    auto last = std::end(range);
+    grain = detail::adaptive_grain(static_cast<std::size_t>(last - first), grain);
+    co_await detail::parallel_sort_impl(first, last, grain, comp);
+}
+
+}// namespace hucoro
+
+#endif//HUCORO_PARALLEL_H
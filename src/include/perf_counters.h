@@ -0,0 +1,90 @@
+//
+// Created by dreamHuang on 2023/3/28.
+//
+
+#ifndef HUCORO_PERF_COUNTERS_H
+#define HUCORO_PERF_COUNTERS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace hucoro {
+enum class PerfEvent {
+    CYCLES,
+    INSTRUCTIONS,
+    BRANCH_MISSES,
+    L1D_MISSES,
+    LLC_MISSES,
+    CONTEXT_SWITCHES,
+};
+
+constexpr std::size_t PERF_EVENT_NUM = 6;
+
+const char* perf_event_name(PerfEvent event) noexcept;
+
+/// The values of the events, which are only meaningful for the available events
+struct PerfSample {
+    std::array<std::uint64_t, PERF_EVENT_NUM> values{};
+
+    std::uint64_t operator[](PerfEvent event) const noexcept { return values[static_cast<std::size_t>(event)]; }
+    std::uint64_t& operator[](PerfEvent event) noexcept { return values[static_cast<std::size_t>(event)]; }
+
+    PerfSample& operator+=(const PerfSample& other) noexcept;
+    PerfSample operator-(const PerfSample& other) const noexcept;
+};
+
+/// PerfCounters counts the hardware (and software) events of the calling thread by
+/// `perf_event_open`, in user space only.
+///
+/// The events are opened as one group whose leader is the first available event, so `read` gets
+/// all of them by one syscall at the same time (an event refused by the group is read separately).
+/// The events can not be opened are unavailable (e.g. in a VM without PMU, or a container with
+/// a high `perf_event_paranoid`), and they are simply reported as unavailable instead of errors.
+///
+///     PerfCounters counters;
+///     auto begin = counters.read();
+///     ...
+///     auto delta = counters.read() - begin;
+class PerfCounters {
+public:
+    /// The counters start counting once created
+    PerfCounters() noexcept;
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+    ~PerfCounters();
+
+    /// Whether any event is available
+    bool available() const noexcept;
+    bool available(PerfEvent event) const noexcept { return fds_[static_cast<std::size_t>(event)] >= 0; }
+
+    /// The current values of the events (0 for the unavailable ones)
+    PerfSample read() const noexcept;
+
+    /// e.g. "cycles=1000 instructions=2000 branch-misses=n/a ..." with the values divided by `divisor`
+    std::string format(const PerfSample& sample, double divisor = 1) const;
+
+private:
+    std::array<int, PERF_EVENT_NUM> fds_;
+    // the position of each event in the values read from the leader, -1 if not in the group
+    std::array<int, PERF_EVENT_NUM> group_index_;
+    int leader_ = -1;
+    int group_size_ = 0;
+};
+
+/// The events of the resumed tasks sampled by scheduler (see `SingleThreadScheduler::enable_perf_sampling`)
+struct TaskPerfStats {
+    // the number of resumes measured
+    std::uint64_t sampled = 0;
+    // the sum of the events of the sampled resumes
+    PerfSample total;
+
+    /// The mean of `event` per resumed task
+    double per_task(PerfEvent event) const noexcept {
+        return sampled == 0 ? 0 : static_cast<double>(total[event]) / static_cast<double>(sampled);
+    }
+};
+}// namespace hucoro
+
+#endif//HUCORO_PERF_COUNTERS_H
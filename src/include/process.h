@@ -0,0 +1,134 @@
+//
+// Created by dreamHuang on 2023/3/26.
+//
+
+#ifndef HUCORO_PROCESS_H
+#define HUCORO_PROCESS_H
+
+#include "config.h"
+#include "io_driver.h"
+#include "task.h"
+#include <csignal>
+#include <cstddef>
+#include <initializer_list>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+namespace hucoro {
+/// One end of a non-blocking pipe, see AsyncFd for the constraints.
+/// Note that writing to a pipe whose read end is closed raises SIGPIPE (unless it is ignored).
+class Pipe {
+public:
+    Pipe() noexcept = default;
+    /// take the ownership of `fd`, which will be set to non-blocking
+    explicit Pipe(int fd) : io_(fd) {}
+
+    int fd() const noexcept { return io_.fd(); }
+    bool is_open() const noexcept { return io_.is_open(); }
+    /// e.g. close the stdin of child process to send EOF
+    void close() noexcept { io_.close(); }
+
+    /// Read at most `size` bytes, return 0 at the end of pipe
+    Task<std::size_t> read(void* buf, std::size_t size);
+    /// Read until the end of pipe
+    Task<std::string> read_to_end();
+    /// Write all the `size` bytes
+    Task<void> write(const void* buf, std::size_t size);
+
+private:
+    AsyncFd io_;
+};
+
+/// How the child process terminated
+struct ExitStatus {
+    // the exit code if exited normally
+    int code = 0;
+    // the signal number if killed by signal, otherwise 0
+    int signal = 0;
+
+    bool success() const noexcept { return code == 0 && signal == 0; }
+};
+
+/// A child process, which is monitored by a pidfd in the IoDriver of current scheduler, so that
+/// `co_await wait()` does not block the scheduler thread (and does not need SIGCHLD or a thread).
+///
+///     auto proc = Process::spawn({"sh", "-c", "echo hi"}, {.pipe_stdout = true});
+///     auto output = co_await proc.stdout_pipe().read_to_end();
+///     auto status = co_await proc.wait();
+///
+/// The process should be waited, otherwise it is only reaped by the destructor if it has exited.
+class Process {
+public:
+    struct Options {
+        // create pipes for the stdio, otherwise they are inherited
+        bool pipe_stdin = false;
+        bool pipe_stdout = false;
+        bool pipe_stderr = false;
+    };
+
+    Process(Process&& other) noexcept;
+    Process& operator=(Process&& other) noexcept;
+    Process(const Process&) = delete;
+    Process& operator=(const Process&) = delete;
+    ~Process();
+
+    /// `argv[0]` is searched in PATH, throws std::system_error on failure.
+    /// The child starts with no blocked signal, i.e. the signals taken by a SignalSet of this
+    /// thread are delivered to it normally.
+    static Process spawn(const std::vector<std::string>& argv, Options options);
+    static Process spawn(const std::vector<std::string>& argv) { return spawn(argv, Options{}); }
+
+    pid_t pid() const noexcept { return pid_; }
+
+    Pipe& stdin_pipe() noexcept { return stdin_; }
+    Pipe& stdout_pipe() noexcept { return stdout_; }
+    Pipe& stderr_pipe() noexcept { return stderr_; }
+
+    /// Send `signal` by the pidfd (which can not reach another process reusing the pid)
+    void kill(int signal);
+
+    /// Wait for the termination and reap the process, can only be awaited once
+    Task<ExitStatus> wait();
+
+private:
+    Process() = default;
+    /// reap the process if it has exited, return whether it is reaped
+    bool try_reap(ExitStatus& status);
+    void reap_if_exited() noexcept;
+
+    pid_t pid_ = -1;
+    AsyncFd pidfd_;
+    bool reaped_ = false;
+    Pipe stdin_;
+    Pipe stdout_;
+    Pipe stderr_;
+};
+
+/// SignalSet receives the signals by a signalfd in the IoDriver of current scheduler instead of
+/// the signal handlers, see `signals`.
+///
+/// The signals are blocked in the creating thread (and restored by the destructor). Since a
+/// process-directed signal is delivered to any thread not blocking it, the signals should also be
+/// blocked in the other threads, e.g. by creating the SignalSet before starting them.
+class SignalSet {
+public:
+    explicit SignalSet(std::initializer_list<int> signos);
+    SignalSet(const SignalSet&) = delete;
+    SignalSet& operator=(const SignalSet&) = delete;
+    ~SignalSet();
+
+    /// Wait for the next signal of the set, return the signal number
+    Task<int> next();
+
+private:
+    sigset_t mask_;
+    sigset_t prev_mask_;
+    AsyncFd signal_fd_;
+};
+
+/// e.g. `auto set = signals({SIGTERM, SIGHUP}); int sig = co_await set.next();`
+inline SignalSet signals(std::initializer_list<int> signos) { return SignalSet{signos}; }
+}// namespace hucoro
+
+#endif//HUCORO_PROCESS_H
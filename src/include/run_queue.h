@@ -0,0 +1,99 @@
+//
+// Created by dreamHuang on 2023/3/16.
+//
+
+#ifndef HUCORO_RUN_QUEUE_H
+#define HUCORO_RUN_QUEUE_H
+
+#include "clock.h"
+#include "spawn_task.h"
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <vector>
+
+namespace hucoro {
+/// The scheduling class of a spawned task, selected by `SpawnOptions`
+enum class Priority {
+    // latency sensitive work (e.g. request handling)
+    CRITICAL = 0,
+    NORMAL,
+    // e.g. compaction, it only get a small share but never starves
+    BACKGROUND,
+};
+
+inline constexpr std::size_t PRIORITY_NUM = 3;
+
+/// The queue delay (from being scheduled to being resumed) of one scheduling class.
+/// The delay is recorded into log2 buckets of nanoseconds, so the percentile is an upper bound
+/// with at most 2x error, which is enough to check the isolation between classes.
+struct QueueDelayStats {
+    static constexpr std::size_t BUCKET_NUM = 64;
+
+    std::uint64_t count = 0;
+    std::uint64_t total_ns = 0;
+    std::uint64_t max_ns = 0;
+    // buckets[i] counts the delays in [2^(i-1), 2^i) ns (buckets[0] counts 0)
+    std::array<std::uint64_t, BUCKET_NUM> buckets{};
+
+    void record(std::uint64_t delay_ns) noexcept;
+
+    /// `p` is in [0, 1], e.g. 0.99 for p99. Return 0 if there is no record.
+    std::uint64_t percentile_ns(double p) const noexcept;
+
+    std::uint64_t mean_ns() const noexcept { return count == 0 ? 0 : total_ns / count; }
+};
+
+/// How the scheduler select between the scheduling classes, see `detail::RunQueue`
+struct PriorityOptions {
+    // indexed by Priority
+    std::array<std::uint32_t, PRIORITY_NUM> weights = {8, 4, 1};
+    RuntimeClock::duration starvation_threshold = std::chrono::milliseconds(10);
+};
+
+namespace detail {
+    /// The run queue of scheduler, each scheduling class has its own FIFO queue.
+    ///
+    /// `pop` selects the class by weighted round-robin: in one round, class `i` can be popped
+    /// at most `weights[i]` times, and a new round starts when no class with remaining credit
+    /// has task. To protect the lower classes from starvation, a task which has waited longer
+    /// than `starvation_threshold` is popped first regardless of its class.
+    class RunQueue {
+    public:
+        RunQueue() : RunQueue(PriorityOptions{}) {}
+        explicit RunQueue(PriorityOptions options);
+
+        void push(SpawnTask&& task, Priority priority);
+        /// The tasks are still queued one by one, but share one enqueue time
+        void push_batch(std::vector<SpawnTask>&& tasks, Priority priority);
+
+        std::optional<SpawnTask> pop();
+
+        bool empty() const noexcept;
+        std::size_t size() const noexcept;
+        std::size_t size(Priority priority) const noexcept { return queues_[index(priority)].size(); }
+
+        const QueueDelayStats& delay_stats(Priority priority) const noexcept { return stats_[index(priority)]; }
+
+    private:
+        struct QueuedTask {
+            SpawnTask task_;
+            RuntimeClock::time_point enqueue_at_;
+        };
+
+        static std::size_t index(Priority priority) noexcept { return static_cast<std::size_t>(priority); }
+
+        SpawnTask pop_from(std::size_t idx, RuntimeClock::time_point now);
+
+        PriorityOptions options_;
+        std::array<std::deque<QueuedTask>, PRIORITY_NUM> queues_;
+        std::array<std::uint32_t, PRIORITY_NUM> credits_;
+        std::array<QueueDelayStats, PRIORITY_NUM> stats_;
+    };
+}// namespace detail
+}// namespace hucoro
+
+#endif//HUCORO_RUN_QUEUE_H
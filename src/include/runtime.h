@@ -0,0 +1,226 @@
+//
+// Created by dreamHuang on 2023/4/6.
+//
+
+#ifndef HUCORO_RUNTIME_H
+#define HUCORO_RUNTIME_H
+
+#include "config.h"
+#include "exception.h"
+#include "hucoro_traits.h"
+#include "single_thread_scheduler.h"
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/// Runtime is the configured entry of hucoro, e.g.
+///
+///     auto runtime = Runtime::builder()
+///                            .worker_threads(4)
+///                            .task_budget(32)
+///                            .queue_capacity(1024, OverflowPolicy::RUN_INLINE)
+///                            .spin_before_park(std::chrono::microseconds(50))
+///                            .thread_name("hucoro-worker")
+///                            .build();
+///     auto results = runtime.run([](std::size_t worker) { return serve(worker); });
+///
+/// Each worker thread owns a SingleThreadScheduler (a shard), the tasks are never moved between
+/// the workers, so the workers usually serve independent inputs (e.g. SO_REUSEPORT listeners).
+namespace hucoro {
+class Runtime {
+public:
+    using ThreadHook = std::function<void(std::size_t worker)>;
+
+    class Builder {
+    public:
+        /// The number of threads started by `run` (1 by default)
+        Builder& worker_threads(std::size_t n) {
+            worker_threads_ = n;
+            return *this;
+        }
+
+        /// The max number of tasks resumed by one iteration of scheduler loop, before I/O is polled
+        Builder& task_budget(std::size_t budget) {
+            options_.task_budget = budget;
+            return *this;
+        }
+
+        /// Bound the run queue of each scheduler, 0 means unbounded
+        Builder& queue_capacity(std::size_t capacity, OverflowPolicy overflow = OverflowPolicy::REJECT) {
+            options_.queue_capacity = capacity;
+            options_.overflow = overflow;
+            return *this;
+        }
+
+        Builder& priority(PriorityOptions priority) {
+            options_.priority = priority;
+            return *this;
+        }
+
+        /// Poll I/O without blocking for `duration` before parking the idle thread, which trades CPU
+        /// for the latency of wake-ups
+        Builder& spin_before_park(std::chrono::microseconds duration) {
+            options_.spin_before_park = duration;
+            return *this;
+        }
+
+        /// How long the unfinished tasks (e.g. the ones not joined) are drained after `func` returns,
+        /// before they are cancelled (see `SingleThreadScheduler::shutdown`)
+        Builder& shutdown_timeout(std::chrono::milliseconds timeout) {
+            shutdown_timeout_ = timeout;
+            return *this;
+        }
+
+        /// The worker threads are named `prefix-<i>` (truncated to 15 characters by Linux)
+        Builder& thread_name(std::string prefix) {
+            thread_name_ = std::move(prefix);
+            return *this;
+        }
+
+        /// Pin the i-th worker thread to `cpus[i % cpus.size()]`
+        Builder& thread_affinity(std::vector<int> cpus) {
+            cpus_ = std::move(cpus);
+            return *this;
+        }
+
+        /// Called by each worker thread before its scheduler starts / after it stops
+        Builder& on_thread_start(ThreadHook hook) {
+            on_thread_start_ = std::move(hook);
+            return *this;
+        }
+
+        Builder& on_thread_stop(ThreadHook hook) {
+            on_thread_stop_ = std::move(hook);
+            return *this;
+        }
+
+        /// Called by the scheduler thread before it blocks in epoll_wait / after it is woken up
+        Builder& on_park(std::function<void()> hook) {
+            options_.on_park = std::move(hook);
+            return *this;
+        }
+
+        Builder& on_unpark(std::function<void()> hook) {
+            options_.on_unpark = std::move(hook);
+            return *this;
+        }
+
+        /// Throws HuCoroGeneralErr if the configuration is invalid
+        Runtime build() const;
+
+    private:
+        SchedulerOptions options_;
+        std::size_t worker_threads_ = 1;
+        std::chrono::milliseconds shutdown_timeout_{0};
+        std::string thread_name_;
+        std::vector<int> cpus_;
+        ThreadHook on_thread_start_;
+        ThreadHook on_thread_stop_;
+    };
+
+    static Builder builder() { return Builder{}; }
+
+    std::size_t worker_threads() const noexcept { return worker_threads_; }
+    const SchedulerOptions& scheduler_options() const noexcept { return options_; }
+
+    /// The ShutdownReport of the scheduler used by the last `block_on`, or of the i-th worker of
+    /// the last `run`
+    const std::vector<ShutdownReport>& shutdown_reports() const noexcept { return shutdown_reports_; }
+
+    /// Run `func()` on the calling thread by a scheduler with the configured options, then shut
+    /// down the scheduler. The thread is not renamed or pinned, and the thread hooks are not called.
+    template<typename FUNC>
+    auto block_on(FUNC func, std::enable_if_t<is_awaitable_v<decltype(func())>, int> = 0) {
+        SingleThreadScheduler scheduler{options_};
+        shutdown_reports_.assign(1, ShutdownReport{});
+        if constexpr (std::is_void_v<decltype(scheduler.block_on(std::move(func)))>) {
+            scheduler.block_on(std::move(func));
+            shutdown_reports_[0] = scheduler.shutdown(shutdown_timeout_);
+        } else {
+            auto result = scheduler.block_on(std::move(func));
+            shutdown_reports_[0] = scheduler.shutdown(shutdown_timeout_);
+            return result;
+        }
+    }
+
+    /// Run `func(i)` on the i-th worker thread, and return the results (if not void) by the order of
+    /// workers once all of them are finished. If any worker throws, the first exception (by the order
+    /// of workers) is rethrown after joining all the threads.
+    template<typename FUNC>
+    auto run(FUNC func) {
+        using Awaitable = decltype(func(std::size_t{}));
+        using Result = std::remove_cvref_t<typename awaitable_traits<Awaitable>::await_return_type>;
+        std::vector<std::exception_ptr> errors(worker_threads_);
+        shutdown_reports_.assign(worker_threads_, ShutdownReport{});
+        if constexpr (std::is_void_v<Result>) {
+            start_workers(errors, [&](std::size_t i) {
+                SingleThreadScheduler scheduler{options_};
+                scheduler.block_on([&func, i]() { return func(i); });
+                shutdown_reports_[i] = scheduler.shutdown(shutdown_timeout_);
+            });
+            rethrow_first(errors);
+        } else {
+            std::vector<std::optional<Result>> slots(worker_threads_);
+            start_workers(errors, [&](std::size_t i) {
+                SingleThreadScheduler scheduler{options_};
+                slots[i].emplace(scheduler.block_on([&func, i]() { return func(i); }));
+                shutdown_reports_[i] = scheduler.shutdown(shutdown_timeout_);
+            });
+            rethrow_first(errors);
+            std::vector<Result> results;
+            results.reserve(worker_threads_);
+            for (auto& slot: slots) { results.push_back(std::move(*slot)); }
+            return results;
+        }
+    }
+
+private:
+    Runtime() = default;
+
+    /// Start the workers running `body(i)` and join them, the exceptions are stored in `errors`
+    template<typename Body>
+    void start_workers(std::vector<std::exception_ptr>& errors, Body body) {
+        std::vector<std::thread> threads;
+        threads.reserve(worker_threads_);
+        for (std::size_t i = 0; i < worker_threads_; ++i) {
+            threads.emplace_back([this, &errors, &body, i]() {
+                try {
+                    setup_thread(i);
+                    if (on_thread_start_) { on_thread_start_(i); }
+                    body(i);
+                } catch (...) { errors[i] = std::current_exception(); }
+                try {
+                    if (on_thread_stop_) { on_thread_stop_(i); }
+                } catch (...) {
+                    // the error of the worker itself is reported first
+                    if (!errors[i]) { errors[i] = std::current_exception(); }
+                }
+            });
+        }
+        for (auto& thread: threads) { thread.join(); }
+    }
+
+    /// Name and pin current thread as the `worker`-th worker
+    void setup_thread(std::size_t worker) const;
+
+    static void rethrow_first(const std::vector<std::exception_ptr>& errors);
+
+    SchedulerOptions options_;
+    std::size_t worker_threads_ = 1;
+    std::chrono::milliseconds shutdown_timeout_{0};
+    std::string thread_name_;
+    std::vector<int> cpus_;
+    ThreadHook on_thread_start_;
+    ThreadHook on_thread_stop_;
+    std::vector<ShutdownReport> shutdown_reports_;
+};
+}// namespace hucoro
+
+#endif//HUCORO_RUNTIME_H
@@ -0,0 +1,334 @@
+//
+// Created by dreamHuang on 2023/3/8.
+//
+
+#ifndef HUCORO_SHARED_TASK_H
+#define HUCORO_SHARED_TASK_H
+
+#include "config.h"
+#include "exception.h"
+#include "hucoro_traits.h"
+#include "io_driver.h"
+#include "single_thread_scheduler.h"
+#include "task_local.h"
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace hucoro {
+/// SharedTask<T> represent a lazily async task that can be `co_await`ed by many
+/// coroutines (possibly on different threads), while the underlying coroutine
+/// is only executed once.
+///
+/// 1. It is copyable, all the copies refer to the same coroutine frame (ref counted).
+/// 2. The first `co_await` start the execution, the following awaiters will be
+/// linked into a lock-free intrusive list and resumed once the task finished.
+/// An awaiter on a scheduler is resumed by that scheduler (woken through its IoDriver),
+/// so it never continues on the thread which finishes the task.
+/// 3. Every awaiter get a `const T&` to the result stored in the promise.
+template<typename T>
+class SharedTask;
+
+namespace detail {
+    /// A node of the intrusive waiter list, which lives in the awaiter
+    /// (i.e. in the frame of the awaiting coroutine), so no allocation is needed.
+    struct SharedTaskWaiter {
+        SharedTaskWaiter* next_ = nullptr;
+        // null if the awaiting coroutine is not run by a scheduler, then it is resumed inline
+        SingleThreadScheduler* scheduler_ = nullptr;
+        IoDriver* driver_ = nullptr;
+        RemoteWakeNode node_;
+
+        /// Resume the awaiting coroutine on its own thread. `this` is invalid after this
+        void wake() noexcept {
+            if (!scheduler_) {
+                node_.coroutine_.resume();
+            } else if (SingleThreadScheduler::CURRENT_SCHEDULER == scheduler_) {
+                driver_->wake(node_.coroutine_);
+            } else {
+                driver_->remote_wake(node_);
+            }
+        }
+    };
+
+    class SharedTaskPromiseBase {
+        template<typename T>
+        friend class SharedTaskAwaiterBase;
+
+        template<typename T>
+        friend class hucoro::SharedTask;
+
+    public:
+        // The state of the shared task is encoded in `waiters_`:
+        // 1. `&waiters_`: the task has not been started
+        // 2. `nullptr`: the task has been started and there is no waiter
+        // 3. `this`: the task has finished and the result is ready
+        // 4. otherwise: the head of the waiter list
+        SharedTaskPromiseBase() noexcept : ref_count_(1), waiters_(&waiters_) {}
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        class FinalAwaitable {
+        public:
+            bool await_ready() noexcept { return false; }
+
+            template<typename Promise>
+            void await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+                SharedTaskPromiseBase& promise = handle.promise();
+                void* const ready = static_cast<void*>(&promise);
+                void* waiters = promise.waiters_.exchange(ready, std::memory_order_acq_rel);
+                // NOTE: resuming a waiter inline may destroy this coroutine frame (e.g. the last
+                // SharedTask is dropped), so do not touch promise or `this` in the loop.
+                auto* waiter = static_cast<SharedTaskWaiter*>(waiters);
+                while (waiter != nullptr) {
+                    // the waiter node lives in the awaiting coroutine, read next before wake it
+                    auto* next = waiter->next_;
+                    waiter->wake();
+                    waiter = next;
+                }
+            }
+            void await_resume() noexcept {}
+        };
+
+        FinalAwaitable final_suspend() noexcept { return {}; }
+
+        bool is_ready() const noexcept {
+            return waiters_.load(std::memory_order_acquire) == static_cast<const void*>(this);
+        }
+
+    private:
+        void incr_ref() noexcept { ref_count_.fetch_add(1, std::memory_order_relaxed); }
+
+        /// return true if this is the last reference
+        bool decr_ref() noexcept { return ref_count_.fetch_sub(1, std::memory_order_acq_rel) == 1; }
+
+        /// Try to link `waiter` into the waiter list, start the task if it has not been started.
+        /// Return false if the task has already finished (i.e. no need to suspend)
+        bool try_await(SharedTaskWaiter* waiter, std::coroutine_handle<> coroutine) {
+            void* const ready = static_cast<void*>(this);
+            void* const not_started = static_cast<void*>(&waiters_);
+            void* const started_no_waiter = nullptr;
+
+            void* old_waiters = waiters_.load(std::memory_order_acquire);
+            if (old_waiters == not_started &&
+                waiters_.compare_exchange_strong(old_waiters, started_no_waiter, std::memory_order_relaxed)) {
+                // We are the first awaiter, so start to execute the task.
+                // It may run to completion synchronously.
+                coroutine.resume();
+                old_waiters = waiters_.load(std::memory_order_acquire);
+            }
+
+            do {
+                if (old_waiters == ready) { return false; }
+                waiter->next_ = static_cast<SharedTaskWaiter*>(old_waiters);
+            } while (!waiters_.compare_exchange_weak(old_waiters, static_cast<void*>(waiter),
+                                                     std::memory_order_release, std::memory_order_acquire));
+            return true;
+        }
+
+        std::atomic<std::size_t> ref_count_;
+        std::atomic<void*> waiters_;
+    };
+
+    template<typename T>
+    class SharedTaskPromise final : public SharedTaskPromiseBase {
+        using coroutine_handle_t = std::coroutine_handle<SharedTaskPromise<T>>;
+
+    public:
+        SharedTask<T> get_return_object() noexcept;
+
+        template<typename U>
+        void return_value(U&& result) noexcept(std::is_nothrow_constructible_v<T, U&&>) {
+            result_.template emplace<1>(std::forward<U>(result));
+        }
+        void unhandled_exception() noexcept { result_ = std::current_exception(); }
+
+        const T& result() const {
+            switch (result_.index()) {
+                case 0:
+                    throw HuCoroGeneralErr{"No result for shared task, please co_await it first"};
+                case 1:
+                    return std::get<1>(result_);
+                case 2:
+                    std::rethrow_exception(std::get<2>(result_));
+                default:
+                    __builtin_unreachable();
+            }
+        }
+
+    private:
+        std::variant<std::monostate, T, std::exception_ptr> result_;
+    };
+
+    /// the lvalue ref version of SharedTaskPromise, see TaskPromise<T&>
+    template<typename T>
+    class SharedTaskPromise<T&> final : public SharedTaskPromiseBase {
+    public:
+        SharedTask<T&> get_return_object() noexcept;
+
+        void return_value(T& result) noexcept { result_ = std::addressof(result); }
+        void unhandled_exception() noexcept { result_ = std::current_exception(); }
+
+        T& result() const {
+            switch (result_.index()) {
+                case 0:
+                    throw HuCoroGeneralErr{"No result for shared task, please co_await it first"};
+                case 1:
+                    return *std::get<1>(result_);
+                case 2:
+                    std::rethrow_exception(std::get<2>(result_));
+                default:
+                    __builtin_unreachable();
+            }
+        }
+
+    private:
+        std::variant<std::monostate, T*, std::exception_ptr> result_;
+    };
+
+    template<>
+    class SharedTaskPromise<void> final : public SharedTaskPromiseBase {
+    public:
+        SharedTask<void> get_return_object() noexcept;
+
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { exception_ptr_ = std::current_exception(); }
+
+        void result() const {
+            if (exception_ptr_) { std::rethrow_exception(exception_ptr_); }
+        }
+
+    private:
+        std::exception_ptr exception_ptr_ = nullptr;
+    };
+
+    template<typename T>
+    class SharedTaskAwaiterBase {
+    protected:
+        using coroutine_handle_t = std::coroutine_handle<SharedTaskPromise<T>>;
+
+    public:
+        explicit SharedTaskAwaiterBase(coroutine_handle_t handle) noexcept : task_coroutine_(handle) {}
+
+        bool await_ready() noexcept { return !task_coroutine_ || task_coroutine_.promise().is_ready(); }
+
+        bool await_suspend(std::coroutine_handle<> awaiting_coroutine) {
+            // the awaiting coroutine may be resumed by the task which finish the shared task
+            context_guard_.save(*this);
+            auto* scheduler = SingleThreadScheduler::CURRENT_SCHEDULER;
+            IoDriver* driver = scheduler ? &SingleThreadScheduler::io_driver() : nullptr;
+            waiter_.scheduler_ = scheduler;
+            waiter_.driver_ = driver;
+            waiter_.node_.coroutine_ = awaiting_coroutine;
+            if (!task_coroutine_.promise().try_await(&waiter_, task_coroutine_)) { return false; }
+            // It is linked, and will be woken through the driver, which only resumes it on this
+            // thread after we return. Without a scheduler it may be already resumed, so not touch `this`.
+            if (driver) { driver->suspend(); }
+            return true;
+        }
+
+        decltype(auto) await_resume() {
+            context_guard_.restore();
+            if (!task_coroutine_) { throw HuCoroGeneralErr{"Cannot co_await an empty shared task"}; }
+            return task_coroutine_.promise().result();
+        }
+
+    private:
+        coroutine_handle_t task_coroutine_;
+        SharedTaskWaiter waiter_;
+        TaskLocalGuard context_guard_;
+    };
+}// namespace detail
+
+template<typename T>
+class [[nodiscard]] SharedTask {
+    using coroutine_handle_t = std::coroutine_handle<detail::SharedTaskPromise<T>>;
+
+public:
+    using promise_type = detail::SharedTaskPromise<T>;
+
+    SharedTask() noexcept : task_coroutine_(nullptr) {}
+    explicit SharedTask(coroutine_handle_t task_coroutine) noexcept : task_coroutine_(task_coroutine) {}
+
+    SharedTask(const SharedTask& other) noexcept : task_coroutine_(other.task_coroutine_) {
+        if (task_coroutine_) { task_coroutine_.promise().incr_ref(); }
+    }
+    SharedTask(SharedTask&& other) noexcept : task_coroutine_(std::exchange(other.task_coroutine_, nullptr)) {}
+
+    SharedTask& operator=(const SharedTask& other) noexcept {
+        if (task_coroutine_ != other.task_coroutine_) {
+            if (other.task_coroutine_) { other.task_coroutine_.promise().incr_ref(); }
+            release();
+            task_coroutine_ = other.task_coroutine_;
+        }
+        return *this;
+    }
+
+    SharedTask& operator=(SharedTask&& other) noexcept {
+        if (this != &other) {
+            release();
+            task_coroutine_ = std::exchange(other.task_coroutine_, nullptr);
+        }
+        return *this;
+    }
+
+    ~SharedTask() { release(); }
+
+    /// Return true if the result (or exception) is ready, so that `co_await` will not suspend.
+    bool is_ready() const noexcept { return !task_coroutine_ || task_coroutine_.promise().is_ready(); }
+
+    bool valid() const noexcept { return task_coroutine_ != nullptr; }
+
+    /// Two shared tasks are equal if they refer to the same coroutine
+    friend bool operator==(const SharedTask& lhs, const SharedTask& rhs) noexcept {
+        return lhs.task_coroutine_ == rhs.task_coroutine_;
+    }
+
+    /// The awaiter returns `const T&` (or `T&` for SharedTask<T&>), which is valid as long as
+    /// there is at least one SharedTask refer to the coroutine.
+    auto operator co_await() const noexcept { return detail::SharedTaskAwaiterBase<T>{task_coroutine_}; }
+
+private:
+    void release() noexcept {
+        if (task_coroutine_ && task_coroutine_.promise().decr_ref()) { task_coroutine_.destroy(); }
+        task_coroutine_ = nullptr;
+    }
+
+    coroutine_handle_t task_coroutine_;
+};
+
+namespace detail {
+    template<typename T>
+    SharedTask<T> SharedTaskPromise<T>::get_return_object() noexcept {
+        return SharedTask<T>{std::coroutine_handle<SharedTaskPromise<T>>::from_promise(*this)};
+    }
+
+    template<typename T>
+    SharedTask<T&> SharedTaskPromise<T&>::get_return_object() noexcept {
+        return SharedTask<T&>{std::coroutine_handle<SharedTaskPromise<T&>>::from_promise(*this)};
+    }
+
+    inline SharedTask<void> SharedTaskPromise<void>::get_return_object() noexcept {
+        return SharedTask<void>{std::coroutine_handle<SharedTaskPromise<void>>::from_promise(*this)};
+    }
+}// namespace detail
+
+/// Wrap an awaitable (e.g. Task<T>) into a SharedTask, the result will be decayed
+/// (e.g. Task<T> whose await return type is `T&&` will produce SharedTask<T>)
+template<typename Awaitable, typename Result = std::remove_cvref_t<typename awaitable_traits<Awaitable>::await_return_type>>
+SharedTask<Result> make_shared_task(Awaitable awaitable,
+                                    std::enable_if_t<!std::is_same_v<Result, void>, int> = 0) {
+    co_return co_await std::move(awaitable);
+}
+
+template<typename Awaitable, typename Result = std::remove_cvref_t<typename awaitable_traits<Awaitable>::await_return_type>>
+SharedTask<void> make_shared_task(Awaitable awaitable, std::enable_if_t<std::is_same_v<Result, void>, int> = 0) {
+    co_await std::move(awaitable);
+}
+
+}// namespace hucoro
+
+#endif// HUCORO_SHARED_TASK_H
@@ -5,44 +5,325 @@
 #ifndef HUCORO_SINGLE_THREAD_SCHEDULER_H
 #define HUCORO_SINGLE_THREAD_SCHEDULER_H
 
+#include "buffer_pool.h"
+#include "clock.h"
 #include "config.h"
 #include "exception.h"
 #include "hucoro_traits.h"
+#include "io_driver.h"
+#include "perf_counters.h"
+#include "run_queue.h"
 #include "spawn_task.h"
+#include "task_registry.h"
 #include "task.h"
-#include <deque>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <functional>
+#include <iterator>
+#include <memory>
 #include <mutex>
+#include <source_location>
+#include <thread>
 #include <type_traits>
 #include <variant>
+#include <vector>
 
 namespace hucoro {
-namespace detail {}// namespace detail
+namespace execution {
+    class Scheduler;
+}// namespace execution
+
+namespace detail {
+    class BlockOnPromiseBase;
+
+    /// An operation waiting to be executed by the scheduler (e.g. started by the sender of
+    /// `execution::Scheduler::schedule()`), which is embedded in the operation state, so
+    /// scheduling it does not allocate.
+    struct ScheduleNode {
+        ScheduleNode* next_ = nullptr;
+        void (*execute_)(ScheduleNode* node) noexcept = nullptr;
+    };
+}// namespace detail
+
+/// The options of `spawn`
+struct SpawnOptions {
+    Priority priority = Priority::NORMAL;
+    // copy the TaskLocal variables of the spawning task into the spawned task
+    bool inherit_task_locals = false;
+};
+
+/// What `spawn` does when the run queue has reached `SchedulerOptions::queue_capacity`
+enum class OverflowPolicy {
+    // throw HuCoroGeneralErr from `spawn`
+    REJECT,
+    // resume the spawned task inside `spawn` until its first suspension, which slows the spawner down
+    RUN_INLINE,
+};
+
+/// The tunables of SingleThreadScheduler, usually set through `Runtime::Builder` (see runtime.h)
+struct SchedulerOptions {
+    PriorityOptions priority;
+    // the max number of tasks resumed in one iteration of `block_on` loop, before I/O is polled
+    std::size_t task_budget = 10;
+    // the max number of queued tasks, 0 means unbounded
+    std::size_t queue_capacity = 0;
+    OverflowPolicy overflow = OverflowPolicy::REJECT;
+    // when idle, keep polling I/O without blocking for this long before parking in epoll_wait
+    std::chrono::microseconds spin_before_park{0};
+    // called before parking and after being woken up (when the woken coroutines have run)
+    std::function<void()> on_park;
+    std::function<void()> on_unpark;
+    // how long the destructor waits for the abandoned tasks to be destroyed by their completions,
+    // after which they are leaked and reported to `on_leak` (see `~SingleThreadScheduler`)
+    std::chrono::milliseconds abandoned_wait{1000};
+    std::function<void(std::size_t leaked)> on_leak;
+};
+
+/// The result of `SingleThreadScheduler::shutdown`
+struct ShutdownReport {
+    // the unfinished tasks which finished before the deadline
+    std::size_t drained = 0;
+    // the unfinished tasks which were cancelled at the deadline
+    std::size_t cancelled = 0;
+    // the cancelled tasks left alive, since an outside completion (e.g. the callback of
+    // `async_from_callback`) will still write to their frames, which destroys them later
+    std::size_t abandoned = 0;
+};
 
 // single thread scheduler
 class SingleThreadScheduler {
 
 public:
-    void schedule(SpawnTask&& task);
+    SingleThreadScheduler() = default;
+    explicit SingleThreadScheduler(PriorityOptions priority_options) : tasks_(priority_options) {
+        options_.priority = priority_options;
+    }
+    explicit SingleThreadScheduler(SchedulerOptions options) : options_(std::move(options)), tasks_(options_.priority) {
+        if (options_.task_budget == 0) { throw HuCoroGeneralErr("The task budget of scheduler must be positive"); }
+    }
+    SingleThreadScheduler(const SingleThreadScheduler&) = delete;
+    SingleThreadScheduler& operator=(const SingleThreadScheduler&) = delete;
+    /// The unfinished tasks are cancelled without draining (see `shutdown`), and it waits until
+    /// the abandoned ones are destroyed by their completions, for at most `abandoned_wait`.
+    /// Past it, the abandoned frames are leaked (their completions may still destroy them
+    /// later), and so are the drivers they may unregister from.
+    ~SingleThreadScheduler();
+
+    const SchedulerOptions& options() const noexcept { return options_; }
+
+    /// The number of spawned tasks handled by the overflow policy, since the queue is full
+    std::size_t overflowed() const noexcept { return overflowed_; }
+
+    /// The number of spawned tasks which have neither finished nor been cancelled, i.e. queued or
+    /// suspended (e.g. the ones not joined when `block_on` returns)
+    std::size_t unfinished_tasks() const noexcept { return spawned_.unfinished(); }
+
+    /// Shut down gracefully, which is called after `block_on` returns (e.g. before a restart):
+    /// 1. new spawns are rejected (`spawn` throws HuCoroGeneralErr);
+    /// 2. the unfinished tasks keep running (including their I/O) until all of them finish, the
+    ///    `timeout` expires or none of them can make progress;
+    /// 3. the remaining ones are cancelled: their frames are destroyed (or by the last JoinHandle
+    ///    if it is held outside the tasks), and awaiting their JoinHandle throws HuCoroGeneralErr.
+    ///
+    /// The frames are destroyed while suspended, and the awaiters clean up what still refers to
+    /// them: the file AIO in flight is cancelled (or waited for), and a task waiting for the
+    /// callback of `async_from_callback` is abandoned, i.e. left alive until the callback
+    /// completes, which destroys it instead of resuming it (see `ShutdownReport::abandoned`).
+    /// The JoinHandles of cancelled tasks must be dropped before the scheduler. The scheduler can
+    /// be used again after shutdown.
+    ShutdownReport shutdown(std::chrono::milliseconds timeout);
+
+    void schedule(SpawnTask&& task, Priority priority = Priority::NORMAL);
+
+    void schedule_batch(std::vector<SpawnTask>&& tasks, Priority priority = Priority::NORMAL);
+
+    /// Execute `node` in the next iteration of `block_on`, it must be alive until executed.
+    /// It is thread safe: from another thread, the node is pushed into a lock-free MPSC stack and
+    /// the parked scheduler is notified (it is executed once the scheduler runs `block_on`).
+    void schedule(detail::ScheduleNode& node) noexcept;
+
+    /// The P2300 scheduler of this scheduler (see execution.h)
+    inline execution::Scheduler get_scheduler() noexcept;
+
+    /// The queue delay of tasks in scheduling class `priority` (i.e. how long they wait in the
+    /// run queue before being resumed)
+    const QueueDelayStats& queue_delay_stats(Priority priority) const noexcept {
+        return tasks_.delay_stats(priority);
+    }
+
+    /// Measure the events (cycles, cache misses ...) of every `period`-th resumed task, 0 disables it.
+    /// It can also be called inside `block_on`. The counters are opened by the first sampled resume
+    /// of each `block_on`, so the events are attributed to the scheduler thread, see `task_perf_stats`.
+    void enable_perf_sampling(std::size_t period = 64) noexcept { perf_period_ = period; }
+
+    const TaskPerfStats& task_perf_stats() const noexcept { return perf_stats_; }
+
+    /// The counters used by the last `block_on` which sampled (or null), which tells the
+    /// availability of each event
+    const PerfCounters* perf_counters() const noexcept { return perf_counters_.get(); }
 
     template<typename FUNC>
     auto block_on(FUNC func, std::enable_if_t<is_awaitable_v<decltype(func())>, int> = 0);
 
-    /// The returned type of spawn is hucoro::SpawnTask
+    /// The returned type of spawn is hucoro::SpawnTask.
+    /// `location` is recorded by TaskRegistry (if enabled) as the spawn site.
     template<typename FUNC>
-    static auto spawn(FUNC&& func) {
+    static auto spawn(FUNC&& func, SpawnOptions options = {},
+                      std::source_location location = std::source_location::current()) {
         if (!CURRENT_SCHEDULER) {
             throw HuCoroGeneralErr("Try spawn out side the scope of scheduler, which "
                                    "is not supported for now");
         }
         auto [join_handle, spawn_task] = CURRENT_SCHEDULER->spawn_impl(std::forward<FUNC>(func));
+        if (options.inherit_task_locals) { inherit_task_locals(spawn_task); }
+        if (TaskRegistry::enabled()) { spawn_task.register_task(location); }
         // should not use spawn_task after this
-        CURRENT_SCHEDULER->schedule(std::move(spawn_task));
+        CURRENT_SCHEDULER->schedule(std::move(spawn_task), options.priority);
         return std::move(join_handle);
     }
 
+    /// Spawn `n` tasks, the i-th one runs `func(i)` (each task owns a copy of `func`).
+    ///
+    /// Compared with calling `spawn` in a loop, the coroutine frames are allocated from
+    /// one contiguous slab and the tasks are queued by one `schedule_batch` (one clock read
+    /// and one capacity check for the whole batch).
+    /// The returned type is hucoro::JoinSet
+    template<typename FUNC>
+    static auto spawn_n(std::size_t n, FUNC func, SpawnOptions options = {},
+                        std::source_location location = std::source_location::current()) {
+        using awaitable_t = decltype(func(std::size_t{}));
+        using result_t = std::remove_reference_t<typename awaitable_traits<awaitable_t>::await_return_type>;
+        if (!CURRENT_SCHEDULER) {
+            throw HuCoroGeneralErr("Try spawn out side the scope of scheduler, which "
+                                   "is not supported for now");
+        }
+
+        JoinSet<result_t> join_set;
+        join_set.reserve(n);
+        std::vector<SpawnTask> spawn_tasks;
+        spawn_tasks.reserve(n);
+        {
+            detail::FrameSlabScope slab_scope(n);
+            for (std::size_t i = 0; i < n; ++i) {
+                spawn_into([func, i]() mutable { return func(i); }, options, location, join_set, spawn_tasks);
+            }
+        }
+        CURRENT_SCHEDULER->schedule_batch(std::move(spawn_tasks), options.priority);
+        return join_set;
+    }
+
+    /// Spawn every func in `funcs` (a range of callable returning awaitable with the same type),
+    /// see `spawn_n`. Each task owns a copy of its func (moved from `funcs` if it is an rvalue),
+    /// so the range does not need to outlive the tasks. The returned type is hucoro::JoinSet
+    template<typename RANGE>
+    static auto spawn_many(RANGE&& funcs, SpawnOptions options = {},
+                           std::source_location location = std::source_location::current()) {
+        using func_t = std::decay_t<decltype(*std::begin(funcs))>;
+        using awaitable_t = decltype(std::declval<func_t&>()());
+        using result_t = std::remove_reference_t<typename awaitable_traits<awaitable_t>::await_return_type>;
+        if (!CURRENT_SCHEDULER) {
+            throw HuCoroGeneralErr("Try spawn out side the scope of scheduler, which "
+                                   "is not supported for now");
+        }
+
+        auto n = static_cast<std::size_t>(std::distance(std::begin(funcs), std::end(funcs)));
+        JoinSet<result_t> join_set;
+        join_set.reserve(n);
+        std::vector<SpawnTask> spawn_tasks;
+        spawn_tasks.reserve(n);
+        {
+            detail::FrameSlabScope slab_scope(n);
+            for (auto&& func: funcs) {
+                if constexpr (std::is_lvalue_reference_v<RANGE>) {
+                    spawn_into(func_t(func), options, location, join_set, spawn_tasks);
+                } else {
+                    spawn_into(func_t(std::move(func)), options, location, join_set, spawn_tasks);
+                }
+            }
+        }
+        CURRENT_SCHEDULER->schedule_batch(std::move(spawn_tasks), options.priority);
+        return join_set;
+    }
+
+    /// The BufferPool of current scheduler, which is created lazily by the first call.
+    /// The buffers must be released before the scheduler is destroyed.
+    static BufferPool& buffer_pool() {
+        if (!CURRENT_SCHEDULER) {
+            throw HuCoroGeneralErr("Try get buffer pool out side the scope of scheduler");
+        }
+        auto& pool = CURRENT_SCHEDULER->buffer_pool_;
+        if (!pool) { pool = std::make_unique<BufferPool>(); }
+        return *pool;
+    }
+
+    /// The IoDriver (reactor) of current scheduler, which is created by `block_on` (or the first
+    /// call out of it). It is polled by `block_on` for I/O, and the idle loop parks in it.
+    static IoDriver& io_driver() {
+        if (!CURRENT_SCHEDULER) { throw HuCoroGeneralErr("Try get io driver out side the scope of scheduler"); }
+        auto& driver = CURRENT_SCHEDULER->io_driver_;
+        if (!driver) { driver = std::make_unique<IoDriver>(); }
+        return *driver;
+    }
+
+    /// The number of spawned tasks that can run in parallel in current scheduler,
+    /// which is always 1 for SingleThreadScheduler (or out of the scope of scheduler).
+    static std::size_t concurrency() noexcept { return 1; }
+
     thread_local static SingleThreadScheduler* CURRENT_SCHEDULER;
 
 private:
+    friend class detail::BlockOnPromiseBase;
+
+    /// Called by the root task of `block_on` finishing on another thread (e.g. resumed by the
+    /// completion of a SharedTask there), which wakes the parked loop
+    void on_root_finishing_remotely() noexcept;
+
+    /// resume `task` and add its events to `perf_stats_`, the counters are opened if needed
+    void resume_sampled(SpawnTask& task);
+
+    /// Execute the nodes scheduled before this call (including the remote ones), the ones
+    /// scheduled by them run in the next round
+    void run_scheduled() noexcept;
+
+    /// Whether there are nodes scheduled by other threads
+    bool has_remote_scheduled() const noexcept {
+        return remote_scheduled_.load(std::memory_order_acquire) != nullptr;
+    }
+
+    /// Whether another thread asks the idle loop not to park, see `park`
+    bool woken_remotely() const noexcept {
+        return root_finishing_.load(std::memory_order_acquire) || has_remote_scheduled();
+    }
+
+    /// Wait for I/O (or a remote wake) when there is nothing to run, see
+    /// `SchedulerOptions::spin_before_park`
+    void park();
+
+    /// Run the unfinished tasks until `deadline`, see `shutdown`
+    void drain(RuntimeClock::time_point deadline);
+
+    /// Cancel the unfinished tasks, and return the number of them (`abandoned` is set to the
+    /// number of the ones left alive)
+    std::size_t cancel_unfinished(std::size_t& abandoned);
+
+    /// Create the task of a batch (see `spawn_n`), which is scheduled by the caller
+    template<typename FUNC, typename Result>
+    static void spawn_into(FUNC func, const SpawnOptions& options, std::source_location location,
+                           JoinSet<Result>& join_set, std::vector<SpawnTask>& spawn_tasks) {
+        auto [join_handle, spawn_task] = CURRENT_SCHEDULER->spawn_impl(std::move(func));
+        if (options.inherit_task_locals) { inherit_task_locals(spawn_task); }
+        if (TaskRegistry::enabled()) { spawn_task.register_task(location); }
+        join_set.push_back(std::move(join_handle));
+        spawn_tasks.push_back(std::move(spawn_task));
+    }
+
+    static void inherit_task_locals(SpawnTask& spawn_task) {
+        if (auto* context = detail::TaskLocalContext::current()) {
+            spawn_task.task_local_context().inherit_from(*context);
+        }
+    }
+
     template<typename FUNC>
     std::pair<JoinHandle<void>, SpawnTask>
     spawn_impl(FUNC func,
@@ -64,7 +345,33 @@ private:
     }
 
     /* data member */
-    std::deque<SpawnTask> tasks_;
+    SchedulerOptions options_;
+    std::size_t overflowed_ = 0;
+    bool shutting_down_ = false;
+    // must be declared before the members may own the frames of spawned tasks
+    detail::SpawnTaskList spawned_;
+    detail::RunQueue tasks_;
+    // the intrusive FIFO queue of ScheduleNode
+    detail::ScheduleNode* scheduled_head_ = nullptr;
+    detail::ScheduleNode* scheduled_tail_ = nullptr;
+    // the LIFO stack of ScheduleNode pushed by other threads
+    std::atomic<detail::ScheduleNode*> remote_scheduled_ = nullptr;
+    std::unique_ptr<BufferPool> buffer_pool_;
+    std::unique_ptr<IoDriver> io_driver_;
+    // the driver of the running `block_on`, which is notified by the remote `schedule`
+    std::atomic<IoDriver*> notified_driver_ = nullptr;
+    // the number of remote `schedule` still using `notified_driver_`
+    std::atomic<std::size_t> remote_schedulers_ = 0;
+    // the root task of `block_on` is finishing on another thread, so do not park
+    std::atomic<bool> root_finishing_ = false;
+    // the drivers replaced by the cancellation of `shutdown`
+    std::vector<std::unique_ptr<IoDriver>> retired_drivers_;
+    std::size_t perf_period_ = 0;
+    std::size_t perf_tick_ = 0;
+    std::unique_ptr<PerfCounters> perf_counters_;
+    // whether `perf_counters_` is opened by the thread of current `block_on`
+    bool perf_opened_ = false;
+    TaskPerfStats perf_stats_;
 };
 
 // A special task and promise for block_on
@@ -98,7 +405,11 @@ namespace detail {
 
         void resume() { coroutine_handle_.resume(); }
 
-        inline bool done() { return coroutine_handle_.done(); }
+        /// It does not read the frame, which may be running on another thread
+        inline bool done() { return coroutine_handle_.promise().finished_.load(std::memory_order_acquire); }
+
+        /// the scheduler running this task, which is woken if the task finishes on another thread
+        void bind(SingleThreadScheduler* scheduler) noexcept { coroutine_handle_.promise().scheduler_ = scheduler; }
 
         decltype(auto) result() & { return coroutine_handle_.promise().result(); }
         decltype(auto) result() && { return std::move(coroutine_handle_.promise()).result(); }
@@ -109,8 +420,30 @@ namespace detail {
 
     class BlockOnPromiseBase {
     public:
+        struct FinalAwaiter {
+            bool await_ready() noexcept {
+                // notify before suspending, the frame may be destroyed by the scheduler thread after that
+                if (scheduler_ && SingleThreadScheduler::CURRENT_SCHEDULER != scheduler_) {
+                    scheduler_->on_root_finishing_remotely();
+                }
+                return false;
+            }
+            void await_suspend(std::coroutine_handle<>) noexcept {
+                // the last access to the frame before the scheduler thread may destroy it
+                finished_->store(true, std::memory_order_release);
+            }
+            void await_resume() noexcept {}
+
+            SingleThreadScheduler* scheduler_;
+            std::atomic<bool>* finished_;
+        };
+
         std::suspend_always initial_suspend() noexcept { return {}; }
-        std::suspend_always final_suspend() noexcept { return {}; }
+        FinalAwaiter final_suspend() noexcept { return {scheduler_, &finished_}; }
+
+        SingleThreadScheduler* scheduler_ = nullptr;
+        // set once suspended at the final point, which is checked instead of `done()` of the handle
+        std::atomic<bool> finished_ = false;
     };
 
     template<typename RESULT>
@@ -164,6 +497,10 @@ namespace detail {
         void return_void() noexcept {}
         void unhandled_exception() { exception_ptr_ = std::current_exception(); }
 
+        void result() {
+            if (exception_ptr_) { std::rethrow_exception(exception_ptr_); }
+        }
+
     private:
         std::exception_ptr exception_ptr_ = nullptr;
     };
@@ -194,27 +531,68 @@ namespace detail {
 
 template<typename FUNC>
 auto SingleThreadScheduler::block_on(FUNC func, std::enable_if_t<is_awaitable_v<decltype(func())>, int>) {
-    // set the thread local variable
-    CURRENT_SCHEDULER = this;
+    // set the thread local variable, the previous one is restored at the end (i.e. a nested block_on)
+    auto* prev_scheduler = std::exchange(CURRENT_SCHEDULER, this);
+    RuntimeClock::refresh();
+    // the task local variables of the root task
+    detail::TaskLocalContext root_context;
+    auto* prev_context = detail::TaskLocalContext::exchange(&root_context);
+    // the counters of the last block_on may belong to another thread
+    perf_opened_ = false;
+    // the idle loop always parks in the driver
+    io_driver();
+    root_finishing_.store(false, std::memory_order_relaxed);
+    // the nodes scheduled remotely after this store notify the driver, the ones before it are
+    // seen by the first check of the loop
+    notified_driver_.store(io_driver_.get());
 
     auto block_on_task = detail::run_impl(func());
+    block_on_task.bind(this);
     block_on_task.resume();
     while (1) {
         // first check block_on_tasks
         if (block_on_task.done()) { goto FINISH_BLOCK_ON; }
+        RuntimeClock::refresh();
 
         // pop task from task queue to execute
-        for (int i = 0; i < 10; ++i) {
-            if (tasks_.empty()) { continue; }
-            SpawnTask task = std::move(tasks_.front());
-            tasks_.pop_front();
-            task.resume();
+        for (std::size_t i = 0; i < options_.task_budget; ++i) {
+            auto task = tasks_.pop();
+            if (!task) { break; }
+            if (perf_period_ > 0 && ++perf_tick_ % perf_period_ == 0) {
+                resume_sampled(*task);
+            } else {
+                task->resume();
+            }
+        }
+
+        run_scheduled();
+        // the root task may have been resumed by the tasks above, do not park for it
+        if (block_on_task.done()) { goto FINISH_BLOCK_ON; }
+
+        bool idle = tasks_.empty() && !scheduled_head_ && !has_remote_scheduled();
+        if (!idle) {
+            if (io_driver_->waiting() > 0) { io_driver_->poll(0); }
+        } else if (root_finishing_.load(std::memory_order_acquire)) {
+            // the root task is about to suspend at its final point on another thread
+            std::this_thread::yield();
+        } else {
+            // block for I/O (or remote wakes) only when there is nothing else to do
+            park();
         }
     }
 
 FINISH_BLOCK_ON:
     assert(block_on_task.done());
-    CURRENT_SCHEDULER = nullptr;
+    notified_driver_.store(nullptr);
+    // the driver may be destroyed once `block_on` returns
+    while (remote_schedulers_.load(std::memory_order_acquire) > 0) {}
+    CURRENT_SCHEDULER = prev_scheduler;
+    if (prev_scheduler) {
+        RuntimeClock::refresh();
+    } else {
+        RuntimeClock::reset();
+    }
+    detail::TaskLocalContext::exchange(prev_context);
     // a move happened since the return type is `auto` (not `decltype(auto)`),
     // which will be decayed to non-reference type
     return std::move(block_on_task).result();
@@ -6,12 +6,19 @@
 #define HUCORO_SPAWN_TASK_H
 #include "config.h"
 #include "exception.h"
+#include "frame_slab.h"
 #include "hucoro_traits.h"
+#include "task.h"
+#include "task_local.h"
+#include "task_registry.h"
 #include <atomic>
+#include <cassert>
 #include <exception>
+#include <mutex>
 #include <type_traits>
 #include <utility>
 #include <variant>
+#include <vector>
 
 namespace hucoro {
 template<typename Result>
@@ -24,6 +31,54 @@ template<typename Result>
 class SpawnTaskPromise;
 
 class SpawnTask;
+class SpawnTaskPromiseState;
+
+namespace detail {
+    /// The spawned tasks of one scheduler which have not been destroyed (an intrusive list), so that
+    /// they can be drained and cancelled by `SingleThreadScheduler::shutdown`.
+    ///
+    /// The tasks are linked on the scheduler thread, but they may finish or be destroyed on other
+    /// threads (e.g. the JoinHandle is dropped by another worker of Runtime, or a task is resumed
+    /// inline by the completer of a SharedTask). So the list is guarded by a mutex, which is one of
+    /// a static striped array rather than a member, since a task may unlink itself concurrently with
+    /// the destruction of the list. The last reference to a linked task is also dropped under it,
+    /// so that `cancel_unfinished` knows which tasks nobody else will destroy.
+    class SpawnTaskList {
+    public:
+        SpawnTaskList() = default;
+        SpawnTaskList(const SpawnTaskList&) = delete;
+        SpawnTaskList& operator=(const SpawnTaskList&) = delete;
+        /// the tasks alive after this are detached
+        ~SpawnTaskList();
+
+        void link(SpawnTaskPromiseState& state) noexcept;
+
+        /// The number of tasks which are neither finished nor cancelled
+        std::size_t unfinished() const noexcept { return unfinished_.load(std::memory_order_acquire); }
+
+        /// The number of cancelled tasks which are left alive for their outside completions
+        std::size_t abandoned() const noexcept { return abandoned_.load(std::memory_order_acquire); }
+
+        /// Cancel all the unfinished tasks, see `SingleThreadScheduler::shutdown`.
+        /// Return the number of cancelled tasks, and add the ones left alive (since they are
+        /// waiting for outside completions, see PendingCompletion) to `abandoned`.
+        std::size_t cancel_unfinished(std::size_t& abandoned);
+
+    private:
+        friend class hucoro::SpawnTaskPromiseState;
+
+        /// the mutex guarding this list
+        std::mutex& mutex() const noexcept;
+        /// unlink `state` with the mutex held
+        void unlink(SpawnTaskPromiseState& state) noexcept;
+
+        SpawnTaskPromiseState* head_ = nullptr;
+        // only modified with the mutex held
+        std::atomic<std::size_t> unfinished_ = 0;
+        std::atomic<std::size_t> abandoned_ = 0;
+    };
+}// namespace detail
+
 namespace {
     /// Ths state of spawn task promise
     enum class State {
@@ -35,12 +90,18 @@ namespace {
         WAITING_TO_RESUME,
         // The spawn task is already finish
         FINISH,
+        // cancelled by the shutdown of scheduler before finish, and it will never be resumed
+        CANCELLED,
     };
 }// namespace
 
 class SpawnTaskPromiseState {
 public:
     SpawnTaskPromiseState() : state_(State::INIT) {}
+    ~SpawnTaskPromiseState() {
+        if (registry_node_.registered()) { TaskRegistry::remove(registry_node_); }
+        unlink();
+    }
     auto final_suspend() noexcept {}
 
     void incr_ref() { val_.fetch_add(1, std::memory_order_release); }
@@ -51,12 +112,42 @@ public:
 
     State state() const { return state_.load(std::memory_order_acquire); }
 
+    /// Whether the frame should be destroyed by the one dropping the last reference, i.e. it is
+    /// not started, suspended at final suspend point or cancelled
+    bool destroy_on_release() const {
+        auto current = state();
+        return current == State::INIT || current == State::FINISH || current == State::CANCELLED;
+    }
+
+    /// Drop a reference, return whether the caller should destroy the frame
+    /// (i.e. it is the last reference and `destroy_on_release`)
+    bool release() noexcept;
+
+    /// Called by the final awaiter of `frame`, set the state to FINISH and return the coroutine to
+    /// transfer to: the awaiting one, `frame` itself to destroy it if nobody refers to it, or noop.
+    std::coroutine_handle<> finish(std::coroutine_handle<> frame) noexcept;
+
     void set_awaiting_coroutine(std::coroutine_handle<> handle) { awaiting_coroutine_ = handle; }
 
     std::atomic<State> state_;
     std::coroutine_handle<> awaiting_coroutine_ = nullptr;
     // reference count
     std::atomic<size_t> val_;
+    // the task local variables, which is switched in when resumed by SpawnTask
+    detail::TaskLocalContext context_;
+    // the entry in TaskRegistry (if enabled when spawned)
+    detail::TaskRegistryNode registry_node_;
+    // the frame, and the entry in the SpawnTaskList of scheduler (guarded by its mutex)
+    std::coroutine_handle<> frame_ = nullptr;
+    std::atomic<detail::SpawnTaskList*> list_ = nullptr;
+    SpawnTaskPromiseState* prev_ = nullptr;
+    SpawnTaskPromiseState* next_ = nullptr;
+    // cancelled but left to its outside completions, see `SpawnTaskList::cancel_unfinished`
+    bool abandoned_ = false;
+
+private:
+    /// remove itself from the list (if not detached)
+    void unlink() noexcept;
 };
 
 
@@ -72,20 +163,7 @@ namespace detail {
         }
 
         std::coroutine_handle<> await_suspend(coroutine_handle_t handle) noexcept {
-            auto& promise = handle.promise();
-            SpawnTaskPromiseState& state = promise.state();
-            State prev_state = state.state_.exchange(State::FINISH, std::memory_order_acq_rel);
-            if (prev_state == State::WAITING_TO_RESUME) { return state.awaiting_coroutine_; }
-            if (state.val_.load(std::memory_order_acquire) == 0) {
-                // no reference to this task
-                // so it can be destroy (we do this by continue current coroutine)
-                return handle;
-            }
-            // we come here because there is at least one handle to this coroutine
-            // (e.g. JoinHandle) and no awaiting coroutine exist.
-            //
-            // so return to caller/resumer and keep the result in SpawnTaskPromise
-            return std::noop_coroutine();
+            return handle.promise().state().finish(handle);
         }
 
         void await_resume() noexcept {}
@@ -100,6 +178,10 @@ class SpawnTaskPromise {
     static_assert(std::atomic<State>::is_always_lock_free);
 
 public:
+    // the frame may come from a FrameSlab (see `spawn_n`)
+    static void* operator new(std::size_t size) { return detail::allocate_frame(size); }
+    static void operator delete(void* ptr) noexcept { detail::deallocate_frame(ptr); }
+
     std::pair<JoinHandle<Result>, SpawnTask> get_return_object();
     std::suspend_always initial_suspend() noexcept { return {}; }
     void unhandled_exception() { result_ = std::current_exception(); }
@@ -145,7 +227,7 @@ public:
 
 private:
     SpawnTaskPromiseState state_;
-    std::variant<std::monostate, Result, std::exception_ptr> result_ = nullptr;
+    std::variant<std::monostate, Result, std::exception_ptr> result_;
 };
 
 template<>
@@ -153,6 +235,9 @@ class SpawnTaskPromise<void> {
     static_assert(std::atomic<State>::is_always_lock_free);
 
 public:
+    static void* operator new(std::size_t size) { return detail::allocate_frame(size); }
+    static void operator delete(void* ptr) noexcept { detail::deallocate_frame(ptr); }
+
     std::suspend_always initial_suspend() noexcept { return {}; }
     std::pair<JoinHandle<void>, SpawnTask> get_return_object();
     void unhandled_exception() { result_ = std::current_exception(); }
@@ -179,21 +264,33 @@ class SpawnTask {
 public:
     SpawnTask(SpawnTaskPromiseState& state, std::coroutine_handle<> handle) noexcept : state_(state), handle_(handle) {
         state.incr_ref();
+        state.frame_ = handle;
     }
     SpawnTask(const SpawnTask&) = delete;
     SpawnTask& operator=(const SpawnTask&) = delete;
     SpawnTask(SpawnTask&& other) : state_(other.state_), handle_(std::exchange(other.handle_, nullptr)) {}
     ~SpawnTask() {
-        if (handle_ && state_.decr_ref() == 0 && state_.state() == State::INIT) { handle_.destroy(); }
+        if (handle_ && state_.release()) { handle_.destroy(); }
     }
     void resume() {
         State state = State::INIT;
         if (!state_.state_.compare_exchange_strong(state, State::IN_PROGRESS, std::memory_order_acq_rel)) {
             assert(state == State::WAITING_TO_RESUME);
         }
+        auto* prev_context = detail::TaskLocalContext::exchange(&state_.context_);
+        if (state_.registry_node_.registered()) { state_.registry_node_.on_resume(); }
         handle_.resume();
+        detail::TaskLocalContext::exchange(prev_context);
     }
 
+    detail::TaskLocalContext& task_local_context() noexcept { return state_.context_; }
+
+    /// Register the task to TaskRegistry, `location` is where it is spawned
+    void register_task(std::source_location location) { TaskRegistry::add(state_, location); }
+
+    /// Track the task by the list of scheduler until it is destroyed
+    void link_to(detail::SpawnTaskList& list) noexcept { list.link(state_); }
+
 private:
     SpawnTaskPromiseState& state_;
     std::coroutine_handle<> handle_;
@@ -211,20 +308,29 @@ public:
 
     ~JoinHandleBase() {
         if (!coroutine_) { return; }
-        SpawnTaskPromiseState& state = coroutine_.promise().state();
-        if (state.decr_ref() == 0 && state.state() == State::INIT) { coroutine_.destroy(); }
+        if (coroutine_.promise().state().release()) { coroutine_.destroy(); }
     }
     bool await_ready() noexcept { return false; }
     bool await_suspend(std::coroutine_handle<> awaiting_coroutine) {
         auto& state = coroutine_.promise().state();
 
+        // the awaiting coroutine will be resumed inside the spawned task
+        context_guard_.save(*this);
         state.set_awaiting_coroutine(awaiting_coroutine);
-        State prev_state = state.state_.exchange(State::WAITING_TO_RESUME, std::memory_order_acq_rel);
-        return prev_state != State::FINISH;
+        State prev_state = state.state();
+        do {
+            // keep the FINISH state, so that the frame is destroyed by the last reference
+            if (prev_state == State::FINISH) { return false; }
+            if (prev_state == State::CANCELLED) {
+                throw HuCoroGeneralErr("The spawn task has been cancelled by the shutdown of scheduler");
+            }
+        } while (!state.state_.compare_exchange_weak(prev_state, State::WAITING_TO_RESUME, std::memory_order_acq_rel));
+        return true;
     }
 
 protected:
     coroutine_handle_t coroutine_;
+    detail::TaskLocalGuard context_guard_;
 };
 
 /// When call `join_handle.result()`, it may throw exception
@@ -233,21 +339,70 @@ template<typename Result>
 class JoinHandle : public JoinHandleBase<Result> {
 public:
     using JoinHandleBase<Result>::JoinHandleBase;
-    Result& await_resume() & { return this->coroutine_.promise().result(); }
+    Result& await_resume() & {
+        this->context_guard_.restore();
+        return this->coroutine_.promise().result();
+    }
 
-    Result&& await_resume() && { return std::move(this->coroutine_.promise()).result(); }
+    Result&& await_resume() && {
+        this->context_guard_.restore();
+        return std::move(this->coroutine_.promise()).result();
+    }
 };
 
 template<>
 class JoinHandle<void> : public JoinHandleBase<void> {
 public:
     using JoinHandleBase<void>::JoinHandleBase;
-    void await_resume() { this->coroutine_.promise().result(); }
+    void await_resume() {
+        this->context_guard_.restore();
+        this->coroutine_.promise().result();
+    }
 };
 
 template<typename Result>
 JoinHandle(std::coroutine_handle<SpawnTaskPromise<Result>>) -> JoinHandle<Result>;
 
+/// A group of JoinHandle returned by `spawn_n` / `spawn_many`.
+/// `co_await join_set.join()` waits for all of them in order, and returns
+/// the results in a std::vector (or nothing for JoinSet<void>).
+template<typename Result>
+class JoinSet {
+public:
+    using result_t = std::conditional_t<std::is_same_v<Result, void>, void, std::vector<Result>>;
+
+    JoinSet() = default;
+    JoinSet(JoinSet&&) noexcept = default;
+    JoinSet& operator=(JoinSet&&) noexcept = default;
+    JoinSet(const JoinSet&) = delete;
+    JoinSet& operator=(const JoinSet&) = delete;
+
+    void reserve(std::size_t n) { handles_.reserve(n); }
+    void push_back(JoinHandle<Result>&& handle) { handles_.push_back(std::move(handle)); }
+
+    std::size_t size() const noexcept { return handles_.size(); }
+    bool empty() const noexcept { return handles_.empty(); }
+    JoinHandle<Result>& operator[](std::size_t idx) { return handles_[idx]; }
+    auto begin() noexcept { return handles_.begin(); }
+    auto end() noexcept { return handles_.end(); }
+
+    /// If any of the task throws, the exception is rethrown after the previous
+    /// tasks have been joined (the remaining are still running).
+    Task<result_t> join() {
+        if constexpr (std::is_same_v<Result, void>) {
+            for (auto& handle: handles_) { co_await handle; }
+        } else {
+            std::vector<Result> results;
+            results.reserve(handles_.size());
+            for (auto& handle: handles_) { results.push_back(std::move(co_await handle)); }
+            co_return results;
+        }
+    }
+
+private:
+    std::vector<JoinHandle<Result>> handles_;
+};
+
 template<typename Result>
 std::pair<JoinHandle<Result>, SpawnTask> SpawnTaskPromise<Result>::get_return_object() {
     using coroutine_handle_t = std::coroutine_handle<SpawnTaskPromise<Result>>;
@@ -61,7 +61,7 @@ namespace detail {
         Task<T> get_return_object() noexcept { return Task{coroutine_handle_t::from_promise(*this)}; }
 
         template<typename U>
-        void return_value(U&& result) noexcept(noexcept(result_ = std::forward<T>(result))) {
+        void return_value(U&& result) noexcept(noexcept(result_ = std::forward<U>(result))) {
             result_ = std::forward<U>(result);
         }
         void unhandled_exception() noexcept { result_ = std::current_exception(); }
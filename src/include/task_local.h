@@ -0,0 +1,181 @@
+//
+// Created by dreamHuang on 2023/3/18.
+//
+
+#ifndef HUCORO_TASK_LOCAL_H
+#define HUCORO_TASK_LOCAL_H
+
+#include "config.h"
+#include "exception.h"
+#include "task_registry.h"
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace hucoro {
+class SpawnTaskPromiseState;
+
+namespace detail {
+    /// An outside completion which writes to the frame of a suspended task later (e.g. the callback
+    /// of `async_from_callback` completed by another thread), so the frame can not simply be
+    /// destroyed by the cancellation of the task (see `SpawnTaskList::cancel_unfinished`).
+    struct PendingCompletion {
+        /// Called by the cancellation with a reference to `task` taken. Return true if the
+        /// completion is abandoned, i.e. the completer drops the reference instead of resuming
+        /// the task; otherwise it has completed and does not touch the frame any more.
+        bool (*abandon_)(PendingCompletion* node, SpawnTaskPromiseState& task) noexcept = nullptr;
+        PendingCompletion* prev_ = nullptr;
+        PendingCompletion* next_ = nullptr;
+    };
+
+    /// The task local variables of a spawned task (or the root task of `block_on`),
+    /// which is stored in the promise of spawn task.
+    ///
+    /// The slots are allocated lazily by the first `TaskLocal::set` (or inheriting from
+    /// the parent), so a task without task local only pays a null pointer.
+    class TaskLocalContext {
+    public:
+        using slots_t = std::array<std::shared_ptr<void>, HUCORO_TASK_LOCAL_SLOTS>;
+
+        TaskLocalContext() = default;
+        TaskLocalContext(const TaskLocalContext&) = delete;
+        TaskLocalContext& operator=(const TaskLocalContext&) = delete;
+
+        void* get(std::size_t slot) const noexcept { return slots_ ? (*slots_)[slot].get() : nullptr; }
+
+        void set(std::size_t slot, std::shared_ptr<void> value) {
+            if (!slots_) { slots_ = std::make_unique<slots_t>(); }
+            (*slots_)[slot] = std::move(value);
+        }
+
+        /// Copy all the variables of `parent`, the values are shared (not deep copied).
+        void inherit_from(const TaskLocalContext& parent) {
+            if (parent.slots_) { slots_ = std::make_unique<slots_t>(*parent.slots_); }
+        }
+
+        /// The outside completions the task is suspended on, which are only touched by the thread
+        /// running the task (or cancelling it)
+        PendingCompletion* pending() const noexcept { return pending_; }
+
+        void add_pending(PendingCompletion& node) noexcept {
+            node.prev_ = nullptr;
+            node.next_ = pending_;
+            if (pending_) { pending_->prev_ = &node; }
+            pending_ = &node;
+        }
+
+        void remove_pending(PendingCompletion& node) noexcept {
+            if (node.prev_) {
+                node.prev_->next_ = node.next_;
+            } else {
+                pending_ = node.next_;
+            }
+            if (node.next_) { node.next_->prev_ = node.prev_; }
+            node.prev_ = node.next_ = nullptr;
+        }
+
+        /// The entry of the task in TaskRegistry, null if not registered
+        TaskRegistryNode* registry_node() const noexcept { return registry_node_; }
+        void set_registry_node(TaskRegistryNode* node) noexcept { registry_node_ = node; }
+
+        /// The context of the task running on current thread
+        static TaskLocalContext* current() noexcept { return CURRENT; }
+
+        /// Switch the context of current thread, return the previous one
+        static TaskLocalContext* exchange(TaskLocalContext* context) noexcept {
+            return std::exchange(CURRENT, context);
+        }
+
+    private:
+        std::unique_ptr<slots_t> slots_;
+        TaskRegistryNode* registry_node_ = nullptr;
+        PendingCompletion* pending_ = nullptr;
+
+        thread_local static TaskLocalContext* CURRENT;
+    };
+
+    std::size_t allocate_task_local_slot();
+}// namespace detail
+
+/// TaskLocal<T> is a variable whose value is local to the spawned task (like thread_local,
+/// but follows the task instead of the thread), e.g. request id, deadline or tracing span.
+///
+/// 1. The value is visible to the spawned task and all the `Task`s it awaits.
+/// 2. Spawned tasks inherit the values of their parent if `SpawnOptions::inherit_task_locals`.
+/// 3. Reading is a fixed slot index without hashing or allocation.
+///
+/// Each TaskLocal occupies one of the HUCORO_TASK_LOCAL_SLOTS slots for the whole program,
+/// so it is supposed to be declared as a static / global variable.
+template<typename T>
+class TaskLocal {
+public:
+    TaskLocal() : slot_(detail::allocate_task_local_slot()) {}
+    TaskLocal(const TaskLocal&) = delete;
+    TaskLocal& operator=(const TaskLocal&) = delete;
+
+    /// Return nullptr if the value is not set (or out of the scope of task)
+    T* get() const noexcept {
+        auto* context = detail::TaskLocalContext::current();
+        return context ? static_cast<T*>(context->get(slot_)) : nullptr;
+    }
+
+    /// Set the value of current task, the inherited value of the child tasks is not affected.
+    template<typename... Args>
+    T& set(Args&&... args) {
+        auto* context = detail::TaskLocalContext::current();
+        if (!context) { throw HuCoroGeneralErr("Try set task local out side the scope of task"); }
+        auto value = std::make_shared<T>(std::forward<Args>(args)...);
+        T& ref = *value;
+        context->set(slot_, std::move(value));
+        return ref;
+    }
+
+    void reset() {
+        auto* context = detail::TaskLocalContext::current();
+        if (context) { context->set(slot_, nullptr); }
+    }
+
+private:
+    std::size_t slot_;
+};
+
+namespace detail {
+    /// Record the type of awaiter in the registry entry of current task (see TaskRegistry)
+    template<typename Awaiter>
+    void note_await() noexcept {
+        auto* context = TaskLocalContext::current();
+        if (context && context->registry_node()) { context->registry_node()->on_await<Awaiter>(); }
+    }
+
+    /// Used by the awaiters whose awaiting coroutine may be resumed by another task (e.g. JoinHandle),
+    /// to restore the task local context of the awaiting coroutine.
+    class TaskLocalGuard {
+    public:
+        void save() noexcept {
+            context_ = TaskLocalContext::current();
+            saved_ = true;
+        }
+
+        /// Also record `awaiter` as what the current task is suspended on
+        template<typename Awaiter>
+        void save(const Awaiter&) noexcept {
+            save();
+            note_await<Awaiter>();
+        }
+
+        /// Do nothing if not saved (i.e. the awaiter did not suspend)
+        void restore() const noexcept {
+            if (!saved_) { return; }
+            TaskLocalContext::exchange(context_);
+            if (context_ && context_->registry_node()) { context_->registry_node()->on_resume(); }
+        }
+
+    private:
+        TaskLocalContext* context_ = nullptr;
+        bool saved_ = false;
+    };
+}// namespace detail
+}// namespace hucoro
+
+#endif//HUCORO_TASK_LOCAL_H
@@ -0,0 +1,100 @@
+//
+// Created by dreamHuang on 2023/3/30.
+//
+
+#ifndef HUCORO_TASK_REGISTRY_H
+#define HUCORO_TASK_REGISTRY_H
+
+#include "clock.h"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <source_location>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+namespace hucoro {
+class SpawnTaskPromiseState;
+
+namespace detail {
+    /// The intrusive entry of a spawned task in TaskRegistry, which is a member of its promise
+    struct TaskRegistryNode {
+        TaskRegistryNode* prev_ = nullptr;
+        TaskRegistryNode* next_ = nullptr;
+        // the shard of TaskRegistry, SIZE_MAX if not registered
+        std::size_t shard_ = SIZE_MAX;
+        std::uint64_t id_ = 0;
+        std::source_location location_;
+        const SpawnTaskPromiseState* owner_ = nullptr;
+        // the time (in RuntimeClock) of spawn or the last resume
+        std::atomic<std::int64_t> last_resume_{0};
+        // the type of the awaiter it is suspended on, null when running. Only the awaiters saving
+        // the context by `TaskLocalGuard::save(awaiter)` are recorded, others are reported as none.
+        std::atomic<const std::type_info*> awaiter_{nullptr};
+
+        bool registered() const noexcept { return shard_ != SIZE_MAX; }
+
+        void on_resume() noexcept {
+            last_resume_.store(RuntimeClock::now().time_since_epoch().count(), std::memory_order_relaxed);
+            awaiter_.store(nullptr, std::memory_order_relaxed);
+        }
+
+        template<typename Awaitable>
+        void on_await() noexcept {
+            awaiter_.store(&typeid(Awaitable), std::memory_order_relaxed);
+        }
+    };
+}// namespace detail
+
+/// A snapshot of a live spawned task
+struct TaskSnapshot {
+    std::uint64_t id;
+    std::source_location location;
+    // INIT / IN_PROGRESS / WAITING_TO_RESUME / FINISH
+    const char* state;
+    // time since the last resume (or spawn if never resumed)
+    std::chrono::nanoseconds since_last_resume;
+    // the demangled type of the awaiter it is suspended on, empty if it is running (or suspended
+    // on an awaiter not recorded by `TaskLocalGuard`, e.g. a plain Task or std::suspend_always)
+    std::string awaiter;
+};
+
+/// TaskRegistry is an opt-in registry of the live spawned tasks, for diagnosing the stalls
+/// (e.g. which tasks have not been resumed for a long time, and what they are waiting for).
+///
+/// 1. When enabled, `spawn` links the promise into one of the sharded intrusive lists (one
+/// uncontended lock), and it is unlinked when the coroutine frame is destroyed. The tasks
+/// spawned before enabling are not registered.
+/// 2. When disabled (the default), `spawn` only pays a relaxed atomic load.
+///
+/// `dump` takes the locks, so it can not be called in a signal handler directly. Instead,
+/// receive the signal by `signals({SIGUSR1}).next()` in a task (see process.h) and dump there.
+class TaskRegistry {
+public:
+    static void enable(bool enabled = true) noexcept { ENABLED.store(enabled, std::memory_order_relaxed); }
+    static bool enabled() noexcept { return ENABLED.load(std::memory_order_relaxed); }
+
+    /// The number of registered live tasks
+    static std::size_t size();
+
+    /// Snapshots of all the registered tasks, the longest not resumed first
+    static std::vector<TaskSnapshot> snapshot();
+
+    /// One line per task, e.g.
+    /// `#12 WAITING_TO_RESUME 1520.3ms awaiter=hucoro::IoRegistration::ReadyAwaiter at main.cpp:42 (serve)`
+    static std::string dump();
+    /// Write `dump()` to `fd` (e.g. STDERR_FILENO)
+    static void dump(int fd);
+
+    /// Register the task (used by `spawn`)
+    static void add(SpawnTaskPromiseState& state, std::source_location location);
+    static void remove(detail::TaskRegistryNode& node) noexcept;
+
+private:
+    static std::atomic<bool> ENABLED;
+};
+}// namespace hucoro
+
+#endif//HUCORO_TASK_REGISTRY_H
@@ -0,0 +1,101 @@
+//
+// Created by dreamHuang on 2023/3/24.
+//
+
+#ifndef HUCORO_TCP_H
+#define HUCORO_TCP_H
+
+#include "config.h"
+#include "io_driver.h"
+#include "iobuf.h"
+#include "single_thread_scheduler.h"
+#include "task.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+namespace hucoro {
+/// A non-blocking TCP connection, see AsyncFd for the constraints.
+///
+/// At most one coroutine can read, and one can write at the same time.
+class TcpStream {
+public:
+    TcpStream() noexcept = default;
+    /// take the ownership of `fd`, which will be set to non-blocking
+    explicit TcpStream(int fd) : io_(fd) {}
+
+    /// `host` is an IPv4 address, throws std::system_error on failure
+    static Task<TcpStream> connect(std::string host, std::uint16_t port);
+
+    int fd() const noexcept { return io_.fd(); }
+    bool is_open() const noexcept { return io_.is_open(); }
+    void close() noexcept { io_.close(); }
+
+    void set_nodelay(bool nodelay);
+
+    /// Read at most `size` bytes, return 0 at the end of stream
+    Task<std::size_t> read(void* buf, std::size_t size);
+    /// Read into the tail of `buf` (from the BufferPool of current scheduler), return 0 at the end of stream
+    Task<std::size_t> read(IOBuf& buf);
+    /// Write all the `size` bytes
+    Task<void> write(const void* buf, std::size_t size);
+    /// Write all the bytes of `buf` (by `writev`) and consume them
+    Task<void> write(IOBuf& buf);
+    /// Graceful shutdown: send FIN, then wait for (and discard the data before) the FIN of peer
+    Task<void> shutdown();
+
+private:
+    friend class TcpListener;
+
+    AsyncFd io_;
+};
+
+/// A listening TCP socket whose `accept` is awaitable.
+///
+/// With `reuse_port` (the default), several listeners can bind to the same port, and the kernel
+/// distributes the incoming connections among them. So each scheduler thread can have its own
+/// listener and accept without a shared lock (or a thundering herd).
+class TcpListener {
+public:
+    struct Options {
+        int backlog = 1024;
+        bool reuse_port = true;
+    };
+
+    TcpListener(TcpListener&& other) noexcept : stream_(std::move(other.stream_)) {}
+    TcpListener& operator=(TcpListener&& other) noexcept {
+        stream_ = std::move(other.stream_);
+        return *this;
+    }
+
+    /// `host` is an IPv4 address, port 0 means any port (see `local_port`).
+    /// Throws std::system_error on failure
+    static TcpListener bind(const std::string& host, std::uint16_t port, Options options);
+    static TcpListener bind(const std::string& host, std::uint16_t port) { return bind(host, port, Options{}); }
+
+    int fd() const noexcept { return stream_.fd(); }
+    std::uint16_t local_port() const;
+
+    Task<TcpStream> accept();
+
+    /// Accept connections (at most `max_connections`) and spawn a task running `handler(TcpStream)`
+    /// for each of them. `handler` returns an awaitable, and it is copied into every spawned task.
+    template<typename HANDLER>
+    Task<void> serve(HANDLER handler, std::size_t max_connections = SIZE_MAX) {
+        for (std::size_t i = 0; i < max_connections; ++i) {
+            auto stream = co_await accept();
+            SingleThreadScheduler::spawn(
+                    [handler, stream = std::move(stream)]() mutable { return handler(std::move(stream)); });
+        }
+    }
+
+private:
+    explicit TcpListener(TcpStream&& stream) noexcept : stream_(std::move(stream)) {}
+
+    // reuse the registration of TcpStream
+    TcpStream stream_;
+};
+}// namespace hucoro
+
+#endif//HUCORO_TCP_H
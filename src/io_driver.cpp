@@ -0,0 +1,345 @@
+//
+// Created by dreamHuang on 2023/3/22.
+//
+
+#include "io_driver.h"
+#include "exception.h"
+#include "single_thread_scheduler.h"
+#include <algorithm>
+#include <cerrno>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace hucoro {
+namespace {
+    [[noreturn]] void throw_errno(const char* what) { throw std::system_error(errno, std::system_category(), what); }
+
+    constexpr int MAX_EPOLL_EVENTS = 64;
+}// namespace
+
+/*
+ * IoRegistration
+ */
+
+IoRegistration::IoRegistration(IoDriver& driver, int fd) : driver_(&driver), fd_(fd) {
+    driver.add(fd, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, this);
+}
+
+IoRegistration::~IoRegistration() { driver_->remove(fd_); }
+
+void IoRegistration::ReadyAwaiter::await_suspend(std::coroutine_handle<> awaiting_coroutine) {
+    auto idx = IoRegistration::index(interest_);
+    if (registration_.waiters_[idx]) {
+        throw HuCoroGeneralErr("There is already a coroutine waiting for the same interest of fd");
+    }
+    context_guard_.save(*this);
+    registration_.waiters_[idx] = awaiting_coroutine;
+    registration_.driver_->suspend();
+}
+
+void IoRegistration::on_event(std::uint32_t events) {
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+        ready_[index(Interest::READABLE)] = true;
+        if (auto& waiter = waiters_[index(Interest::READABLE)]) { driver_->wake(std::exchange(waiter, nullptr)); }
+    }
+    if (events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+        ready_[index(Interest::WRITABLE)] = true;
+        if (auto& waiter = waiters_[index(Interest::WRITABLE)]) { driver_->wake(std::exchange(waiter, nullptr)); }
+    }
+}
+
+/*
+ * AsyncFd
+ */
+
+AsyncFd::AsyncFd(int fd) : fd_(fd) {
+    int flags = ::fcntl(fd, F_GETFL);
+    if (flags < 0 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) { throw_errno("fcntl"); }
+}
+
+void AsyncFd::close() noexcept {
+    // unregister before closing the fd
+    registration_.reset();
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+IoRegistration::ReadyAwaiter AsyncFd::wait(Interest interest) {
+    if (!registration_) { registration_ = std::make_unique<IoRegistration>(SingleThreadScheduler::io_driver(), fd_); }
+    registration_->clear_ready(interest);
+    return registration_->ready(interest);
+}
+
+/*
+ * IoDriver
+ */
+
+IoDriver::IoDriver() : epoll_fd_(::epoll_create1(EPOLL_CLOEXEC)) {
+    if (epoll_fd_ < 0) { throw_errno("epoll_create1"); }
+    wake_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd_ < 0) {
+        ::close(epoll_fd_);
+        throw_errno("eventfd");
+    }
+    // the event without source is the remote wake
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLET;
+    event.data.ptr = nullptr;
+    if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event) < 0) {
+        ::close(wake_fd_);
+        ::close(epoll_fd_);
+        throw_errno("epoll_ctl add");
+    }
+}
+
+IoDriver::~IoDriver() {
+    // a remote thread may still be writing wake_fd_ after its coroutine has been resumed
+    while (remote_wakers_.load(std::memory_order_acquire) > 0) {}
+    aio_.reset();
+    ::close(wake_fd_);
+    ::close(epoll_fd_);
+}
+
+std::size_t IoDriver::poll(int timeout_ms) {
+    epoll_event events[MAX_EPOLL_EVENTS];
+    // do not block if there are coroutines waiting to be resumed
+    if (!ready_.empty()) {
+        timeout_ms = 0;
+    } else if (pollable_head_ && (timeout_ms < 0 || timeout_ms > POLLABLE_INTERVAL_MS)) {
+        timeout_ms = POLLABLE_INTERVAL_MS;
+    }
+    int num = ::epoll_wait(epoll_fd_, events, MAX_EPOLL_EVENTS, timeout_ms);
+    if (num < 0 && errno != EINTR) { throw_errno("epoll_wait"); }
+    for (int i = 0; i < num; ++i) {
+        if (auto* source = static_cast<detail::IoSource*>(events[i].data.ptr)) {
+            source->on_event(events[i].events);
+        } else {
+            drain_remote();
+        }
+    }
+    if (pollable_head_) { check_pollables(); }
+
+    // the resumed coroutines may wake others, which will be resumed by the next poll
+    resuming_.swap(ready_);
+    waiting_ -= resuming_.size();
+    for (auto coroutine: resuming_) { coroutine.resume(); }
+    std::size_t resumed = resuming_.size();
+    resuming_.clear();
+    return resumed;
+}
+
+detail::AioContext& IoDriver::aio() {
+    if (!aio_) { aio_ = std::make_unique<detail::AioContext>(*this); }
+    return *aio_;
+}
+
+void IoDriver::add(int fd, std::uint32_t events, detail::IoSource* source) {
+    epoll_event event{};
+    event.events = events;
+    event.data.ptr = source;
+    if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0) { throw_errno("epoll_ctl add"); }
+}
+
+void IoDriver::remove(int fd) noexcept { ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr); }
+
+void IoDriver::wake(std::coroutine_handle<> coroutine) {
+    ready_.push_back(coroutine);
+}
+
+void IoDriver::remote_wake(detail::RemoteWakeNode& node) noexcept {
+    remote_wakers_.fetch_add(1, std::memory_order_relaxed);
+    auto* head = remote_head_.load(std::memory_order_relaxed);
+    do {
+        node.next_ = head;
+    } while (!remote_head_.compare_exchange_weak(head, &node, std::memory_order_release, std::memory_order_relaxed));
+    // only the first one after a drain has to notify, the others are drained together
+    if (head == nullptr) {
+        std::uint64_t one = 1;
+        [[maybe_unused]] auto n = ::write(wake_fd_, &one, sizeof(one));
+    }
+    remote_wakers_.fetch_sub(1, std::memory_order_release);
+}
+
+void IoDriver::notify() noexcept {
+    remote_wakers_.fetch_add(1, std::memory_order_relaxed);
+    std::uint64_t one = 1;
+    [[maybe_unused]] auto n = ::write(wake_fd_, &one, sizeof(one));
+    remote_wakers_.fetch_sub(1, std::memory_order_release);
+}
+
+bool IoDriver::woken(std::coroutine_handle<> coroutine) {
+    drain_remote();
+    return std::find(ready_.begin(), ready_.end(), coroutine) != ready_.end();
+}
+
+void IoDriver::drain_remote() {
+    std::uint64_t count;
+    // reset the counter before taking the nodes, so a later remote_wake notifies again
+    while (::read(wake_fd_, &count, sizeof(count)) > 0) {}
+    auto* node = remote_head_.exchange(nullptr, std::memory_order_acquire);
+    // the stack is in LIFO order, wake them in the order of remote_wake
+    std::size_t first = ready_.size();
+    while (node) {
+        // the node is invalid once its coroutine is resumed, which happens after this
+        auto* next = node->next_;
+        ready_.push_back(node->coroutine_);
+        node = next;
+    }
+    std::reverse(ready_.begin() + static_cast<std::ptrdiff_t>(first), ready_.end());
+}
+
+void IoDriver::add_pollable(detail::PollableNode& node) noexcept {
+    node.prev_ = nullptr;
+    node.next_ = pollable_head_;
+    if (pollable_head_) { pollable_head_->prev_ = &node; }
+    pollable_head_ = &node;
+}
+
+void IoDriver::remove_pollable(detail::PollableNode& node) noexcept {
+    if (node.prev_) {
+        node.prev_->next_ = node.next_;
+    } else {
+        pollable_head_ = node.next_;
+    }
+    if (node.next_) { node.next_->prev_ = node.prev_; }
+    node.prev_ = node.next_ = nullptr;
+}
+
+void IoDriver::check_pollables() {
+    auto* node = pollable_head_;
+    while (node) {
+        auto* next = node->next_;
+        if (node->is_ready_(node)) {
+            remove_pollable(*node);
+            node->is_ready_ = nullptr;
+            wake(node->coroutine_);
+        }
+        node = next;
+    }
+}
+
+/*
+ * AIO
+ */
+
+namespace detail {
+    void AioOperation::prepare(std::uint16_t opcode, int fd, void* buf, std::size_t size,
+                               std::int64_t offset) noexcept {
+        iocb_ = {};
+        iocb_.aio_lio_opcode = opcode;
+        iocb_.aio_fildes = static_cast<std::uint32_t>(fd);
+        iocb_.aio_buf = reinterpret_cast<std::uint64_t>(buf);
+        iocb_.aio_nbytes = size;
+        iocb_.aio_offset = offset;
+        iocb_.aio_data = reinterpret_cast<std::uint64_t>(this);
+        result_ = 0;
+        submitted_ = false;
+        done_ = false;
+    }
+
+    AioContext::AioContext(IoDriver& driver) : driver_(driver) {
+        if (::syscall(SYS_io_setup, MAX_EVENTS, &context_) < 0) { throw_errno("io_setup"); }
+        event_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (event_fd_ < 0) {
+            ::syscall(SYS_io_destroy, context_);
+            throw_errno("eventfd");
+        }
+        driver.add(event_fd_, EPOLLIN | EPOLLET, this);
+    }
+
+    AioContext::~AioContext() {
+        // io_destroy waits for the in-flight operations
+        ::syscall(SYS_io_destroy, context_);
+        driver_.remove(event_fd_);
+        ::close(event_fd_);
+    }
+
+    void AioContext::submit(AioOperation* ops, std::size_t num) {
+        constexpr std::size_t MAX_BATCH = 64;
+        struct iocb* iocbs[MAX_BATCH];
+        std::size_t idx = 0;
+        while (idx < num) {
+            std::size_t batch = std::min(MAX_BATCH, num - idx);
+            for (std::size_t i = 0; i < batch; ++i) {
+                auto& op = ops[idx + i];
+                op.iocb_.aio_flags |= IOCB_FLAG_RESFD;
+                op.iocb_.aio_resfd = static_cast<std::uint32_t>(event_fd_);
+                // the operation may have been moved since `prepare`
+                op.iocb_.aio_data = reinterpret_cast<std::uint64_t>(&op);
+                iocbs[i] = &op.iocb_;
+            }
+            long submitted = ::syscall(SYS_io_submit, context_, static_cast<long>(batch), iocbs);
+            if (submitted < 0) {
+                if (errno == EINTR) { continue; }
+                if (errno == EAGAIN && in_flight_ > 0) {
+                    // too many in-flight operations, wait for some of them
+                    reap(true);
+                    continue;
+                }
+                // the first one is invalid, fail it and go on
+                complete(ops[idx], -errno);
+                idx += 1;
+                continue;
+            }
+            for (long i = 0; i < submitted; ++i) { ops[idx + i].submitted_ = true; }
+            in_flight_ += static_cast<std::size_t>(submitted);
+            idx += static_cast<std::size_t>(submitted);
+        }
+    }
+
+    void AioContext::reap(bool blocking) {
+        struct io_event events[MAX_EVENTS];
+        struct timespec no_wait {};
+        while (in_flight_ > 0) {
+            long num = ::syscall(SYS_io_getevents, context_, blocking ? 1L : 0L, static_cast<long>(MAX_EVENTS),
+                                 events, blocking ? nullptr : &no_wait);
+            if (num < 0) {
+                if (errno == EINTR) { continue; }
+                throw_errno("io_getevents");
+            }
+            for (long i = 0; i < num; ++i) {
+                in_flight_ -= 1;
+                complete(*reinterpret_cast<AioOperation*>(events[i].data), events[i].res);
+            }
+            if (num < static_cast<long>(MAX_EVENTS)) { break; }
+            blocking = false;
+        }
+    }
+
+    void AioContext::cancel(AioOperation& op) {
+        op.waiter_ = nullptr;
+        if (!op.submitted_ || op.done_) { return; }
+        struct io_event event {};
+        // most of the operations can not be cancelled (EINVAL), and the cancelled ones
+        // (EINPROGRESS) are still reported by io_getevents
+        ::syscall(SYS_io_cancel, context_, &op.iocb_, &event);
+        while (!op.done_) { reap(true); }
+    }
+
+    void AioContext::on_event(std::uint32_t) {
+        std::uint64_t count;
+        // reset the counter of eventfd
+        while (::read(event_fd_, &count, sizeof(count)) > 0) {}
+        reap(false);
+    }
+
+    void AioContext::complete(AioOperation& op, std::int64_t result) {
+        op.result_ = result;
+        op.done_ = true;
+        AioWaiter* waiter = op.waiter_;
+        if (!waiter) { return; }
+        waiter->remaining_ -= 1;
+        if (waiter->first_done_ == SIZE_MAX) { waiter->first_done_ = op.index_; }
+        if (waiter->coroutine_ && (waiter->wait_any_ || waiter->remaining_ == 0)) {
+            driver_.wake(std::exchange(waiter->coroutine_, nullptr));
+        }
+    }
+}// namespace detail
+}// namespace hucoro
@@ -0,0 +1,171 @@
+//
+// Created by dreamHuang on 2023/3/20.
+//
+
+#include "iobuf.h"
+#include "exception.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <unistd.h>
+#include <utility>
+
+namespace hucoro {
+IOBuf::IOBuf(IOBuf&& other) noexcept
+    : segments_(std::move(other.segments_)), length_(std::exchange(other.length_, 0)),
+      pending_(std::move(other.pending_)), pending_offset_(other.pending_offset_) {
+    other.segments_.clear();
+}
+
+IOBuf& IOBuf::operator=(IOBuf&& other) noexcept {
+    if (this != &other) {
+        segments_ = std::move(other.segments_);
+        other.segments_.clear();
+        length_ = std::exchange(other.length_, 0);
+        pending_ = std::move(other.pending_);
+        pending_offset_ = other.pending_offset_;
+    }
+    return *this;
+}
+
+IOBuf IOBuf::clone() const {
+    IOBuf buf;
+    buf.segments_ = segments_;
+    buf.length_ = length_;
+    return buf;
+}
+
+std::span<std::byte> IOBuf::prepare(BufferPool& pool) {
+    if (!segments_.empty()) {
+        auto& tail = segments_.back();
+        std::size_t end = tail.offset_ + tail.length_;
+        if (tail.buffer_.unique() && end < tail.buffer_.capacity()) {
+            pending_ = tail.buffer_;
+            pending_offset_ = end;
+            return {pending_.data() + end, pending_.capacity() - end};
+        }
+    }
+    pending_ = pool.allocate();
+    pending_offset_ = 0;
+    return {pending_.data(), pending_.capacity()};
+}
+
+void IOBuf::commit(std::size_t n) {
+    if (!pending_) { throw HuCoroGeneralErr("IOBuf::commit without prepare"); }
+    if (n > pending_.capacity() - pending_offset_) {
+        throw HuCoroGeneralErr("IOBuf::commit more bytes than prepared");
+    }
+    if (n > 0) {
+        if (!segments_.empty() && segments_.back().buffer_.get() == pending_.get()) {
+            // the space is right after the tail segment
+            segments_.back().length_ += n;
+        } else {
+            segments_.push_back(Segment{std::move(pending_), pending_offset_, n});
+        }
+        length_ += n;
+    }
+    pending_.reset();
+}
+
+void IOBuf::append(const void* data, std::size_t size, BufferPool& pool) {
+    auto* src = static_cast<const std::byte*>(data);
+    while (size > 0) {
+        auto space = prepare(pool);
+        std::size_t n = std::min(size, space.size());
+        std::memcpy(space.data(), src, n);
+        commit(n);
+        src += n;
+        size -= n;
+    }
+}
+
+void IOBuf::append(IOBuf&& other) {
+    for (auto& segment: other.segments_) { segments_.push_back(std::move(segment)); }
+    length_ += other.length_;
+    other.segments_.clear();
+    other.length_ = 0;
+}
+
+IOBuf IOBuf::split(std::size_t n) {
+    if (n > length_) { throw HuCoroGeneralErr("IOBuf::split more bytes than its length"); }
+    IOBuf front;
+    while (n > 0) {
+        auto& segment = segments_.front();
+        if (segment.length_ <= n) {
+            n -= segment.length_;
+            front.length_ += segment.length_;
+            length_ -= segment.length_;
+            front.segments_.push_back(std::move(segment));
+            segments_.pop_front();
+        } else {
+            // share the buffer between the two IOBufs
+            front.segments_.push_back(Segment{segment.buffer_, segment.offset_, n});
+            front.length_ += n;
+            segment.offset_ += n;
+            segment.length_ -= n;
+            length_ -= n;
+            n = 0;
+        }
+    }
+    return front;
+}
+
+void IOBuf::trim_front(std::size_t n) {
+    if (n > length_) { throw HuCoroGeneralErr("IOBuf::trim_front more bytes than its length"); }
+    length_ -= n;
+    while (n > 0) {
+        auto& segment = segments_.front();
+        if (segment.length_ <= n) {
+            n -= segment.length_;
+            segments_.pop_front();
+        } else {
+            segment.offset_ += n;
+            segment.length_ -= n;
+            n = 0;
+        }
+    }
+}
+
+std::size_t IOBuf::to_iovec(struct iovec* iov, std::size_t max_iov) const noexcept {
+    std::size_t num = std::min(max_iov, segments_.size());
+    for (std::size_t i = 0; i < num; ++i) {
+        iov[i].iov_base = segments_[i].buffer_.data() + segments_[i].offset_;
+        iov[i].iov_len = segments_[i].length_;
+    }
+    return num;
+}
+
+std::size_t IOBuf::copy_to(void* dest, std::size_t size) const noexcept {
+    auto* dst = static_cast<std::byte*>(dest);
+    std::size_t copied = 0;
+    for (auto& segment: segments_) {
+        if (copied == size) { break; }
+        std::size_t n = std::min(size - copied, segment.length_);
+        std::memcpy(dst + copied, segment.buffer_.data() + segment.offset_, n);
+        copied += n;
+    }
+    return copied;
+}
+
+std::string IOBuf::to_string() const {
+    std::string str(length_, '\0');
+    copy_to(str.data(), str.size());
+    return str;
+}
+
+ssize_t IOBuf::read_from(int fd, BufferPool& pool) {
+    auto space = prepare(pool);
+    ssize_t n = ::read(fd, space.data(), space.size());
+    commit(n > 0 ? static_cast<std::size_t>(n) : 0);
+    return n;
+}
+
+ssize_t IOBuf::write_to(int fd) {
+    constexpr std::size_t MAX_IOV = IOV_MAX < 64 ? IOV_MAX : 64;
+    struct iovec iov[MAX_IOV];
+    std::size_t num = to_iovec(iov, MAX_IOV);
+    ssize_t n = ::writev(fd, iov, static_cast<int>(num));
+    if (n > 0) { trim_front(static_cast<std::size_t>(n)); }
+    return n;
+}
+}// namespace hucoro
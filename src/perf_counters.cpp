@@ -0,0 +1,130 @@
+//
+// Created by dreamHuang on 2023/3/28.
+//
+
+#include "perf_counters.h"
+#include <cstdio>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace hucoro {
+namespace {
+    struct EventConfig {
+        const char* name;
+        std::uint32_t type;
+        std::uint64_t config;
+    };
+
+    constexpr std::uint64_t cache_config(std::uint64_t cache) {
+        return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    }
+
+    // in the order of PerfEvent
+    constexpr EventConfig EVENT_CONFIGS[PERF_EVENT_NUM] = {
+            {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+            {"L1d-misses", PERF_TYPE_HW_CACHE, cache_config(PERF_COUNT_HW_CACHE_L1D)},
+            {"LLC-misses", PERF_TYPE_HW_CACHE, cache_config(PERF_COUNT_HW_CACHE_LL)},
+            {"context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+    };
+
+    /// Open the event into the group of `group_fd`, or as a new group leader if `group_fd` is -1
+    int open_event(const EventConfig& config, int group_fd) noexcept {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = config.type;
+        attr.config = config.config;
+        // only count the user space, which is allowed by perf_event_paranoid <= 2
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        // reading the leader returns {nr, values...} of the whole group
+        attr.read_format = PERF_FORMAT_GROUP;
+        // pid = 0, cpu = -1: the calling thread on any cpu
+        return static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, PERF_FLAG_FD_CLOEXEC));
+    }
+}// namespace
+
+const char* perf_event_name(PerfEvent event) noexcept { return EVENT_CONFIGS[static_cast<std::size_t>(event)].name; }
+
+PerfSample& PerfSample::operator+=(const PerfSample& other) noexcept {
+    for (std::size_t i = 0; i < PERF_EVENT_NUM; ++i) { values[i] += other.values[i]; }
+    return *this;
+}
+
+PerfSample PerfSample::operator-(const PerfSample& other) const noexcept {
+    PerfSample result;
+    for (std::size_t i = 0; i < PERF_EVENT_NUM; ++i) { result.values[i] = values[i] - other.values[i]; }
+    return result;
+}
+
+PerfCounters::PerfCounters() noexcept {
+    group_index_.fill(-1);
+    for (std::size_t i = 0; i < PERF_EVENT_NUM; ++i) {
+        int fd = leader_ >= 0 ? open_event(EVENT_CONFIGS[i], leader_) : -1;
+        if (fd >= 0) {
+            group_index_[i] = group_size_++;
+        } else {
+            // the first available event leads the group, or the event can not join the group
+            // (e.g. a software leader with hardware members), which is read by itself
+            fd = open_event(EVENT_CONFIGS[i], -1);
+            if (fd >= 0 && leader_ < 0) {
+                leader_ = fd;
+                group_index_[i] = group_size_++;
+            }
+        }
+        fds_[i] = fd;
+    }
+}
+
+PerfCounters::~PerfCounters() {
+    for (int fd: fds_) {
+        if (fd >= 0) { ::close(fd); }
+    }
+}
+
+bool PerfCounters::available() const noexcept {
+    for (int fd: fds_) {
+        if (fd >= 0) { return true; }
+    }
+    return false;
+}
+
+PerfSample PerfCounters::read() const noexcept {
+    PerfSample sample;
+    if (leader_ >= 0) {
+        // {nr, value of each member in the order of opening}
+        std::uint64_t group[1 + PERF_EVENT_NUM] = {};
+        auto expected = static_cast<ssize_t>(sizeof(std::uint64_t) * static_cast<std::size_t>(1 + group_size_));
+        if (::read(leader_, group, sizeof(group)) == expected) {
+            for (std::size_t i = 0; i < PERF_EVENT_NUM; ++i) {
+                if (group_index_[i] >= 0) { sample.values[i] = group[1 + group_index_[i]]; }
+            }
+        }
+    }
+    for (std::size_t i = 0; i < PERF_EVENT_NUM; ++i) {
+        if (fds_[i] < 0 || group_index_[i] >= 0) { continue; }
+        // {nr = 1, value} since every event is opened with PERF_FORMAT_GROUP
+        std::uint64_t single[2] = {};
+        if (::read(fds_[i], single, sizeof(single)) == sizeof(single)) { sample.values[i] = single[1]; }
+    }
+    return sample;
+}
+
+std::string PerfCounters::format(const PerfSample& sample, double divisor) const {
+    std::string str;
+    char buf[64];
+    for (std::size_t i = 0; i < PERF_EVENT_NUM; ++i) {
+        if (!str.empty()) { str += ' '; }
+        if (fds_[i] >= 0) {
+            std::snprintf(buf, sizeof(buf), "%s=%.1f", EVENT_CONFIGS[i].name,
+                          static_cast<double>(sample.values[i]) / divisor);
+        } else {
+            std::snprintf(buf, sizeof(buf), "%s=n/a", EVENT_CONFIGS[i].name);
+        }
+        str += buf;
+    }
+    return str;
+}
+}// namespace hucoro
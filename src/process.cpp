@@ -0,0 +1,252 @@
+//
+// Created by dreamHuang on 2023/3/26.
+//
+
+#include "process.h"
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+
+extern char** environ;
+
+namespace hucoro {
+namespace {
+    [[noreturn]] void throw_errno(const char* what) { throw std::system_error(errno, std::system_category(), what); }
+
+    // P_PIDFD of waitid (since Linux 5.4), which may be missing in the old headers
+    constexpr auto WAIT_PIDFD = static_cast<idtype_t>(3);
+
+    /// pipe2 with O_CLOEXEC, the end kept by parent will be set to non-blocking by Pipe
+    void make_pipe(int fds[2]) {
+        if (::pipe2(fds, O_CLOEXEC) < 0) { throw_errno("pipe2"); }
+    }
+}// namespace
+
+/*
+ * Pipe
+ */
+
+Task<std::size_t> Pipe::read(void* buf, std::size_t size) {
+    while (true) {
+        ssize_t n = ::read(fd(), buf, size);
+        if (n >= 0) { co_return static_cast<std::size_t>(n); }
+        if (errno == EAGAIN) {
+            co_await io_.wait(Interest::READABLE);
+        } else if (errno != EINTR) {
+            throw_errno("read");
+        }
+    }
+}
+
+Task<std::string> Pipe::read_to_end() {
+    std::string data;
+    char buf[4096];
+    std::size_t n;
+    while ((n = co_await read(buf, sizeof(buf))) > 0) { data.append(buf, n); }
+    co_return data;
+}
+
+Task<void> Pipe::write(const void* buf, std::size_t size) {
+    auto* data = static_cast<const char*>(buf);
+    while (size > 0) {
+        ssize_t n = ::write(fd(), data, size);
+        if (n >= 0) {
+            data += n;
+            size -= static_cast<std::size_t>(n);
+        } else if (errno == EAGAIN) {
+            co_await io_.wait(Interest::WRITABLE);
+        } else if (errno != EINTR) {
+            throw_errno("write");
+        }
+    }
+}
+
+/*
+ * Process
+ */
+
+Process::Process(Process&& other) noexcept
+    : pid_(std::exchange(other.pid_, -1)), pidfd_(std::move(other.pidfd_)),
+      reaped_(std::exchange(other.reaped_, true)), stdin_(std::move(other.stdin_)),
+      stdout_(std::move(other.stdout_)), stderr_(std::move(other.stderr_)) {}
+
+Process& Process::operator=(Process&& other) noexcept {
+    if (this != &other) {
+        reap_if_exited();
+        pid_ = std::exchange(other.pid_, -1);
+        pidfd_ = std::move(other.pidfd_);
+        reaped_ = std::exchange(other.reaped_, true);
+        stdin_ = std::move(other.stdin_);
+        stdout_ = std::move(other.stdout_);
+        stderr_ = std::move(other.stderr_);
+    }
+    return *this;
+}
+
+Process::~Process() { reap_if_exited(); }
+
+void Process::reap_if_exited() noexcept {
+    if (reaped_) { return; }
+    try {
+        ExitStatus status;
+        try_reap(status);
+    } catch (const std::system_error&) {
+        // e.g. ECHILD if SIGCHLD is ignored, nothing to reap
+    }
+}
+
+Process Process::spawn(const std::vector<std::string>& argv, Options options) {
+    if (argv.empty()) { throw std::system_error(EINVAL, std::system_category(), "spawn without argv"); }
+    std::vector<char*> args;
+    args.reserve(argv.size() + 1);
+    for (auto& arg: argv) { args.push_back(const_cast<char*>(arg.c_str())); }
+    args.push_back(nullptr);
+
+    // -1 means inherited
+    int child_fds[3] = {-1, -1, -1};
+    int parent_fds[3] = {-1, -1, -1};
+    const bool piped[3] = {options.pipe_stdin, options.pipe_stdout, options.pipe_stderr};
+    auto close_all = [&]() {
+        for (int i = 0; i < 3; ++i) {
+            if (child_fds[i] >= 0) { ::close(child_fds[i]); }
+            if (parent_fds[i] >= 0) { ::close(parent_fds[i]); }
+        }
+    };
+
+    posix_spawn_file_actions_t actions;
+    ::posix_spawn_file_actions_init(&actions);
+    try {
+        for (int i = 0; i < 3; ++i) {
+            if (!piped[i]) { continue; }
+            int fds[2];
+            make_pipe(fds);
+            // the child reads stdin from fds[0], and writes stdout / stderr to fds[1]
+            child_fds[i] = i == 0 ? fds[0] : fds[1];
+            parent_fds[i] = i == 0 ? fds[1] : fds[0];
+            // dup2 clears the O_CLOEXEC of target
+            ::posix_spawn_file_actions_adddup2(&actions, child_fds[i], i);
+        }
+    } catch (...) {
+        ::posix_spawn_file_actions_destroy(&actions);
+        close_all();
+        throw;
+    }
+
+    // the child would inherit the mask of this thread, e.g. the signals blocked by a SignalSet,
+    // so unblock all of them and reset the blocked ones to the default action
+    posix_spawnattr_t attr;
+    ::posix_spawnattr_init(&attr);
+    sigset_t blocked;
+    sigset_t empty;
+    ::pthread_sigmask(SIG_BLOCK, nullptr, &blocked);
+    ::sigemptyset(&empty);
+    ::posix_spawnattr_setsigmask(&attr, &empty);
+    ::posix_spawnattr_setsigdefault(&attr, &blocked);
+    ::posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+    pid_t pid;
+    int err = ::posix_spawnp(&pid, args[0], &actions, &attr, args.data(), environ);
+    ::posix_spawnattr_destroy(&attr);
+    ::posix_spawn_file_actions_destroy(&actions);
+    if (err != 0) {
+        close_all();
+        throw std::system_error(err, std::system_category(), "posix_spawnp " + argv[0]);
+    }
+    for (int& fd: child_fds) {
+        if (fd >= 0) { ::close(std::exchange(fd, -1)); }
+    }
+
+    Process process;
+    process.pid_ = pid;
+    // the pid can not be reused before the child is reaped, so there is no race here
+    int pidfd = static_cast<int>(::syscall(SYS_pidfd_open, pid, 0));
+    if (pidfd < 0) {
+        int open_errno = errno;
+        ::kill(pid, SIGKILL);
+        ::waitpid(pid, nullptr, 0);
+        process.reaped_ = true;
+        close_all();
+        throw std::system_error(open_errno, std::system_category(), "pidfd_open");
+    }
+    process.pidfd_ = AsyncFd{pidfd};
+    if (piped[0]) { process.stdin_ = Pipe{parent_fds[0]}; }
+    if (piped[1]) { process.stdout_ = Pipe{parent_fds[1]}; }
+    if (piped[2]) { process.stderr_ = Pipe{parent_fds[2]}; }
+    return process;
+}
+
+void Process::kill(int signal) {
+    if (reaped_) { throw std::system_error(ESRCH, std::system_category(), "kill a reaped process"); }
+    if (::syscall(SYS_pidfd_send_signal, pidfd_.fd(), signal, nullptr, 0) < 0) { throw_errno("pidfd_send_signal"); }
+}
+
+bool Process::try_reap(ExitStatus& status) {
+    siginfo_t info{};
+    if (::waitid(WAIT_PIDFD, static_cast<id_t>(pidfd_.fd()), &info, WEXITED | WNOHANG) < 0) {
+        if (errno == EINTR) { return false; }
+        throw_errno("waitid");
+    }
+    // si_pid is 0 if the process is still running
+    if (info.si_pid == 0) { return false; }
+    reaped_ = true;
+    if (info.si_code == CLD_EXITED) {
+        status.code = info.si_status;
+    } else {
+        status.signal = info.si_status;
+    }
+    return true;
+}
+
+Task<ExitStatus> Process::wait() {
+    if (reaped_) { throw std::system_error(ECHILD, std::system_category(), "wait a reaped process"); }
+    ExitStatus status;
+    // the pidfd becomes readable when the process terminates
+    while (!try_reap(status)) { co_await pidfd_.wait(Interest::READABLE); }
+    co_return status;
+}
+
+/*
+ * SignalSet
+ */
+
+SignalSet::SignalSet(std::initializer_list<int> signos) {
+    sigemptyset(&mask_);
+    for (int signo: signos) { sigaddset(&mask_, signo); }
+    if (int err = ::pthread_sigmask(SIG_BLOCK, &mask_, &prev_mask_)) {
+        throw std::system_error(err, std::system_category(), "pthread_sigmask");
+    }
+    int fd = ::signalfd(-1, &mask_, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd < 0) {
+        int err = errno;
+        ::pthread_sigmask(SIG_SETMASK, &prev_mask_, nullptr);
+        throw std::system_error(err, std::system_category(), "signalfd");
+    }
+    signal_fd_ = AsyncFd{fd};
+}
+
+SignalSet::~SignalSet() {
+    signal_fd_.close();
+    ::pthread_sigmask(SIG_SETMASK, &prev_mask_, nullptr);
+}
+
+Task<int> SignalSet::next() {
+    signalfd_siginfo info{};
+    while (true) {
+        ssize_t n = ::read(signal_fd_.fd(), &info, sizeof(info));
+        if (n == static_cast<ssize_t>(sizeof(info))) { co_return static_cast<int>(info.ssi_signo); }
+        if (n < 0 && errno == EAGAIN) {
+            co_await signal_fd_.wait(Interest::READABLE);
+        } else if (n < 0 && errno != EINTR) {
+            throw_errno("read signalfd");
+        }
+    }
+}
+}// namespace hucoro
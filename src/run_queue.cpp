@@ -0,0 +1,107 @@
+//
+// Created by dreamHuang on 2023/3/16.
+//
+
+#include "run_queue.h"
+#include <bit>
+
+namespace hucoro {
+void QueueDelayStats::record(std::uint64_t delay_ns) noexcept {
+    count += 1;
+    total_ns += delay_ns;
+    if (delay_ns > max_ns) { max_ns = delay_ns; }
+    auto idx = static_cast<std::size_t>(std::bit_width(delay_ns));
+    buckets[idx < BUCKET_NUM ? idx : BUCKET_NUM - 1] += 1;
+}
+
+std::uint64_t QueueDelayStats::percentile_ns(double p) const noexcept {
+    if (count == 0) { return 0; }
+    auto rank = static_cast<std::uint64_t>(p * static_cast<double>(count));
+    if (rank == 0) { rank = 1; }
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < BUCKET_NUM; ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            // the upper bound of bucket i, but never larger than the max record
+            std::uint64_t upper = i == 0 ? 0 : (std::uint64_t{1} << i) - 1;
+            return upper < max_ns ? upper : max_ns;
+        }
+    }
+    return max_ns;
+}
+
+namespace detail {
+    namespace {
+        // read the clock directly (instead of the cached RuntimeClock::now()), since the
+        // cached time point may be stale by the running time of current task
+        RuntimeClock::time_point precise_now() noexcept { return RuntimeClock::underlying_clock::now(); }
+    }// namespace
+
+    RunQueue::RunQueue(PriorityOptions options) : options_(options), credits_(options.weights) {}
+
+    void RunQueue::push(SpawnTask&& task, Priority priority) {
+        queues_[index(priority)].push_back(QueuedTask{static_cast<SpawnTask&&>(task), precise_now()});
+    }
+
+    void RunQueue::push_batch(std::vector<SpawnTask>&& tasks, Priority priority) {
+        auto& queue = queues_[index(priority)];
+        auto now = precise_now();
+        // one clock read for the batch. SpawnTask is not move assignable, so the range insert
+        // of deque cannot be used
+        for (auto& task: tasks) { queue.push_back(QueuedTask{static_cast<SpawnTask&&>(task), now}); }
+        tasks.clear();
+    }
+
+    std::optional<SpawnTask> RunQueue::pop() {
+        if (empty()) { return std::nullopt; }
+        auto now = precise_now();
+
+        // starvation protection for the lower classes
+        for (std::size_t idx = PRIORITY_NUM - 1; idx > 0; --idx) {
+            auto& queue = queues_[idx];
+            if (!queue.empty() && now - queue.front().enqueue_at_ >= options_.starvation_threshold) {
+                return pop_from(idx, now);
+            }
+        }
+
+        // weighted round-robin, try again with a new round if the credits are used up
+        for (int round = 0; round < 2; ++round) {
+            for (std::size_t idx = 0; idx < PRIORITY_NUM; ++idx) {
+                if (!queues_[idx].empty() && credits_[idx] > 0) {
+                    credits_[idx] -= 1;
+                    return pop_from(idx, now);
+                }
+            }
+            credits_ = options_.weights;
+        }
+
+        // only the classes with zero weight have task
+        for (std::size_t idx = 0; idx < PRIORITY_NUM; ++idx) {
+            if (!queues_[idx].empty()) { return pop_from(idx, now); }
+        }
+        __builtin_unreachable();
+    }
+
+    bool RunQueue::empty() const noexcept {
+        for (auto& queue: queues_) {
+            if (!queue.empty()) { return false; }
+        }
+        return true;
+    }
+
+    std::size_t RunQueue::size() const noexcept {
+        std::size_t size = 0;
+        for (auto& queue: queues_) { size += queue.size(); }
+        return size;
+    }
+
+    SpawnTask RunQueue::pop_from(std::size_t idx, RuntimeClock::time_point now) {
+        auto& queue = queues_[idx];
+        QueuedTask queued = std::move(queue.front());
+        queue.pop_front();
+        auto delay = std::chrono::duration_cast<std::chrono::nanoseconds>(now - queued.enqueue_at_).count();
+        stats_[idx].record(delay > 0 ? static_cast<std::uint64_t>(delay) : 0);
+        return std::move(queued.task_);
+    }
+}// namespace detail
+}// namespace hucoro
@@ -0,0 +1,53 @@
+//
+// Created by dreamHuang on 2023/4/6.
+//
+
+#include "runtime.h"
+#include <algorithm>
+#include <pthread.h>
+#include <sched.h>
+#include <string>
+#include <system_error>
+
+namespace hucoro {
+Runtime Runtime::Builder::build() const {
+    if (worker_threads_ == 0) { throw HuCoroGeneralErr("The runtime needs at least one worker thread"); }
+    if (options_.task_budget == 0) { throw HuCoroGeneralErr("The task budget of scheduler must be positive"); }
+    if (shutdown_timeout_.count() < 0) { throw HuCoroGeneralErr("The shutdown timeout must not be negative"); }
+    for (int cpu: cpus_) {
+        if (cpu < 0 || cpu >= CPU_SETSIZE) { throw HuCoroGeneralErr("Invalid cpu in the thread affinity"); }
+    }
+    Runtime runtime;
+    runtime.options_ = options_;
+    runtime.worker_threads_ = worker_threads_;
+    runtime.shutdown_timeout_ = shutdown_timeout_;
+    runtime.thread_name_ = thread_name_;
+    runtime.cpus_ = cpus_;
+    runtime.on_thread_start_ = on_thread_start_;
+    runtime.on_thread_stop_ = on_thread_stop_;
+    return runtime;
+}
+
+void Runtime::setup_thread(std::size_t worker) const {
+    if (!thread_name_.empty()) {
+        // the name of thread is at most 15 characters (without '\0')
+        auto name = thread_name_ + "-" + std::to_string(worker);
+        name.resize(std::min<std::size_t>(name.size(), 15));
+        ::pthread_setname_np(::pthread_self(), name.c_str());
+    }
+    if (!cpus_.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpus_[worker % cpus_.size()], &set);
+        if (int err = ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set)) {
+            throw std::system_error(err, std::system_category(), "pthread_setaffinity_np");
+        }
+    }
+}
+
+void Runtime::rethrow_first(const std::vector<std::exception_ptr>& errors) {
+    for (const auto& error: errors) {
+        if (error) { std::rethrow_exception(error); }
+    }
+}
+}// namespace hucoro
@@ -3,10 +3,228 @@
 //
 
 #include "single_thread_scheduler.h"
+#include <algorithm>
+#include <climits>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
 
 namespace hucoro {
+namespace {
+    /// Keep the drivers which the leaked frames may still unregister from, they are never destroyed
+    void leak_drivers(std::vector<std::unique_ptr<IoDriver>>& drivers) {
+        static std::mutex mutex;
+        static auto* leaked = new std::vector<std::unique_ptr<IoDriver>>();
+        std::lock_guard guard(mutex);
+        for (auto& driver: drivers) { leaked->push_back(std::move(driver)); }
+    }
+}// namespace
 
-void SingleThreadScheduler::schedule(SpawnTask&& task) { tasks_.push_back(static_cast<SpawnTask&&>(task)); }
+SingleThreadScheduler::~SingleThreadScheduler() {
+    std::size_t abandoned = 0;
+    if (spawned_.unfinished() > 0) { cancel_unfinished(abandoned); }
+    // the destruction of the abandoned frames may still unregister from the retired drivers
+    auto deadline = std::chrono::steady_clock::now() + options_.abandoned_wait;
+    while (spawned_.abandoned() > 0) {
+        if (std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::yield();
+            continue;
+        }
+        // the completions may never come, the frames are detached from `spawned_` by its destructor
+        auto leaked = spawned_.abandoned();
+        try {
+            leak_drivers(retired_drivers_);
+        } catch (...) {
+            for (auto& driver: retired_drivers_) { [[maybe_unused]] auto* released = driver.release(); }
+        }
+        try {
+            if (options_.on_leak) { options_.on_leak(leaked); }
+        } catch (...) {}
+        return;
+    }
+}
+
+ShutdownReport SingleThreadScheduler::shutdown(std::chrono::milliseconds timeout) {
+    if (CURRENT_SCHEDULER == this) { throw HuCoroGeneralErr("Try shutdown the scheduler inside its block_on"); }
+    ShutdownReport report;
+    auto unfinished = spawned_.unfinished();
+    if (unfinished == 0) { return report; }
+
+    auto* prev_scheduler = std::exchange(CURRENT_SCHEDULER, this);
+    shutting_down_ = true;
+    try {
+        drain(RuntimeClock::underlying_clock::now() + timeout);
+    } catch (...) {
+        shutting_down_ = false;
+        CURRENT_SCHEDULER = prev_scheduler;
+        throw;
+    }
+    report.drained = unfinished - spawned_.unfinished();
+    report.cancelled = cancel_unfinished(report.abandoned);
+    shutting_down_ = false;
+    CURRENT_SCHEDULER = prev_scheduler;
+    if (prev_scheduler) {
+        RuntimeClock::refresh();
+    } else {
+        RuntimeClock::reset();
+    }
+    return report;
+}
+
+void SingleThreadScheduler::drain(RuntimeClock::time_point deadline) {
+    while (spawned_.unfinished() > 0) {
+        RuntimeClock::refresh();
+        auto now = RuntimeClock::now();
+        if (now >= deadline) { return; }
+
+        for (std::size_t i = 0; i < options_.task_budget; ++i) {
+            auto task = tasks_.pop();
+            if (!task) { break; }
+            task->resume();
+        }
+        run_scheduled();
+
+        bool idle = tasks_.empty() && !scheduled_head_ && !has_remote_scheduled();
+        if (io_driver_ && io_driver_->waiting() > 0) {
+            auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - now).count();
+            io_driver_->poll(idle ? static_cast<int>(std::min<decltype(left)>(left, INT_MAX)) : 0);
+        } else if (idle) {
+            // the unfinished tasks can not make progress any more (e.g. waiting for each other)
+            return;
+        }
+    }
+}
+
+std::size_t SingleThreadScheduler::cancel_unfinished(std::size_t& abandoned) {
+    auto* prev_scheduler = std::exchange(CURRENT_SCHEDULER, this);
+    auto cancelled = spawned_.cancel_unfinished(abandoned);
+    // the queued tasks are destroyed with their SpawnTask
+    while (tasks_.pop()) {}
+    // the nodes lived in the cancelled frames
+    scheduled_head_ = scheduled_tail_ = nullptr;
+    // the driver may still resume the cancelled coroutines (e.g. woken but not resumed, or the ones
+    // kept by JoinHandle), so it is never polled again. But it is kept alive, since the frames
+    // destroyed later still unregister from it.
+    if (cancelled > 0 && io_driver_) { retired_drivers_.push_back(std::move(io_driver_)); }
+    CURRENT_SCHEDULER = prev_scheduler;
+    return cancelled;
+}
+
+void SingleThreadScheduler::schedule(SpawnTask&& task, Priority priority) {
+    if (shutting_down_) { throw HuCoroGeneralErr("The scheduler is shutting down"); }
+    task.link_to(spawned_);
+    if (options_.queue_capacity > 0 && tasks_.size() >= options_.queue_capacity) {
+        if (options_.overflow == OverflowPolicy::REJECT) { throw HuCoroGeneralErr("The run queue is full"); }
+        overflowed_ += 1;
+        task.resume();
+        return;
+    }
+    tasks_.push(static_cast<SpawnTask&&>(task), priority);
+}
+
+void SingleThreadScheduler::schedule_batch(std::vector<SpawnTask>&& tasks, Priority priority) {
+    if (shutting_down_) { throw HuCoroGeneralErr("The scheduler is shutting down"); }
+    for (auto& task: tasks) { task.link_to(spawned_); }
+    if (options_.queue_capacity > 0 && tasks_.size() + tasks.size() > options_.queue_capacity) {
+        // reject the whole batch, or queue as many as possible and run the others inline
+        if (options_.overflow == OverflowPolicy::REJECT) { throw HuCoroGeneralErr("The run queue is full"); }
+        auto free = options_.queue_capacity - std::min(options_.queue_capacity, tasks_.size());
+        std::vector<SpawnTask> inline_tasks;
+        inline_tasks.reserve(tasks.size() - free);
+        while (tasks.size() > free) {
+            inline_tasks.push_back(static_cast<SpawnTask&&>(tasks.back()));
+            tasks.pop_back();
+        }
+        tasks_.push_batch(static_cast<std::vector<SpawnTask>&&>(tasks), priority);
+        overflowed_ += inline_tasks.size();
+        // in the order of spawn
+        for (auto it = inline_tasks.rbegin(); it != inline_tasks.rend(); ++it) { it->resume(); }
+        return;
+    }
+    tasks_.push_batch(static_cast<std::vector<SpawnTask>&&>(tasks), priority);
+}
+
+void SingleThreadScheduler::schedule(detail::ScheduleNode& node) noexcept {
+    if (CURRENT_SCHEDULER != this) {
+        remote_schedulers_.fetch_add(1);
+        auto* head = remote_scheduled_.load(std::memory_order_relaxed);
+        do {
+            node.next_ = head;
+        } while (!remote_scheduled_.compare_exchange_weak(head, &node));
+        // only the first one after a take has to notify, the others are taken together
+        if (head == nullptr) {
+            if (auto* driver = notified_driver_.load()) { driver->notify(); }
+        }
+        remote_schedulers_.fetch_sub(1, std::memory_order_release);
+        return;
+    }
+    node.next_ = nullptr;
+    if (scheduled_tail_) {
+        scheduled_tail_->next_ = &node;
+    } else {
+        scheduled_head_ = &node;
+    }
+    scheduled_tail_ = &node;
+}
+
+void SingleThreadScheduler::run_scheduled() noexcept {
+    if (has_remote_scheduled()) {
+        // the stack is in LIFO order, append them in the order of schedule
+        auto* remote = remote_scheduled_.exchange(nullptr, std::memory_order_acquire);
+        detail::ScheduleNode* reversed = nullptr;
+        while (remote) {
+            auto* next = remote->next_;
+            remote->next_ = reversed;
+            reversed = remote;
+            remote = next;
+        }
+        if (scheduled_tail_) {
+            scheduled_tail_->next_ = reversed;
+        } else {
+            scheduled_head_ = reversed;
+        }
+    }
+    auto* node = std::exchange(scheduled_head_, nullptr);
+    scheduled_tail_ = nullptr;
+    while (node) {
+        // the node may be destroyed by execute
+        auto* next = node->next_;
+        node->execute_(node);
+        node = next;
+    }
+}
+
+void SingleThreadScheduler::park() {
+    if (options_.spin_before_park.count() > 0) {
+        auto deadline = RuntimeClock::underlying_clock::now() + options_.spin_before_park;
+        do {
+            if (io_driver_->poll(0) > 0 || woken_remotely()) { return; }
+        } while (RuntimeClock::underlying_clock::now() < deadline);
+    }
+    if (options_.on_park) { options_.on_park(); }
+    // the remote threads publish before notifying the driver, so a notification after this
+    // check interrupts the poll
+    if (!woken_remotely()) { io_driver_->poll(-1); }
+    if (options_.on_unpark) { options_.on_unpark(); }
+}
+
+void SingleThreadScheduler::on_root_finishing_remotely() noexcept {
+    root_finishing_.store(true, std::memory_order_release);
+    // the driver lives until the root task is done, which happens after this returns
+    io_driver_->notify();
+}
+
+void SingleThreadScheduler::resume_sampled(SpawnTask& task) {
+    if (!perf_opened_) {
+        perf_counters_ = std::make_unique<PerfCounters>();
+        perf_opened_ = true;
+    }
+    auto begin = perf_counters_->read();
+    task.resume();
+    perf_stats_.total += perf_counters_->read() - begin;
+    perf_stats_.sampled += 1;
+}
 
 thread_local SingleThreadScheduler* SingleThreadScheduler::CURRENT_SCHEDULER = nullptr;
 
@@ -4,7 +4,10 @@
 
 #include "spawn_task.h"
 #include "config.h"
+#include <cstdint>
+#include <mutex>
 #include <utility>
+#include <vector>
 
 namespace hucoro {
 std::pair<JoinHandle<void>, SpawnTask> SpawnTaskPromise<void>::get_return_object() {
@@ -13,4 +16,132 @@ std::pair<JoinHandle<void>, SpawnTask> SpawnTaskPromise<void>::get_return_object
     return std::make_pair(JoinHandle<void>{handle},
                           SpawnTask{this->state_, std::coroutine_handle<>::from_address(handle.address())});
 }
+
+namespace {
+    constexpr std::size_t LIST_MUTEX_NUM = 64;
+
+    // never destroyed before the lists, see SpawnTaskList
+    std::mutex LIST_MUTEXES[LIST_MUTEX_NUM];
+}// namespace
+
+bool SpawnTaskPromiseState::release() noexcept {
+    // it is not the last reference, no need to lock
+    auto count = val_.load(std::memory_order_relaxed);
+    while (count > 1) {
+        if (val_.compare_exchange_weak(count, count - 1, std::memory_order_acq_rel)) { return false; }
+    }
+    auto* list = list_.load(std::memory_order_acquire);
+    if (!list) { return decr_ref() == 0 && destroy_on_release(); }
+    // the list may have been detached after the load, but it is still the right mutex then
+    std::lock_guard lock{list->mutex()};
+    return decr_ref() == 0 && destroy_on_release();
+}
+
+std::coroutine_handle<> SpawnTaskPromiseState::finish(std::coroutine_handle<> frame) noexcept {
+    std::unique_lock<std::mutex> lock;
+    auto* list = list_.load(std::memory_order_acquire);
+    if (list) { lock = std::unique_lock{list->mutex()}; }
+    State prev_state = state_.exchange(State::FINISH, std::memory_order_acq_rel);
+    if (list && list_.load(std::memory_order_relaxed) == list) {
+        list->unfinished_.fetch_sub(1, std::memory_order_release);
+    }
+    if (prev_state == State::WAITING_TO_RESUME) { return awaiting_coroutine_; }
+    if (val_.load(std::memory_order_acquire) == 0) {
+        // no reference to this task
+        // so it can be destroy (we do this by continue current coroutine)
+        return frame;
+    }
+    // we come here because there is at least one handle to this coroutine
+    // (e.g. JoinHandle) and no awaiting coroutine exist.
+    //
+    // so return to caller/resumer and keep the result in SpawnTaskPromise,
+    // the frame is destroyed by the one dropping the last reference
+    return std::noop_coroutine();
+}
+
+void SpawnTaskPromiseState::unlink() noexcept {
+    auto* list = list_.load(std::memory_order_acquire);
+    if (!list) { return; }
+    std::lock_guard lock{list->mutex()};
+    // detached by the destruction of list
+    if (list_.load(std::memory_order_relaxed) != list) { return; }
+    list->unlink(*this);
+}
+
+namespace detail {
+    std::mutex& SpawnTaskList::mutex() const noexcept {
+        return LIST_MUTEXES[(reinterpret_cast<std::uintptr_t>(this) / alignof(SpawnTaskList)) % LIST_MUTEX_NUM];
+    }
+
+    SpawnTaskList::~SpawnTaskList() {
+        std::lock_guard lock{mutex()};
+        for (auto* node = head_; node; node = node->next_) { node->list_.store(nullptr, std::memory_order_relaxed); }
+    }
+
+    void SpawnTaskList::link(SpawnTaskPromiseState& state) noexcept {
+        std::lock_guard lock{mutex()};
+        state.list_.store(this, std::memory_order_release);
+        state.prev_ = nullptr;
+        state.next_ = head_;
+        if (head_) { head_->prev_ = &state; }
+        head_ = &state;
+        unfinished_.fetch_add(1, std::memory_order_release);
+    }
+
+    void SpawnTaskList::unlink(SpawnTaskPromiseState& state) noexcept {
+        // destroyed without passing the final awaiter, e.g. not started or finished without reference
+        auto current = state.state();
+        if (current != State::FINISH && current != State::CANCELLED) {
+            unfinished_.fetch_sub(1, std::memory_order_release);
+        }
+        if (state.abandoned_) { abandoned_.fetch_sub(1, std::memory_order_release); }
+        if (state.prev_) {
+            state.prev_->next_ = state.next_;
+        } else {
+            head_ = state.next_;
+        }
+        if (state.next_) { state.next_->prev_ = state.prev_; }
+        state.list_.store(nullptr, std::memory_order_relaxed);
+        state.prev_ = state.next_ = nullptr;
+    }
+
+    std::size_t SpawnTaskList::cancel_unfinished(std::size_t& abandoned) {
+        std::size_t cancelled = 0;
+        // the frames nobody refers to, others are destroyed by the one dropping the last reference
+        std::vector<std::coroutine_handle<>> releasable;
+        {
+            // the last reference is only dropped with the mutex held, so a task without reference
+            // is not being destroyed by someone else (unless it is not started)
+            std::lock_guard lock{mutex()};
+            for (auto* node = head_; node; node = node->next_) {
+                auto current = node->state();
+                if (current == State::FINISH || current == State::CANCELLED) { continue; }
+                if (current == State::INIT && node->ref_count() == 0) { continue; }
+                node->state_.store(State::CANCELLED, std::memory_order_release);
+                cancelled += 1;
+                // the frame is kept by the abandoned completions, and destroyed by the last of them
+                // (which blocks on the mutex until this returns)
+                for (auto* pending = node->context_.pending(); pending; pending = pending->next_) {
+                    node->incr_ref();
+                    if (pending->abandon_(pending, *node)) {
+                        node->abandoned_ = true;
+                    } else {
+                        node->decr_ref();
+                    }
+                }
+                if (node->abandoned_) {
+                    abandoned += 1;
+                    abandoned_.fetch_add(1, std::memory_order_release);
+                    continue;
+                }
+                if (node->ref_count() == 0) { releasable.push_back(node->frame_); }
+            }
+            unfinished_.fetch_sub(cancelled, std::memory_order_release);
+        }
+        // destroying a frame may release the last reference to other cancelled tasks (e.g. by the
+        // JoinHandle in it), which destroys them too. But it never destroys a frame in `releasable`.
+        for (auto frame: releasable) { frame.destroy(); }
+        return cancelled;
+    }
+}// namespace detail
 }// namespace hucoro
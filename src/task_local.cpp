@@ -0,0 +1,21 @@
+//
+// Created by dreamHuang on 2023/3/18.
+//
+
+#include "task_local.h"
+#include <atomic>
+
+namespace hucoro {
+namespace detail {
+    thread_local TaskLocalContext* TaskLocalContext::CURRENT = nullptr;
+
+    std::size_t allocate_task_local_slot() {
+        static std::atomic<std::size_t> next_slot = 0;
+        std::size_t slot = next_slot.fetch_add(1, std::memory_order_relaxed);
+        if (slot >= HUCORO_TASK_LOCAL_SLOTS) {
+            throw HuCoroGeneralErr("Too many TaskLocal, please increase HUCORO_TASK_LOCAL_SLOTS");
+        }
+        return slot;
+    }
+}// namespace detail
+}// namespace hucoro
@@ -0,0 +1,150 @@
+//
+// Created by dreamHuang on 2023/3/30.
+//
+
+#include "task_registry.h"
+#include "spawn_task.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <memory>
+#include <mutex>
+#include <unistd.h>
+
+namespace hucoro {
+namespace {
+    constexpr std::size_t SHARD_NUM = 16;
+
+    struct Shard {
+        std::mutex mutex_;
+        detail::TaskRegistryNode* head_ = nullptr;
+        std::size_t size_ = 0;
+    };
+
+    Shard SHARDS[SHARD_NUM];
+
+    /// The threads register to different shards in round robin
+    std::size_t current_shard() noexcept {
+        static std::atomic<std::size_t> next_shard = 0;
+        thread_local std::size_t shard = next_shard.fetch_add(1, std::memory_order_relaxed) % SHARD_NUM;
+        return shard;
+    }
+
+    const char* state_name(State state) noexcept {
+        switch (state) {
+            case State::INIT:
+                return "INIT";
+            case State::IN_PROGRESS:
+                return "IN_PROGRESS";
+            case State::WAITING_TO_RESUME:
+                return "WAITING_TO_RESUME";
+            case State::FINISH:
+                return "FINISH";
+            case State::CANCELLED:
+                return "CANCELLED";
+        }
+        return "UNKNOWN";
+    }
+
+    std::string demangle(const std::type_info* type) {
+        if (!type) { return {}; }
+        int status = 0;
+        std::unique_ptr<char, void (*)(void*)> name{abi::__cxa_demangle(type->name(), nullptr, nullptr, &status),
+                                                   std::free};
+        return status == 0 && name ? std::string{name.get()} : std::string{type->name()};
+    }
+}// namespace
+
+std::atomic<bool> TaskRegistry::ENABLED = false;
+
+void TaskRegistry::add(SpawnTaskPromiseState& state, std::source_location location) {
+    static std::atomic<std::uint64_t> next_id = 1;
+    auto& node = state.registry_node_;
+    node.id_ = next_id.fetch_add(1, std::memory_order_relaxed);
+    node.location_ = location;
+    node.owner_ = &state;
+    node.on_resume();
+    // the awaitables of the task are recorded through its context
+    state.context_.set_registry_node(&node);
+
+    node.shard_ = current_shard();
+    auto& shard = SHARDS[node.shard_];
+    std::lock_guard lock{shard.mutex_};
+    node.prev_ = nullptr;
+    node.next_ = shard.head_;
+    if (shard.head_) { shard.head_->prev_ = &node; }
+    shard.head_ = &node;
+    shard.size_ += 1;
+}
+
+void TaskRegistry::remove(detail::TaskRegistryNode& node) noexcept {
+    auto& shard = SHARDS[node.shard_];
+    std::lock_guard lock{shard.mutex_};
+    if (node.prev_) {
+        node.prev_->next_ = node.next_;
+    } else {
+        shard.head_ = node.next_;
+    }
+    if (node.next_) { node.next_->prev_ = node.prev_; }
+    shard.size_ -= 1;
+    node.shard_ = SIZE_MAX;
+}
+
+std::size_t TaskRegistry::size() {
+    std::size_t size = 0;
+    for (auto& shard: SHARDS) {
+        std::lock_guard lock{shard.mutex_};
+        size += shard.size_;
+    }
+    return size;
+}
+
+std::vector<TaskSnapshot> TaskRegistry::snapshot() {
+    auto now = RuntimeClock::now().time_since_epoch().count();
+    std::vector<TaskSnapshot> snapshots;
+    for (auto& shard: SHARDS) {
+        std::lock_guard lock{shard.mutex_};
+        for (auto* node = shard.head_; node; node = node->next_) {
+            auto last_resume = node->last_resume_.load(std::memory_order_relaxed);
+            snapshots.push_back(TaskSnapshot{
+                    node->id_, node->location_, state_name(node->owner_->state()),
+                    std::chrono::nanoseconds{std::max<std::int64_t>(0, now - last_resume)},
+                    demangle(node->awaiter_.load(std::memory_order_relaxed))});
+        }
+    }
+    std::sort(snapshots.begin(), snapshots.end(), [](const TaskSnapshot& lhs, const TaskSnapshot& rhs) {
+        return lhs.since_last_resume > rhs.since_last_resume;
+    });
+    return snapshots;
+}
+
+std::string TaskRegistry::dump() {
+    std::string str;
+    char buf[128];
+    for (auto& task: snapshot()) {
+        std::snprintf(buf, sizeof(buf), "#%llu %s %.1fms", static_cast<unsigned long long>(task.id), task.state,
+                      static_cast<double>(task.since_last_resume.count()) / 1e6);
+        str += buf;
+        if (!task.awaiter.empty()) { str += " awaiter=" + task.awaiter; }
+        std::snprintf(buf, sizeof(buf), ":%u", static_cast<unsigned>(task.location.line()));
+        str += " at ";
+        str += task.location.file_name();
+        str += buf;
+        str += " (";
+        str += task.location.function_name();
+        str += ")\n";
+    }
+    return str;
+}
+
+void TaskRegistry::dump(int fd) {
+    auto str = dump();
+    std::size_t written = 0;
+    while (written < str.size()) {
+        ssize_t n = ::write(fd, str.data() + written, str.size() - written);
+        if (n <= 0) { break; }
+        written += static_cast<std::size_t>(n);
+    }
+}
+}// namespace hucoro
@@ -0,0 +1,158 @@
+//
+// Created by dreamHuang on 2023/3/24.
+//
+
+#include "tcp.h"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace hucoro {
+namespace {
+    [[noreturn]] void throw_errno(const char* what) { throw std::system_error(errno, std::system_category(), what); }
+
+    sockaddr_in make_address(const std::string& host, std::uint16_t port) {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        if (::inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+            throw std::system_error(EINVAL, std::system_category(), "invalid IPv4 address " + host);
+        }
+        return addr;
+    }
+
+    int new_socket() {
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) { throw_errno("socket"); }
+        return fd;
+    }
+}// namespace
+
+/*
+ * TcpStream
+ */
+
+void TcpStream::set_nodelay(bool nodelay) {
+    int value = nodelay ? 1 : 0;
+    if (::setsockopt(fd(), IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value)) < 0) { throw_errno("setsockopt"); }
+}
+
+Task<TcpStream> TcpStream::connect(std::string host, std::uint16_t port) {
+    auto addr = make_address(host, port);
+    TcpStream stream{new_socket()};
+    if (::connect(stream.fd(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        if (errno != EINPROGRESS) { throw_errno("connect"); }
+        co_await stream.io_.wait(Interest::WRITABLE);
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (::getsockopt(stream.fd(), SOL_SOCKET, SO_ERROR, &err, &len) < 0) { throw_errno("getsockopt"); }
+        if (err != 0) { throw std::system_error(err, std::system_category(), "connect"); }
+    }
+    co_return std::move(stream);
+}
+
+Task<std::size_t> TcpStream::read(void* buf, std::size_t size) {
+    while (true) {
+        ssize_t n = ::read(fd(), buf, size);
+        if (n >= 0) { co_return static_cast<std::size_t>(n); }
+        if (errno == EAGAIN) {
+            co_await io_.wait(Interest::READABLE);
+        } else if (errno != EINTR) {
+            throw_errno("read");
+        }
+    }
+}
+
+Task<std::size_t> TcpStream::read(IOBuf& buf) {
+    auto& pool = SingleThreadScheduler::buffer_pool();
+    while (true) {
+        ssize_t n = buf.read_from(fd(), pool);
+        if (n >= 0) { co_return static_cast<std::size_t>(n); }
+        if (errno == EAGAIN) {
+            co_await io_.wait(Interest::READABLE);
+        } else if (errno != EINTR) {
+            throw_errno("read");
+        }
+    }
+}
+
+Task<void> TcpStream::write(const void* buf, std::size_t size) {
+    auto* data = static_cast<const char*>(buf);
+    while (size > 0) {
+        ssize_t n = ::send(fd(), data, size, MSG_NOSIGNAL);
+        if (n >= 0) {
+            data += n;
+            size -= static_cast<std::size_t>(n);
+        } else if (errno == EAGAIN) {
+            co_await io_.wait(Interest::WRITABLE);
+        } else if (errno != EINTR) {
+            throw_errno("send");
+        }
+    }
+}
+
+Task<void> TcpStream::write(IOBuf& buf) {
+    constexpr std::size_t MAX_IOV = 64;
+    struct iovec iov[MAX_IOV];
+    while (!buf.empty()) {
+        // sendmsg instead of IOBuf::write_to (i.e. writev) to avoid SIGPIPE
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = buf.to_iovec(iov, MAX_IOV);
+        ssize_t n = ::sendmsg(fd(), &msg, MSG_NOSIGNAL);
+        if (n >= 0) {
+            buf.trim_front(static_cast<std::size_t>(n));
+        } else if (errno == EAGAIN) {
+            co_await io_.wait(Interest::WRITABLE);
+        } else if (errno != EINTR) {
+            throw_errno("sendmsg");
+        }
+    }
+}
+
+Task<void> TcpStream::shutdown() {
+    if (::shutdown(fd(), SHUT_WR) < 0) { throw_errno("shutdown"); }
+    char discard[512];
+    while (co_await read(discard, sizeof(discard)) > 0) {}
+}
+
+/*
+ * TcpListener
+ */
+
+TcpListener TcpListener::bind(const std::string& host, std::uint16_t port, Options options) {
+    auto addr = make_address(host, port);
+    TcpStream stream{new_socket()};
+    int on = 1;
+    if (::setsockopt(stream.fd(), SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0) { throw_errno("setsockopt"); }
+    if (options.reuse_port && ::setsockopt(stream.fd(), SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0) {
+        throw_errno("setsockopt");
+    }
+    if (::bind(stream.fd(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) { throw_errno("bind"); }
+    if (::listen(stream.fd(), options.backlog) < 0) { throw_errno("listen"); }
+    return TcpListener{std::move(stream)};
+}
+
+std::uint16_t TcpListener::local_port() const {
+    sockaddr_in addr{};
+    socklen_t len = sizeof(addr);
+    if (::getsockname(fd(), reinterpret_cast<sockaddr*>(&addr), &len) < 0) { throw_errno("getsockname"); }
+    return ntohs(addr.sin_port);
+}
+
+Task<TcpStream> TcpListener::accept() {
+    while (true) {
+        int fd = ::accept4(stream_.fd(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd >= 0) { co_return TcpStream{fd}; }
+        if (errno == EAGAIN) {
+            co_await stream_.io_.wait(Interest::READABLE);
+        } else if (errno != EINTR && errno != ECONNABORTED) {
+            throw_errno("accept4");
+        }
+    }
+}
+}// namespace hucoro
@@ -0,0 +1,183 @@
+//
+// Created by dreamHuang on 2023/4/5.
+//
+
+#include "async_bridge.h"
+#include "catch2/catch_test_macros.hpp"
+#include "single_thread_scheduler.h"
+#include "task.h"
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using hucoro::async_from_callback;
+using hucoro::Completion;
+using hucoro::SingleThreadScheduler;
+using hucoro::Task;
+
+namespace {
+/// A C style API: the callback is called with `user_data` on another thread
+void c_style_async_add(int a, int b, void (*callback)(void* user_data, int result), void* user_data) {
+    std::thread([=]() { callback(user_data, a + b); }).detach();
+}
+
+/// Complete all the submitted completions on one background thread
+class Worker {
+public:
+    ~Worker() {
+        if (thread_.joinable()) { thread_.join(); }
+    }
+
+    void submit(Completion<int> completion, int value) {
+        std::lock_guard lock{mutex_};
+        jobs_.emplace_back(completion, value);
+    }
+
+    void run() {
+        thread_ = std::thread([this]() {
+            std::lock_guard lock{mutex_};
+            for (auto& [completion, value]: jobs_) { completion(value); }
+        });
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<std::pair<Completion<int>, int>> jobs_;
+    std::thread thread_;
+};
+
+Task<int> submit_to(Worker& worker, int value) {
+    co_return co_await async_from_callback<int>([&](Completion<int> completion) { worker.submit(completion, value); });
+}
+
+Task<long long> many_remote(int n) {
+    Worker worker;
+    auto join_set = SingleThreadScheduler::spawn_n(static_cast<std::size_t>(n), [&](std::size_t i) {
+        return submit_to(worker, static_cast<int>(i));
+    });
+    // let all the tasks suspend first
+    co_await SingleThreadScheduler::spawn([]() -> Task<void> { co_return; });
+    worker.run();
+    std::vector<int> values = co_await join_set.join();
+    long long sum = 0;
+    for (int value: values) { sum += value; }
+    co_return sum;
+}
+}// namespace
+
+TEST_CASE("async_from_callback completes inline and on scheduler thread", "[AsyncBridge]") {
+    SingleThreadScheduler scheduler;
+    REQUIRE(scheduler.block_on([]() -> Task<int> {
+        co_return co_await async_from_callback<int>([](Completion<int> completion) { completion(42); });
+    }) == 42);
+
+    // completed by another task of the same scheduler
+    REQUIRE(scheduler.block_on([]() -> Task<int> {
+        std::optional<Completion<int>> pending;
+        auto handle = SingleThreadScheduler::spawn([&]() -> Task<void> {
+            pending->set_value(7);
+            co_return;
+        });
+        int value = co_await async_from_callback<int>([&](Completion<int> completion) { pending = completion; });
+        co_await handle;
+        co_return value;
+    }) == 7);
+
+    REQUIRE_THROWS_AS(scheduler.block_on([]() -> Task<void> {
+        co_await async_from_callback<void>([](Completion<void> completion) {
+            completion.set_error(std::make_exception_ptr(std::runtime_error("err")));
+        });
+    }),
+                      std::runtime_error);
+}
+
+TEST_CASE("async_from_callback completes on other threads", "[AsyncBridge]") {
+    SingleThreadScheduler scheduler;
+    auto scheduler_thread = std::this_thread::get_id();
+    auto [value, resumed_thread] = scheduler.block_on([]() -> Task<std::pair<int, std::thread::id>> {
+        int value = co_await async_from_callback<int>([](Completion<int> completion) {
+            c_style_async_add(1, 2, [](void* user_data, int result) {
+                Completion<int>::from_user_data(user_data).set_value(result);
+            }, completion.user_data());
+        });
+        co_return std::make_pair(value, std::this_thread::get_id());
+    });
+    REQUIRE(value == 3);
+    REQUIRE(resumed_thread == scheduler_thread);
+
+    REQUIRE(scheduler.block_on([]() { return many_remote(1000); }) == 999LL * 1000 / 2);
+}
+
+TEST_CASE("await future and pollables", "[AsyncBridge]") {
+    SingleThreadScheduler scheduler;
+    std::promise<int> promise;
+    auto future = promise.get_future();
+    std::thread producer([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        promise.set_value(5);
+    });
+    REQUIRE(scheduler.block_on([&]() -> Task<int> { co_return co_await hucoro::from_future(std::move(future)); }) ==
+            5);
+    producer.join();
+
+    std::promise<void> failed;
+    failed.set_exception(std::make_exception_ptr(std::runtime_error("err")));
+    REQUIRE_THROWS_AS(scheduler.block_on([&]() -> Task<void> {
+        co_await hucoro::from_future(failed.get_future().share());
+    }),
+                      std::runtime_error);
+
+    std::atomic<bool> flag = false;
+    std::thread setter([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        flag = true;
+    });
+    scheduler.block_on([&]() -> Task<void> { co_await hucoro::poll_until([&]() { return flag.load(); }); });
+    REQUIRE(flag);
+    setter.join();
+
+    int fds[2];
+    REQUIRE(::pipe2(fds, O_NONBLOCK) == 0);
+    std::thread writer([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        ::write(fds[1], "x", 1);
+    });
+    char c = 0;
+    scheduler.block_on([&]() -> Task<void> {
+        co_await hucoro::wait_fd(fds[0], hucoro::Interest::READABLE);
+        ::read(fds[0], &c, 1);
+    });
+    REQUIRE(c == 'x');
+    writer.join();
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+// the latency of a completion from another thread, i.e. from the callback to the resumption
+TEST_CASE("remote completion latency", "[.][benchmark]") {
+    constexpr int ROUNDS = 10000;
+    SingleThreadScheduler scheduler;
+    auto total_ns = scheduler.block_on([]() -> Task<double> {
+        double total = 0;
+        for (int i = 0; i < ROUNDS; ++i) {
+            std::chrono::steady_clock::time_point completed;
+            std::thread thread;
+            co_await async_from_callback<void>([&](Completion<void> completion) {
+                thread = std::thread([&completed, completion]() mutable {
+                    completed = std::chrono::steady_clock::now();
+                    completion();
+                });
+            });
+            total += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - completed).count();
+            thread.join();
+        }
+        co_return total;
+    });
+    std::printf("remote completion latency: %.1f us\n", total_ns / ROUNDS / 1000);
+}
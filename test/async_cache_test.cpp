@@ -0,0 +1,191 @@
+//
+// Created by dreamHuang on 2023/3/10.
+//
+
+#include "async_bridge.h"
+#include "async_cache.h"
+#include "catch2/catch_test_macros.hpp"
+#include "runtime.h"
+#include "single_thread_scheduler.h"
+#include "task.h"
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using hucoro::AsyncCache;
+using hucoro::Runtime;
+using hucoro::ShardedAsyncCache;
+using hucoro::SingleThreadScheduler;
+using hucoro::Task;
+
+namespace {
+struct FakeClock {
+    using duration = std::chrono::milliseconds;
+    using rep = duration::rep;
+    using period = duration::period;
+    using time_point = std::chrono::time_point<FakeClock, duration>;
+    static constexpr bool is_steady = true;
+
+    static time_point now() noexcept { return NOW; }
+    static inline time_point NOW{};
+};
+
+// suspend the loader once, so that the other requests will find the entry in-flight
+Task<int> slow_load(int& load_num, int val) {
+    ++load_num;
+    co_await SingleThreadScheduler::spawn([]() -> Task<void> { co_return; });
+    co_return val;
+}
+}// namespace
+
+TEST_CASE("AsyncCache single flight", "[AsyncCache]") {
+    SingleThreadScheduler scheduler;
+    AsyncCache<int, int> cache;
+    int load_num = 0;
+
+    auto sum = scheduler.block_on([&]() -> Task<int> {
+        std::vector<hucoro::JoinHandle<int>> handles;
+        for (int i = 0; i < 5; ++i) {
+            handles.push_back(SingleThreadScheduler::spawn([&]() -> Task<int> {
+                co_return co_await cache.get_or_load(1, [&]() { return slow_load(load_num, 10); });
+            }));
+        }
+        int sum = 0;
+        for (auto& handle: handles) { sum += co_await handle; }
+        // now it is ready
+        sum += co_await cache.get_or_load(1, [&]() { return slow_load(load_num, 20); });
+        co_return sum;
+    });
+
+    REQUIRE(sum == 60);
+    REQUIRE(load_num == 1);
+    auto stats = cache.stats();
+    REQUIRE(stats.misses == 1);
+    REQUIRE(stats.coalesced == 4);
+    REQUIRE(stats.hits == 1);
+    REQUIRE(cache.size() == 1);
+}
+
+TEST_CASE("AsyncCache TTL", "[AsyncCache]") {
+    using namespace std::chrono_literals;
+    SingleThreadScheduler scheduler;
+    AsyncCache<int, int, FakeClock> cache({.ttl = 100ms});
+    int load_num = 0;
+    auto get = [&](int val) {
+        return scheduler.block_on([&]() -> Task<int> {
+            co_return co_await cache.get_or_load(1, [&]() { return slow_load(load_num, val); });
+        });
+    };
+
+    REQUIRE(get(1) == 1);
+    FakeClock::NOW += 99ms;
+    REQUIRE(get(2) == 1);
+    FakeClock::NOW += 1ms;
+    REQUIRE(get(3) == 3);
+    REQUIRE(load_num == 2);
+    REQUIRE(cache.stats().expirations == 1);
+}
+
+TEST_CASE("AsyncCache LRU byte budget", "[AsyncCache]") {
+    SingleThreadScheduler scheduler;
+    AsyncCache<int, std::string> cache({.byte_budget = 10,
+                                        .sizer = [](const int&, const std::string& val) { return val.size(); }});
+    auto get = [&](int key, std::string val) {
+        return scheduler.block_on([&]() -> Task<std::string> {
+            co_return co_await cache.get_or_load(key, [&]() -> Task<std::string> { co_return val; });
+        });
+    };
+
+    get(1, "aaaa");
+    get(2, "bbbb");
+    // touch key 1, so that key 2 is the least recently used
+    REQUIRE(get(1, "xxxx") == "aaaa");
+    get(3, "cccc");
+    REQUIRE(cache.size() == 2);
+    REQUIRE(cache.bytes() == 8);
+    REQUIRE(cache.stats().evictions == 1);
+    REQUIRE(get(1, "xxxx") == "aaaa");
+    REQUIRE(get(2, "dddd") == "dddd");
+}
+
+TEST_CASE("AsyncCache loader failure", "[AsyncCache]") {
+    SingleThreadScheduler scheduler;
+    AsyncCache<int, int> cache;
+    int failed = 0;
+    auto val = scheduler.block_on([&]() -> Task<int> {
+        try {
+            co_await cache.get_or_load(1, []() -> Task<int> {
+                throw std::runtime_error("load failed");
+                co_return 0;
+            });
+        } catch (const std::runtime_error&) { ++failed; }
+        co_return co_await cache.get_or_load(1, []() -> Task<int> { co_return 2; });
+    });
+    REQUIRE(failed == 1);
+    REQUIRE(val == 2);
+    REQUIRE(cache.stats().misses == 2);
+}
+
+TEST_CASE("ShardedAsyncCache", "[AsyncCache]") {
+    SingleThreadScheduler scheduler;
+    ShardedAsyncCache<int, int> cache(4);
+    auto sum = scheduler.block_on([&]() -> Task<int> {
+        int sum = 0;
+        for (int round = 0; round < 2; ++round) {
+            for (int i = 0; i < 16; ++i) {
+                sum += co_await cache.get_or_load(i, [i]() -> Task<int> { co_return i; });
+            }
+        }
+        co_return sum;
+    });
+    REQUIRE(sum == 240);
+    REQUIRE(cache.size() == 16);
+    REQUIRE(cache.stats().misses == 16);
+    REQUIRE(cache.stats().hits == 16);
+}
+
+namespace {
+// the load finishes only after all the other callers are coalesced into it
+template<typename Cache>
+Task<int> gated_load(Cache& cache, std::atomic<int>& load_num, std::size_t coalesced) {
+    load_num.fetch_add(1);
+    co_await hucoro::poll_until([&cache, coalesced]() { return cache.stats().coalesced == coalesced; });
+    co_return 10;
+}
+
+template<typename Cache>
+Task<bool> load_on_own_worker(Cache& cache, std::atomic<int>& load_num, std::size_t coalesced) {
+    auto* scheduler = SingleThreadScheduler::CURRENT_SCHEDULER;
+    auto thread = std::this_thread::get_id();
+    int val = co_await cache.get_or_load(1, [&]() { return gated_load(cache, load_num, coalesced); });
+    co_return val == 10 && scheduler == SingleThreadScheduler::CURRENT_SCHEDULER &&
+            thread == std::this_thread::get_id();
+}
+
+template<typename Cache>
+void check_cold_key_on_workers(Cache& cache) {
+    constexpr std::size_t N = 4;
+    std::atomic<int> load_num = 0;
+    auto runtime = Runtime::builder().worker_threads(N).build();
+    auto resumed = runtime.run([&](std::size_t) { return load_on_own_worker(cache, load_num, N - 1); });
+    REQUIRE(resumed == std::vector<bool>(N, true));
+    REQUIRE(load_num == 1);
+    auto stats = cache.stats();
+    REQUIRE(stats.misses == 1);
+    REQUIRE(stats.coalesced == N - 1);
+    REQUIRE(stats.hits == 0);
+}
+}// namespace
+
+TEST_CASE("AsyncCache single flight on workers", "[AsyncCache]") {
+    AsyncCache<int, int> cache;
+    check_cold_key_on_workers(cache);
+}
+
+TEST_CASE("ShardedAsyncCache single flight on workers", "[AsyncCache]") {
+    ShardedAsyncCache<int, int> cache(4);
+    check_cold_key_on_workers(cache);
+}
@@ -0,0 +1,219 @@
+//
+// Created by dreamHuang on 2023/3/22.
+//
+
+#include "async_file.h"
+#include "buffer_pool.h"
+#include "catch2/benchmark/catch_benchmark.hpp"
+#include "catch2/catch_test_macros.hpp"
+#include "io_driver.h"
+#include "single_thread_scheduler.h"
+#include "task.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <random>
+#include <string>
+#include <system_error>
+#include <unistd.h>
+#include <vector>
+
+using hucoro::AsyncFile;
+using hucoro::IoBatch;
+using hucoro::SingleThreadScheduler;
+using hucoro::Task;
+
+namespace {
+std::string temp_path() {
+    char path[] = "/tmp/hucoro_async_file_XXXXXX";
+    int fd = ::mkstemp(path);
+    ::close(fd);
+    return path;
+}
+
+Task<std::string> write_then_read(std::string path) {
+    auto file = AsyncFile::open(path, O_RDWR | O_TRUNC);
+    std::string data = "hello async file";
+    auto written = co_await file.write_at(data.data(), data.size(), 0);
+    co_await file.fsync();
+    co_await file.fdatasync();
+    std::string read(written, '\0');
+    auto n = co_await file.read_at(read.data(), read.size(), 0);
+    read.resize(n);
+    co_return read;
+}
+
+Task<std::size_t> batch_read(std::string path, std::size_t block, std::size_t num) {
+    auto file = AsyncFile::open(path, O_RDONLY);
+    std::vector<char> buf(block * num);
+    IoBatch batch(num);
+    for (std::size_t i = 0; i < num; ++i) { batch.read_at(file, buf.data() + i * block, block, i * block); }
+    co_await batch.all();
+    std::size_t total = 0;
+    for (std::size_t i = 0; i < num; ++i) {
+        if (!batch.done(i) || batch.result(i) < 0) { co_return std::size_t{0}; }
+        total += static_cast<std::size_t>(batch.result(i));
+    }
+    for (std::size_t i = 0; i < buf.size(); ++i) {
+        if (buf[i] != static_cast<char>(i / block)) { co_return std::size_t{0}; }
+    }
+    co_return total;
+}
+
+Task<std::size_t> batch_any(std::string path) {
+    auto file = AsyncFile::open(path, O_RDONLY);
+    std::vector<char> buf(4096 * 4);
+    IoBatch batch;
+    for (std::size_t i = 0; i < 4; ++i) { batch.read_at(file, buf.data() + i * 4096, 4096, i * 4096); }
+    auto first = co_await batch.any();
+    co_return batch.done(first) ? first : SIZE_MAX;
+}
+
+Task<std::int64_t> read_direct(std::string path, std::size_t size) {
+    auto file = AsyncFile::open(path, O_RDONLY | O_DIRECT);
+    file.advise(0, 0, POSIX_FADV_SEQUENTIAL);
+    // the buffers of BufferPool are page aligned
+    auto buffer = SingleThreadScheduler::buffer_pool().allocate();
+    std::int64_t total = 0;
+    for (std::size_t offset = 0; offset < size; offset += buffer.capacity()) {
+        total += static_cast<std::int64_t>(co_await file.read_at(buffer.data(), buffer.capacity(), offset));
+    }
+    co_return total;
+}
+
+Task<std::string> read_pipe(int fd) {
+    hucoro::IoRegistration registration(SingleThreadScheduler::io_driver(), fd);
+    char buf[64];
+    ssize_t n;
+    while ((n = ::read(fd, buf, sizeof(buf))) < 0 && errno == EAGAIN) {
+        registration.clear_ready(hucoro::Interest::READABLE);
+        co_await registration.ready(hucoro::Interest::READABLE);
+    }
+    co_return std::string(buf, n > 0 ? static_cast<std::size_t>(n) : 0);
+}
+
+Task<void> write_pipe(int fd) {
+    ::write(fd, "ping", 4);
+    co_return;
+}
+
+Task<std::string> pipe_round_trip(int read_fd, int write_fd) {
+    auto reader = SingleThreadScheduler::spawn([read_fd]() { return read_pipe(read_fd); });
+    SingleThreadScheduler::spawn([write_fd]() { return write_pipe(write_fd); });
+    co_return co_await reader;
+}
+
+void fill_file(const std::string& path, std::size_t block, std::size_t num) {
+    int fd = ::open(path.c_str(), O_WRONLY | O_TRUNC);
+    std::vector<char> buf(block);
+    for (std::size_t i = 0; i < num; ++i) {
+        std::memset(buf.data(), static_cast<int>(i), block);
+        ::write(fd, buf.data(), block);
+    }
+    ::close(fd);
+}
+}// namespace
+
+TEST_CASE("AsyncFile read and write", "[AsyncFile]") {
+    auto path = temp_path();
+    SingleThreadScheduler scheduler;
+    REQUIRE(scheduler.block_on([&path]() { return write_then_read(path); }) == "hello async file");
+    ::unlink(path.c_str());
+}
+
+TEST_CASE("AsyncFile open failure", "[AsyncFile]") {
+    REQUIRE_THROWS_AS(AsyncFile::open("/nonexistent/hucoro", O_RDONLY), std::system_error);
+}
+
+TEST_CASE("IoBatch submit all and any", "[AsyncFile]") {
+    auto path = temp_path();
+    fill_file(path, 4096, 16);
+    SingleThreadScheduler scheduler;
+    REQUIRE(scheduler.block_on([&path]() { return batch_read(path, 4096, 16); }) == 4096 * 16);
+    REQUIRE(scheduler.block_on([&path]() { return batch_any(path); }) < 4);
+    ::unlink(path.c_str());
+}
+
+TEST_CASE("AsyncFile O_DIRECT", "[AsyncFile]") {
+    auto path = temp_path();
+    fill_file(path, 4096, 32);
+    SingleThreadScheduler scheduler;
+    try {
+        REQUIRE(scheduler.block_on([&path]() { return read_direct(path, 4096 * 32); }) == 4096 * 32);
+    } catch (const std::system_error& err) {
+        // some file systems (e.g. tmpfs) do not support O_DIRECT
+        REQUIRE(err.code().value() == EINVAL);
+    }
+    ::unlink(path.c_str());
+}
+
+TEST_CASE("IoRegistration readiness", "[AsyncFile]") {
+    int fds[2];
+    REQUIRE(::pipe2(fds, O_NONBLOCK) == 0);
+    SingleThreadScheduler scheduler;
+    auto read_fd = fds[0], write_fd = fds[1];
+    REQUIRE(scheduler.block_on([=]() { return pipe_round_trip(read_fd, write_fd); }) == "ping");
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+namespace {
+Task<std::size_t> async_read_all(std::string path, std::size_t block, std::size_t num, bool random, bool batch) {
+    auto file = AsyncFile::open(path, O_RDONLY);
+    file.advise(0, 0, random ? POSIX_FADV_RANDOM : POSIX_FADV_SEQUENTIAL);
+    std::vector<std::int64_t> offsets(num);
+    for (std::size_t i = 0; i < num; ++i) { offsets[i] = static_cast<std::int64_t>(i * block); }
+    if (random) { std::shuffle(offsets.begin(), offsets.end(), std::mt19937{42}); }
+
+    constexpr std::size_t DEPTH = 32;
+    std::vector<char> buf(block * DEPTH);
+    std::size_t total = 0;
+    if (!batch) {
+        for (auto offset: offsets) { total += co_await file.read_at(buf.data(), block, offset); }
+        co_return total;
+    }
+    for (std::size_t i = 0; i < num; i += DEPTH) {
+        IoBatch io_batch(DEPTH);
+        for (std::size_t j = i; j < std::min(num, i + DEPTH); ++j) {
+            io_batch.read_at(file, buf.data() + (j - i) * block, block, offsets[j]);
+        }
+        co_await io_batch.all();
+        for (std::size_t j = 0; j < io_batch.size(); ++j) { total += static_cast<std::size_t>(io_batch.result(j)); }
+    }
+    co_return total;
+}
+
+std::size_t pread_all(const std::string& path, std::size_t block, std::size_t num, bool random) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    std::vector<std::int64_t> offsets(num);
+    for (std::size_t i = 0; i < num; ++i) { offsets[i] = static_cast<std::int64_t>(i * block); }
+    if (random) { std::shuffle(offsets.begin(), offsets.end(), std::mt19937{42}); }
+    std::vector<char> buf(block);
+    std::size_t total = 0;
+    for (auto offset: offsets) { total += static_cast<std::size_t>(::pread(fd, buf.data(), block, offset)); }
+    ::close(fd);
+    return total;
+}
+}// namespace
+
+TEST_CASE("AsyncFile benchmark", "[.][benchmark]") {
+    constexpr std::size_t BLOCK = 4096, NUM = 16384;
+    auto path = temp_path();
+    fill_file(path, BLOCK, NUM);
+    SingleThreadScheduler scheduler;
+
+    for (bool random: {false, true}) {
+        std::string pattern = random ? "random" : "sequential";
+        BENCHMARK("pread " + pattern + " 64MiB") { return pread_all(path, BLOCK, NUM, random); };
+        BENCHMARK("AsyncFile " + pattern + " 64MiB") {
+            return scheduler.block_on([&]() { return async_read_all(path, BLOCK, NUM, random, false); });
+        };
+        BENCHMARK("AsyncFile batched " + pattern + " 64MiB") {
+            return scheduler.block_on([&]() { return async_read_all(path, BLOCK, NUM, random, true); });
+        };
+    }
+    ::unlink(path.c_str());
+}
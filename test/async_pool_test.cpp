@@ -0,0 +1,244 @@
+//
+// Created by dreamHuang on 2023/4/8.
+//
+
+#include "async_pool.h"
+#include "catch2/catch_test_macros.hpp"
+#include "counter.h"
+#include "runtime.h"
+#include "single_thread_scheduler.h"
+#include "task.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+using hucoro::AsyncPool;
+using hucoro::SingleThreadScheduler;
+using hucoro::Task;
+using hucoro::test::Counter;
+using namespace std::chrono_literals;
+
+namespace {
+struct FakeClock {
+    using duration = std::chrono::milliseconds;
+    using rep = duration::rep;
+    using period = duration::period;
+    using time_point = std::chrono::time_point<FakeClock, duration>;
+    static constexpr bool is_steady = true;
+    static time_point now() noexcept { return NOW; }
+    inline static time_point NOW{};
+};
+
+/// A fake backend connection
+struct Connection {
+    int id = 0;
+    bool broken = false;
+    Counter counter;
+};
+
+using Pool = AsyncPool<Connection>;
+
+Pool::Options connection_options(std::size_t max_size, std::atomic<int>& created) {
+    Pool::Options options;
+    options.max_size = max_size;
+    options.factory = [&created]() -> Task<Connection> { co_return Connection{.id = ++created}; };
+    return options;
+}
+
+Task<void> yield() { co_await SingleThreadScheduler::spawn([]() -> Task<void> { co_return; }); }
+
+Task<void> use(Pool& pool, std::vector<int>& order, int i) {
+    auto lease = co_await pool.acquire();
+    order.push_back(i);
+}
+}// namespace
+
+TEST_CASE("lease and reuse", "[AsyncPool]") {
+    auto alive = Counter::alive_num();
+    std::atomic<int> created = 0;
+    {
+        Pool pool(connection_options(2, created));
+        SingleThreadScheduler scheduler;
+        scheduler.block_on([&]() -> Task<void> {
+            {
+                auto lease = co_await pool.acquire();
+                REQUIRE(lease->id == 1);
+                REQUIRE(pool.stats().leased == 1);
+                REQUIRE(pool.stats().utilization() == 0.5);
+            }
+            auto first = co_await pool.acquire();
+            auto second = co_await pool.acquire();
+            REQUIRE(first->id == 1);
+            REQUIRE(second->id == 2);
+            // moved lease is returned once
+            auto moved = std::move(first);
+            REQUIRE_FALSE(first);
+            moved.release();
+            REQUIRE(pool.stats().idle == 1);
+        });
+        auto stats = pool.stats();
+        REQUIRE(stats.size == 2);
+        REQUIRE(stats.idle == 2);
+        REQUIRE(stats.leased == 0);
+        REQUIRE(stats.acquired == 3);
+        REQUIRE(stats.created == 2);
+        REQUIRE(stats.waited == 2);
+    }
+    REQUIRE(Counter::alive_num() == alive);
+}
+
+TEST_CASE("waiters are served in FIFO order", "[AsyncPool]") {
+    std::atomic<int> created = 0;
+    Pool pool(connection_options(1, created));
+    SingleThreadScheduler scheduler;
+    auto order = scheduler.block_on([&]() -> Task<std::vector<int>> {
+        std::vector<int> order;
+        auto lease = co_await pool.acquire();
+        auto join_set = SingleThreadScheduler::spawn_n(4, [&](std::size_t i) {
+            return use(pool, order, static_cast<int>(i));
+        });
+        // all of them are waiting
+        co_await yield();
+        REQUIRE(pool.stats().waiting == 4);
+        // a newcomer does not overtake the waiters
+        auto late = SingleThreadScheduler::spawn([&]() { return use(pool, order, 4); });
+        lease.release();
+        co_await join_set.join();
+        co_await late;
+        co_return order;
+    });
+    REQUIRE(order == std::vector<int>{0, 1, 2, 3, 4});
+    auto stats = pool.stats();
+    REQUIRE(created == 1);
+    REQUIRE(stats.waited == 6);
+    REQUIRE(stats.waiting == 0);
+    REQUIRE(stats.max_wait >= stats.mean_wait());
+}
+
+TEST_CASE("idle eviction keeps min size", "[AsyncPool]") {
+    auto alive = Counter::alive_num();
+    {
+        AsyncPool<Connection, FakeClock> pool({.min_size = 1,
+                                               .max_size = 3,
+                                               .factory = []() -> Task<Connection> { co_return Connection{}; },
+                                               .idle_timeout = 100ms});
+        SingleThreadScheduler scheduler;
+        scheduler.block_on([&]() -> Task<void> {
+            co_await pool.warm_up();
+            REQUIRE(pool.stats().idle == 1);
+            auto a = co_await pool.acquire();
+            auto b = co_await pool.acquire();
+            auto c = co_await pool.acquire();
+        });
+        REQUIRE(pool.stats().idle == 3);
+
+        FakeClock::NOW += 99ms;
+        REQUIRE(pool.evict_idle() == 0);
+        FakeClock::NOW += 1ms;
+        REQUIRE(pool.evict_idle() == 2);
+        REQUIRE(pool.stats().size == 1);
+        REQUIRE(pool.stats().evicted == 2);
+        REQUIRE(Counter::alive_num() == alive + 1);
+    }
+    REQUIRE(Counter::alive_num() == alive);
+}
+
+TEST_CASE("health checks and failed factory", "[AsyncPool]") {
+    auto alive = Counter::alive_num();
+    {
+        std::atomic<int> created = 0;
+        auto options = connection_options(2, created);
+        options.check_on_acquire = [](Connection& connection) { return !connection.broken; };
+        options.check_on_release = [](Connection& connection) {
+            if (connection.id == 2) { throw std::runtime_error("err"); }
+            return true;
+        };
+        Pool pool(options);
+        SingleThreadScheduler scheduler;
+        scheduler.block_on([&]() -> Task<void> {
+            {
+                auto lease = co_await pool.acquire();
+                lease->broken = true;
+            }
+            // the broken one is dropped
+            auto lease = co_await pool.acquire();
+            REQUIRE(lease->id == 2);
+            // it throws in check_on_release
+            lease.release();
+            lease = co_await pool.acquire();
+            REQUIRE(lease->id == 3);
+            lease.discard();
+        });
+        auto stats = pool.stats();
+        REQUIRE(stats.discarded == 3);
+        REQUIRE(stats.size == 0);
+        REQUIRE(Counter::alive_num() == alive);
+
+        Pool failing({.min_size = 1, .max_size = 1, .factory = []() -> Task<Connection> {
+                          throw std::runtime_error("connect failed");
+                          co_return Connection{};
+                      }});
+        REQUIRE_THROWS_AS(scheduler.block_on([&]() -> Task<void> { auto lease = co_await failing.acquire(); }),
+                          std::runtime_error);
+        REQUIRE_THROWS_AS(scheduler.block_on([&]() { return failing.warm_up(); }), std::runtime_error);
+        REQUIRE(failing.stats().create_failures == 2);
+        REQUIRE(failing.stats().size == 0);
+
+        REQUIRE_THROWS_AS(Pool({.max_size = 0, .factory = failing.options().factory}), hucoro::HuCoroGeneralErr);
+        REQUIRE_THROWS_AS(Pool({.max_size = 1}), hucoro::HuCoroGeneralErr);
+    }
+    REQUIRE(Counter::alive_num() == alive);
+}
+
+TEST_CASE("shared between scheduler threads", "[AsyncPool]") {
+    constexpr std::size_t WORKERS = 3;
+    constexpr std::size_t TASKS = 50;
+    std::atomic<int> created = 0;
+    Pool pool(connection_options(2, created));
+    std::atomic<int> in_use = 0;
+    std::atomic<int> max_in_use = 0;
+    auto runtime = hucoro::Runtime::builder().worker_threads(WORKERS).build();
+    runtime.run([&](std::size_t) -> Task<void> {
+        auto join_set = SingleThreadScheduler::spawn_n(TASKS, [&](std::size_t) -> Task<void> {
+            auto lease = co_await pool.acquire();
+            int now = ++in_use;
+            int max = max_in_use.load();
+            while (now > max && !max_in_use.compare_exchange_weak(max, now)) {}
+            co_await yield();
+            --in_use;
+        });
+        co_await join_set.join();
+    });
+    auto stats = pool.stats();
+    REQUIRE(stats.acquired == WORKERS * TASKS);
+    REQUIRE(stats.size <= 2);
+    REQUIRE(stats.leased == 0);
+    REQUIRE(max_in_use <= 2);
+}
+
+// compare acquiring from the pool with allocating a buffer per request
+TEST_CASE("pool acquire benchmark", "[.][benchmark]") {
+    constexpr int ROUNDS = 1000000;
+    using Buffer = std::vector<char>;
+    AsyncPool<Buffer> pool({.max_size = 1, .factory = []() -> Task<Buffer> { co_return Buffer(64 * 1024); }});
+    SingleThreadScheduler scheduler;
+    auto begin = std::chrono::steady_clock::now();
+    scheduler.block_on([&]() -> Task<void> {
+        for (int i = 0; i < ROUNDS; ++i) {
+            auto lease = co_await pool.acquire();
+            (*lease)[i % lease->size()] = 1;
+        }
+    });
+    auto pool_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+
+    begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < ROUNDS; ++i) {
+        auto buffer = std::make_unique<Buffer>(64 * 1024);
+        (*buffer)[i % buffer->size()] = 1;
+    }
+    auto alloc_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+    std::printf("pool: %.1f ns/op, allocation: %.1f ns/op\n", pool_ns / ROUNDS, alloc_ns / ROUNDS);
+}
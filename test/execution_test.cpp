@@ -0,0 +1,174 @@
+//
+// Created by dreamHuang on 2023/4/2.
+//
+
+#include "catch2/catch_test_macros.hpp"
+#include "execution.h"
+#include "single_thread_scheduler.h"
+#include "task.h"
+#include <chrono>
+#include <cstdio>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+using hucoro::SingleThreadScheduler;
+using hucoro::Task;
+namespace ex = hucoro::execution;
+
+namespace {
+Task<int> add_one(int i) { co_return i + 1; }
+
+Task<int> throw_err() {
+    throw std::runtime_error("err");
+    co_return 0;
+}
+
+Task<std::vector<int>> schedule_order(ex::Scheduler scheduler) {
+    std::vector<int> order;
+    auto handle = SingleThreadScheduler::spawn([&]() -> Task<void> {
+        order.push_back(1);
+        co_return;
+    });
+    order.push_back(0);
+    // the spawned task runs before the scheduled sender completes
+    co_await scheduler.schedule();
+    order.push_back(2);
+    co_await handle;
+    co_return order;
+}
+
+Task<int> await_senders() {
+    int value = co_await ex::just(1);
+    value += co_await (ex::just(2) | ex::then([](int i) { return i * 10; }));
+    co_return value;
+}
+
+/// Record the thread completing the sender, and resume the suspended root task
+struct ResumeReceiver {
+    void set_value() noexcept {
+        *thread_id_ = std::this_thread::get_id();
+        root_.resume();
+    }
+    void set_error(std::exception_ptr) noexcept {}
+    void set_stopped() noexcept {}
+
+    std::coroutine_handle<> root_;
+    std::thread::id* thread_id_;
+};
+
+/// Suspend the awaiting coroutine, and start `schedule()` with ResumeReceiver on another thread
+struct RemoteScheduleAwaiter {
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) {
+        thread_ = std::thread([this, handle]() {
+            // let the scheduler park first
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            // the operation state is not movable, so it is constructed in place
+            op_.emplace(scheduler_, ResumeReceiver{handle, &thread_id_});
+            op_->start();
+        });
+    }
+    std::thread::id await_resume() noexcept {
+        thread_.join();
+        return thread_id_;
+    }
+
+    SingleThreadScheduler* scheduler_;
+    std::thread thread_;
+    std::optional<ex::Scheduler::ScheduleSender::Operation<ResumeReceiver>> op_;
+    std::thread::id thread_id_;
+};
+}// namespace
+
+TEST_CASE("sender traits", "[Execution]") {
+    REQUIRE(ex::is_sender_v<ex::JustSender<int>>);
+    REQUIRE_FALSE(ex::is_sender_v<Task<int>>);
+    REQUIRE(std::is_same_v<ex::sender_value_t<Task<int>>, int>);
+    REQUIRE(std::is_same_v<ex::sender_value_t<hucoro::JoinHandle<std::string>>, std::string>);
+    REQUIRE(std::is_same_v<ex::sender_value_t<ex::JustSender<void>>, void>);
+    // senders are awaitable
+    REQUIRE(hucoro::is_awaitable_v<ex::JustSender<int>>);
+    REQUIRE(std::is_same_v<hucoro::awaitable_traits<ex::JustSender<int>>::await_return_type, int>);
+}
+
+TEST_CASE("schedule sender", "[Execution]") {
+    SingleThreadScheduler scheduler;
+    auto sched = scheduler.get_scheduler();
+    REQUIRE(sched == scheduler.get_scheduler());
+    auto order = scheduler.block_on([=]() { return schedule_order(sched); });
+    REQUIRE(order == std::vector<int>{0, 1, 2});
+
+    auto value = ex::sync_wait(scheduler, sched.schedule() | ex::then([]() { return 42; }));
+    REQUIRE(value == 42);
+}
+
+TEST_CASE("schedule sender started on another thread", "[Execution]") {
+    SingleThreadScheduler scheduler;
+    auto* target = &scheduler;
+    auto [completed_on, scheduler_thread] = scheduler.block_on([=]() -> Task<std::pair<std::thread::id, std::thread::id>> {
+        auto completed_on = co_await RemoteScheduleAwaiter{target, {}, {}, {}};
+        co_return std::pair{completed_on, std::this_thread::get_id()};
+    });
+    // the operation completes on the scheduler thread instead of the starting one
+    REQUIRE(completed_on == scheduler_thread);
+    REQUIRE(completed_on == std::this_thread::get_id());
+}
+
+TEST_CASE("task as sender", "[Execution]") {
+    SingleThreadScheduler scheduler;
+    REQUIRE(ex::sync_wait(scheduler, add_one(1) | ex::then([](int i) { return std::to_string(i); })) == "2");
+    REQUIRE(ex::sync_wait(scheduler, await_senders()) == 21);
+
+    auto [a, b, c] = ex::sync_wait(scheduler, ex::when_all(add_one(1), ex::just(std::string{"x"}), ex::just()));
+    REQUIRE(a == 2);
+    REQUIRE(b == "x");
+    REQUIRE(c == std::monostate{});
+
+    REQUIRE_THROWS_AS(ex::sync_wait(scheduler, throw_err() | ex::then([](int i) { return i; })), std::runtime_error);
+    REQUIRE_THROWS_AS(ex::sync_wait(scheduler, ex::when_all(add_one(1), throw_err())), std::runtime_error);
+    REQUIRE_THROWS_AS(ex::sync_wait(scheduler, ex::just(1) | ex::then([](int) -> int {
+                                                   throw std::runtime_error("err");
+                                               })),
+                      std::runtime_error);
+}
+
+TEST_CASE("join handle and bulk pipeline", "[Execution]") {
+    SingleThreadScheduler scheduler;
+    auto sum = scheduler.block_on([]() -> Task<int> {
+        auto handle = SingleThreadScheduler::spawn([]() { return add_one(9); });
+        std::vector<int> squares(4);
+        auto pipeline = ex::when_all(std::move(handle), ex::just(3)) | ex::then([](std::tuple<int, int> values) {
+                            return std::get<0>(values) + std::get<1>(values);
+                        }) |
+                        ex::bulk(squares.size(), [&](std::size_t i, int value) {
+                            squares[i] = value * static_cast<int>(i);
+                        });
+        int value = co_await std::move(pipeline);
+        co_return value + squares[3];
+    });
+    REQUIRE(sum == 13 + 39);
+}
+
+// compare the cost of `co_await schedule()` with spawning and joining a task
+TEST_CASE("schedule sender benchmark", "[.][benchmark]") {
+    constexpr int ROUNDS = 1000000;
+    SingleThreadScheduler scheduler;
+    auto sched = scheduler.get_scheduler();
+    auto begin = std::chrono::steady_clock::now();
+    scheduler.block_on([=]() -> Task<void> {
+        for (int i = 0; i < ROUNDS; ++i) { co_await sched.schedule(); }
+    });
+    auto schedule_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+
+    begin = std::chrono::steady_clock::now();
+    scheduler.block_on([]() -> Task<void> {
+        for (int i = 0; i < ROUNDS; ++i) { co_await SingleThreadScheduler::spawn([i]() { return add_one(i); }); }
+    });
+    auto spawn_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+    std::printf("schedule: %.1f ns/op, spawn: %.1f ns/op\n", schedule_ns / ROUNDS, spawn_ns / ROUNDS);
+}
@@ -0,0 +1,175 @@
+//
+// Created by dreamHuang on 2023/3/20.
+//
+
+#include "buffer_pool.h"
+#include "catch2/benchmark/catch_benchmark.hpp"
+#include "catch2/catch_test_macros.hpp"
+#include "iobuf.h"
+#include "single_thread_scheduler.h"
+#include "task.h"
+#include <arpa/inet.h>
+#include <cstdint>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using hucoro::BufferPool;
+using hucoro::BufferRef;
+using hucoro::IOBuf;
+
+TEST_CASE("BufferPool page aligned", "[IOBuf]") {
+    BufferPool pool(100, 4);
+    REQUIRE(pool.buffer_size() == BufferPool::page_size());
+    {
+        std::vector<BufferRef> buffers;
+        for (int i = 0; i < 5; ++i) { buffers.push_back(pool.allocate()); }
+        for (auto& buffer: buffers) {
+            REQUIRE(reinterpret_cast<std::uintptr_t>(buffer.data()) % BufferPool::page_size() == 0);
+        }
+        REQUIRE(pool.total_buffers() == 8);
+        REQUIRE(pool.free_buffers() == 3);
+        REQUIRE(pool.regions().size() == 2);
+        REQUIRE(&pool.buffer(buffers[4].get()->index()) == buffers[4].get());
+    }
+    REQUIRE(pool.free_buffers() == 8);
+}
+
+TEST_CASE("BufferPool release on another thread", "[IOBuf]") {
+    BufferPool pool(4096, 2);
+    auto buffer = pool.allocate();
+    auto* raw = buffer.get();
+    std::thread([buffer = std::move(buffer)]() mutable { buffer.reset(); }).join();
+    REQUIRE(pool.free_buffers() == 2);
+    // the remote freed buffer is reused by the owner
+    auto b1 = pool.allocate();
+    auto b2 = pool.allocate();
+    REQUIRE((b1.get() == raw || b2.get() == raw));
+    REQUIRE(pool.total_buffers() == 2);
+}
+
+TEST_CASE("IOBuf append and split without copy", "[IOBuf]") {
+    BufferPool pool(4096, 4);
+    std::string data(10000, 'a');
+    for (std::size_t i = 0; i < data.size(); ++i) { data[i] = static_cast<char>('a' + i % 26); }
+
+    IOBuf buf;
+    buf.append(data.data(), data.size(), pool);
+    REQUIRE(buf.length() == 10000);
+    REQUIRE(buf.segment_num() == 3);
+    REQUIRE(buf.to_string() == data);
+
+    auto front = buf.split(5000);
+    REQUIRE(front.length() == 5000);
+    REQUIRE(buf.length() == 5000);
+    REQUIRE(front.to_string() == data.substr(0, 5000));
+    REQUIRE(buf.to_string() == data.substr(5000));
+    // the second buffer is shared by the two IOBufs
+    REQUIRE(pool.total_buffers() - pool.free_buffers() == 3);
+
+    auto clone = buf.clone();
+    front.append(std::move(buf));
+    REQUIRE(buf.empty());
+    REQUIRE(front.to_string() == data);
+    REQUIRE(clone.to_string() == data.substr(5000));
+
+    front.trim_front(9999);
+    REQUIRE(front.to_string() == data.substr(9999));
+}
+
+TEST_CASE("IOBuf does not write shared buffer", "[IOBuf]") {
+    BufferPool pool(4096, 4);
+    IOBuf buf;
+    buf.append("hello", 5, pool);
+    auto clone = buf.clone();
+    buf.append(" world", 6, pool);
+    REQUIRE(buf.segment_num() == 2);
+    REQUIRE(buf.to_string() == "hello world");
+    REQUIRE(clone.to_string() == "hello");
+}
+
+TEST_CASE("IOBuf readv / writev", "[IOBuf]") {
+    BufferPool pool(4096, 4);
+    int fds[2];
+    REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    IOBuf out;
+    std::string data(6000, 'x');
+    out.append(data.data(), data.size(), pool);
+    while (!out.empty()) { REQUIRE(out.write_to(fds[0]) > 0); }
+
+    IOBuf in;
+    while (in.length() < data.size()) { REQUIRE(in.read_from(fds[1], pool) > 0); }
+    REQUIRE(in.to_string() == data);
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+TEST_CASE("scheduler buffer pool", "[IOBuf]") {
+    REQUIRE_THROWS(hucoro::SingleThreadScheduler::buffer_pool());
+    hucoro::SingleThreadScheduler scheduler;
+    auto size = scheduler.block_on([]() -> hucoro::Task<std::size_t> {
+        auto& pool = hucoro::SingleThreadScheduler::buffer_pool();
+        IOBuf buf;
+        buf.append("abc", 3, pool);
+        co_return buf.length();
+    });
+    REQUIRE(size == 3);
+}
+
+namespace {
+// return the connected (client, server) sockets on loopback
+std::pair<int, int> loopback_pair() {
+    int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    ::bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    ::listen(listener, 1);
+    socklen_t len = sizeof(addr);
+    ::getsockname(listener, reinterpret_cast<sockaddr*>(&addr), &len);
+    int client = ::socket(AF_INET, SOCK_STREAM, 0);
+    ::connect(client, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    int server = ::accept(listener, nullptr, nullptr);
+    ::close(listener);
+    return {client, server};
+}
+}// namespace
+
+TEST_CASE("IOBuf proxy benchmark", "[.][benchmark]") {
+    constexpr std::size_t TOTAL = 64 * 1024 * 1024;
+    auto [source, proxy_in] = loopback_pair();
+    auto [proxy_out, sink] = loopback_pair();
+    std::vector<char> chunk(64 * 1024, 'x');
+
+    BENCHMARK_ADVANCED("proxy 64MiB over loopback")(Catch::Benchmark::Chronometer meter) {
+        meter.measure([&]() {
+            std::thread producer([&]() {
+                for (std::size_t sent = 0; sent < TOTAL;) { sent += ::write(source, chunk.data(), chunk.size()); }
+            });
+            std::thread consumer([&]() {
+                std::vector<char> sink_buf(64 * 1024);
+                for (std::size_t received = 0; received < TOTAL;) {
+                    received += ::read(sink, sink_buf.data(), sink_buf.size());
+                }
+            });
+            // the proxy forwards the bytes in the pooled buffers without copy
+            BufferPool pool;
+            IOBuf buf;
+            for (std::size_t forwarded = 0; forwarded < TOTAL;) {
+                buf.read_from(proxy_in, pool);
+                auto n = buf.write_to(proxy_out);
+                if (n > 0) { forwarded += n; }
+            }
+            producer.join();
+            consumer.join();
+            // bytes/sec = TOTAL / the measured time
+            return TOTAL;
+        });
+    };
+    for (int fd: {source, proxy_in, proxy_out, sink}) { ::close(fd); }
+}
@@ -0,0 +1,127 @@
+//
+// Created by dreamHuang on 2023/3/14.
+//
+
+#include "catch2/benchmark/catch_benchmark.hpp"
+#include "catch2/catch_test_macros.hpp"
+#include "parallel.h"
+#include "single_thread_scheduler.h"
+#include "task.h"
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+using hucoro::SingleThreadScheduler;
+using hucoro::Task;
+
+TEST_CASE("parallel_for", "[Parallel]") {
+    SingleThreadScheduler scheduler;
+    std::vector<int> data(1000);
+    std::iota(data.begin(), data.end(), 0);
+    scheduler.block_on([&]() -> Task<void> { co_await hucoro::parallel_for(data, 16, [](int& v) { v *= 2; }); });
+    for (int i = 0; i < 1000; ++i) { REQUIRE(data[i] == i * 2); }
+}
+
+TEST_CASE("parallel_transform_reduce", "[Parallel]") {
+    SingleThreadScheduler scheduler;
+    std::vector<int> data(1000);
+    std::iota(data.begin(), data.end(), 1);
+    auto sum = scheduler.block_on([&]() -> Task<std::int64_t> {
+        co_return co_await hucoro::parallel_transform_reduce(
+                data, std::int64_t{10}, std::plus<>{}, [](int v) { return std::int64_t{v} * v; });
+    });
+    REQUIRE(sum == 10 + 1000LL * 1001 * 2001 / 6);
+}
+
+TEST_CASE("parallel_sort", "[Parallel]") {
+    SingleThreadScheduler scheduler;
+    std::vector<int> data(10000);
+    std::mt19937 rng(42);
+    for (auto& v: data) { v = static_cast<int>(rng() % 1000); }
+    auto expected = data;
+    std::sort(expected.begin(), expected.end(), std::greater<>{});
+    scheduler.block_on([&]() -> Task<void> { co_await hucoro::parallel_sort(data, std::greater<>{}, 64); });
+    REQUIRE(data == expected);
+}
+
+// split and spawn as if there were 4 workers, the spawned halves run on the same thread
+TEST_CASE("parallel split path", "[Parallel]") {
+    SingleThreadScheduler scheduler;
+    hucoro::detail::ConcurrencyOverride concurrency(4);
+    std::vector<int> data(1000);
+    std::iota(data.begin(), data.end(), 0);
+
+    scheduler.block_on([&]() -> Task<void> { co_await hucoro::parallel_for(data, 16, [](int& v) { v *= 2; }); });
+    for (int i = 0; i < 1000; ++i) { REQUIRE(data[i] == i * 2); }
+
+    auto sum = scheduler.block_on([&]() -> Task<std::int64_t> {
+        co_return co_await hucoro::parallel_transform_reduce(data, std::int64_t{0}, std::plus<>{},
+                                                             [](int v) { return std::int64_t{v}; });
+    });
+    REQUIRE(sum == 999LL * 1000);
+
+    std::mt19937 rng(42);
+    for (auto& v: data) { v = static_cast<int>(rng() % 100); }
+    auto expected = data;
+    std::sort(expected.begin(), expected.end());
+    scheduler.block_on([&]() -> Task<void> { co_await hucoro::parallel_sort(data, std::less<>{}, 16); });
+    REQUIRE(data == expected);
+    REQUIRE(scheduler.unfinished_tasks() == 0);
+}
+
+TEST_CASE("parallel split path throws", "[Parallel]") {
+    SingleThreadScheduler scheduler;
+    hucoro::detail::ConcurrencyOverride concurrency(4);
+    std::vector<int> data(1000);
+    std::iota(data.begin(), data.end(), 0);
+    int visited = 0;
+
+    // the last element is in the inline half of every split, the spawned halves are still joined
+    REQUIRE_THROWS_AS(scheduler.block_on([&]() -> Task<void> {
+        co_await hucoro::parallel_for(data, 16, [&](int v) {
+            if (v == 999) { throw std::runtime_error("parallel_for"); }
+            ++visited;
+        });
+    }),
+                      std::runtime_error);
+    REQUIRE(visited == 999);
+    REQUIRE(scheduler.unfinished_tasks() == 0);
+
+    REQUIRE_THROWS_AS(scheduler.block_on([&]() -> Task<int> {
+        co_return co_await hucoro::parallel_transform_reduce(data, 0, std::plus<>{}, [](int v) {
+            if (v == 0) { throw std::runtime_error("parallel_transform_reduce"); }
+            return v;
+        });
+    }),
+                      std::runtime_error);
+    REQUIRE(scheduler.unfinished_tasks() == 0);
+}
+
+TEST_CASE("parallel benchmark", "[.][benchmark]") {
+    constexpr std::size_t N = 100'000'000;
+    SingleThreadScheduler scheduler;
+    std::vector<std::uint32_t> data(N);
+    std::mt19937 rng(42);
+    for (auto& v: data) { v = rng(); }
+
+    BENCHMARK("parallel_for 100M") {
+        scheduler.block_on([&]() -> Task<void> {
+            co_await hucoro::parallel_for(data, 0, [](std::uint32_t& v) { v = v * 2654435761u + 1; });
+        });
+    };
+
+    BENCHMARK("parallel_transform_reduce 100M") {
+        return scheduler.block_on([&]() -> Task<std::uint64_t> {
+            co_return co_await hucoro::parallel_transform_reduce(data, std::uint64_t{0}, std::plus<>{},
+                                                                 [](std::uint32_t v) { return std::uint64_t{v}; });
+        });
+    };
+
+    BENCHMARK_ADVANCED("parallel_sort 100M")(Catch::Benchmark::Chronometer meter) {
+        auto copy = data;
+        meter.measure([&]() { scheduler.block_on([&]() -> Task<void> { co_await hucoro::parallel_sort(copy); }); });
+    };
+}
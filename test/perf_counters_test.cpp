@@ -0,0 +1,94 @@
+//
+// Created by dreamHuang on 2023/3/28.
+//
+
+#include "catch2/catch_test_macros.hpp"
+#include "perf_counters.h"
+#include "single_thread_scheduler.h"
+#include "task.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using hucoro::PerfCounters;
+using hucoro::PerfEvent;
+using hucoro::SingleThreadScheduler;
+using hucoro::Task;
+
+namespace {
+Task<int> add_one(int i) { co_return i + 1; }
+
+Task<long long> spawn_loop(int n) {
+    std::vector<hucoro::JoinHandle<int>> handles;
+    handles.reserve(static_cast<std::size_t>(n));
+    for (int i = 0; i < n; ++i) { handles.push_back(SingleThreadScheduler::spawn([i]() { return add_one(i); })); }
+    long long sum = 0;
+    for (auto& handle: handles) { sum += co_await handle; }
+    co_return sum;
+}
+
+Task<long long> spawn_batch(int n) {
+    auto join_set = SingleThreadScheduler::spawn_n(static_cast<std::size_t>(n),
+                                                   [](std::size_t i) { return add_one(static_cast<int>(i)); });
+    std::vector<int> values = co_await join_set.join();
+    long long sum = 0;
+    for (int value: values) { sum += value; }
+    co_return sum;
+}
+}// namespace
+
+TEST_CASE("perf counters degrade gracefully", "[Perf]") {
+    // never throws, even if perf_event_open is not permitted
+    PerfCounters counters;
+    auto begin = counters.read();
+    volatile int sink = 0;
+    for (int i = 0; i < 100000; ++i) { sink = sink ^ i; }
+    auto delta = counters.read() - begin;
+    auto str = counters.format(delta);
+    for (std::size_t i = 0; i < hucoro::PERF_EVENT_NUM; ++i) {
+        auto event = static_cast<PerfEvent>(i);
+        REQUIRE(str.find(hucoro::perf_event_name(event)) != std::string::npos);
+        if (!counters.available(event)) { REQUIRE(delta[event] == 0); }
+    }
+    if (counters.available(PerfEvent::INSTRUCTIONS)) { REQUIRE(delta[PerfEvent::INSTRUCTIONS] > 100000); }
+}
+
+TEST_CASE("scheduler perf sampling", "[Perf]") {
+    SingleThreadScheduler scheduler;
+    REQUIRE(scheduler.perf_counters() == nullptr);
+    scheduler.enable_perf_sampling(2);
+    REQUIRE(scheduler.block_on([]() { return spawn_loop(100); }) == 5050);
+    REQUIRE(scheduler.perf_counters() != nullptr);
+    // every second resumed task is measured
+    REQUIRE(scheduler.task_perf_stats().sampled == 50);
+
+    scheduler.enable_perf_sampling(0);
+    REQUIRE(scheduler.block_on([]() { return spawn_loop(100); }) == 5050);
+    REQUIRE(scheduler.task_perf_stats().sampled == 50);
+}
+
+TEST_CASE("perf sampling enabled inside block_on", "[Perf]") {
+    SingleThreadScheduler scheduler;
+    auto sum = scheduler.block_on([&]() -> Task<long long> {
+        scheduler.enable_perf_sampling(1);
+        co_return co_await spawn_loop(10);
+    });
+    REQUIRE(sum == 55);
+    REQUIRE(scheduler.perf_counters() != nullptr);
+    REQUIRE(scheduler.task_perf_stats().sampled == 10);
+}
+
+// Report the events per resumed task, e.g. to compare the frame allocation of spawn and spawn_n
+TEST_CASE("perf counters per task", "[.][benchmark]") {
+    constexpr int TASKS = 100000;
+    auto report = [](const char* name, auto func) {
+        SingleThreadScheduler scheduler;
+        scheduler.enable_perf_sampling(1);
+        scheduler.block_on(func);
+        auto& stats = scheduler.task_perf_stats();
+        std::printf("%-10s per task: %s\n", name,
+                    scheduler.perf_counters()->format(stats.total, static_cast<double>(stats.sampled)).c_str());
+    };
+    report("spawn", []() { return spawn_loop(TASKS); });
+    report("spawn_n", []() { return spawn_batch(TASKS); });
+}
@@ -0,0 +1,92 @@
+//
+// Created by dreamHuang on 2023/3/16.
+//
+
+#include "catch2/catch_test_macros.hpp"
+#include "run_queue.h"
+#include "single_thread_scheduler.h"
+#include "task.h"
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using hucoro::Priority;
+using hucoro::PriorityOptions;
+using hucoro::QueueDelayStats;
+using hucoro::SingleThreadScheduler;
+using hucoro::SpawnOptions;
+using hucoro::Task;
+
+namespace {
+Task<void> record(std::vector<Priority>& order, Priority priority) {
+    order.push_back(priority);
+    co_return;
+}
+
+Task<void> spawn_mixed(std::vector<Priority>& order, int num_per_class) {
+    std::vector<hucoro::JoinHandle<void>> handles;
+    for (auto priority: {Priority::BACKGROUND, Priority::NORMAL, Priority::CRITICAL}) {
+        for (int i = 0; i < num_per_class; ++i) {
+            handles.push_back(SingleThreadScheduler::spawn([&order, priority]() { return record(order, priority); },
+                                                           SpawnOptions{.priority = priority}));
+        }
+    }
+    for (auto& handle: handles) { co_await handle; }
+}
+}// namespace
+
+TEST_CASE("weighted round robin between classes", "[Priority]") {
+    SingleThreadScheduler scheduler(
+            PriorityOptions{.weights = {4, 2, 1}, .starvation_threshold = std::chrono::hours(1)});
+    std::vector<Priority> order;
+    scheduler.block_on([&]() { return spawn_mixed(order, 8); });
+
+    REQUIRE(order.size() == 24);
+    // the first round: 4 critical, 2 normal, 1 background
+    std::vector<Priority> first_round = {Priority::CRITICAL, Priority::CRITICAL, Priority::CRITICAL,
+                                         Priority::CRITICAL, Priority::NORMAL,   Priority::NORMAL,
+                                         Priority::BACKGROUND};
+    REQUIRE(std::vector<Priority>(order.begin(), order.begin() + 7) == first_round);
+    REQUIRE(scheduler.queue_delay_stats(Priority::CRITICAL).count == 8);
+    REQUIRE(scheduler.queue_delay_stats(Priority::NORMAL).count == 8);
+    REQUIRE(scheduler.queue_delay_stats(Priority::BACKGROUND).count == 8);
+}
+
+TEST_CASE("starvation protection", "[Priority]") {
+    // background has no weight, so it can only be popped by starvation protection
+    SingleThreadScheduler scheduler(
+            PriorityOptions{.weights = {1, 1, 0}, .starvation_threshold = std::chrono::milliseconds(1)});
+    std::vector<Priority> order;
+    scheduler.block_on([&]() -> Task<void> {
+        auto background = SingleThreadScheduler::spawn([&order]() { return record(order, Priority::BACKGROUND); },
+                                                       SpawnOptions{.priority = Priority::BACKGROUND});
+        // keep the critical queue busy longer than the starvation threshold
+        std::vector<hucoro::JoinHandle<void>> handles;
+        for (int i = 0; i < 100; ++i) {
+            handles.push_back(SingleThreadScheduler::spawn(
+                    [&order]() -> Task<void> {
+                        order.push_back(Priority::CRITICAL);
+                        std::this_thread::sleep_for(std::chrono::microseconds(100));
+                        co_return;
+                    },
+                    SpawnOptions{.priority = Priority::CRITICAL}));
+        }
+        co_await background;
+        for (auto& handle: handles) { co_await handle; }
+    });
+    REQUIRE(order.size() == 101);
+    REQUIRE(order.back() != Priority::BACKGROUND);
+}
+
+TEST_CASE("queue delay percentile", "[Priority]") {
+    QueueDelayStats stats;
+    REQUIRE(stats.percentile_ns(0.99) == 0);
+    for (int i = 0; i < 99; ++i) { stats.record(100); }
+    stats.record(1'000'000);
+    REQUIRE(stats.count == 100);
+    REQUIRE(stats.max_ns == 1'000'000);
+    // 100 is in bucket [64, 128)
+    REQUIRE(stats.percentile_ns(0.5) == 127);
+    REQUIRE(stats.percentile_ns(0.99) == 127);
+    REQUIRE(stats.percentile_ns(1.0) == 1'000'000);
+}
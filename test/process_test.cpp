@@ -0,0 +1,94 @@
+//
+// Created by dreamHuang on 2023/3/26.
+//
+
+#include "catch2/catch_test_macros.hpp"
+#include "process.h"
+#include "single_thread_scheduler.h"
+#include "task.h"
+#include <csignal>
+#include <string>
+#include <system_error>
+
+using hucoro::ExitStatus;
+using hucoro::Process;
+using hucoro::SingleThreadScheduler;
+using hucoro::Task;
+
+namespace {
+Task<std::string> run_echo() {
+    auto proc = Process::spawn({"sh", "-c", "echo hello; echo oops >&2; exit 3"},
+                               {.pipe_stdout = true, .pipe_stderr = true});
+    auto out = co_await proc.stdout_pipe().read_to_end();
+    auto err = co_await proc.stderr_pipe().read_to_end();
+    auto status = co_await proc.wait();
+    co_return out + err + std::to_string(status.code);
+}
+
+Task<std::string> run_cat(std::string input) {
+    auto proc = Process::spawn({"cat"}, {.pipe_stdin = true, .pipe_stdout = true});
+    // the writer and reader run concurrently, so that a large input does not dead lock
+    auto writer = SingleThreadScheduler::spawn([&proc, &input]() -> Task<void> {
+        co_await proc.stdin_pipe().write(input.data(), input.size());
+        proc.stdin_pipe().close();
+    });
+    auto output = co_await proc.stdout_pipe().read_to_end();
+    co_await writer;
+    auto status = co_await proc.wait();
+    co_return status.success() ? output : std::string{};
+}
+
+Task<ExitStatus> run_kill() {
+    auto proc = Process::spawn({"sleep", "10"});
+    proc.kill(SIGKILL);
+    co_return co_await proc.wait();
+}
+
+Task<ExitStatus> run_terminate() {
+    // SIGTERM is blocked in this thread, but not in the child
+    auto signal_set = hucoro::signals({SIGTERM});
+    auto proc = Process::spawn({"sleep", "10"});
+    proc.kill(SIGTERM);
+    co_return co_await proc.wait();
+}
+
+Task<int> wait_signal() {
+    auto signal_set = hucoro::signals({SIGUSR1, SIGHUP});
+    // blocked, so it is pending for the signalfd instead of terminating the process
+    std::raise(SIGHUP);
+    co_return co_await signal_set.next();
+}
+}// namespace
+
+TEST_CASE("process stdout, stderr and exit code", "[Process]") {
+    SingleThreadScheduler scheduler;
+    REQUIRE(scheduler.block_on(run_echo) == "hello\noops\n3");
+}
+
+TEST_CASE("process stdin", "[Process]") {
+    SingleThreadScheduler scheduler;
+    std::string input(1 << 20, 'x');
+    REQUIRE(scheduler.block_on([&input]() { return run_cat(input); }) == input);
+}
+
+TEST_CASE("process kill", "[Process]") {
+    SingleThreadScheduler scheduler;
+    auto status = scheduler.block_on(run_kill);
+    REQUIRE(status.signal == SIGKILL);
+    REQUIRE_FALSE(status.success());
+}
+
+TEST_CASE("process terminated while a SignalSet is alive", "[Process]") {
+    SingleThreadScheduler scheduler;
+    auto status = scheduler.block_on(run_terminate);
+    REQUIRE(status.signal == SIGTERM);
+}
+
+TEST_CASE("process spawn failure", "[Process]") {
+    REQUIRE_THROWS_AS(Process::spawn({"/nonexistent/hucoro"}), std::system_error);
+}
+
+TEST_CASE("signalfd", "[Process]") {
+    SingleThreadScheduler scheduler;
+    REQUIRE(scheduler.block_on(wait_signal) == SIGHUP);
+}
@@ -0,0 +1,192 @@
+//
+// Created by dreamHuang on 2023/4/6.
+//
+
+#include "async_bridge.h"
+#include "catch2/catch_test_macros.hpp"
+#include "exception.h"
+#include "runtime.h"
+#include "single_thread_scheduler.h"
+#include "task.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <pthread.h>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using hucoro::OverflowPolicy;
+using hucoro::Runtime;
+using hucoro::SchedulerOptions;
+using hucoro::SingleThreadScheduler;
+using hucoro::Task;
+
+namespace {
+Task<void> record(std::vector<int>& order, int i) {
+    order.push_back(i);
+    co_return;
+}
+
+Task<std::vector<int>> spawn_many(int n) {
+    std::vector<int> order;
+    std::vector<hucoro::JoinHandle<void>> handles;
+    for (int i = 0; i < n; ++i) {
+        handles.push_back(SingleThreadScheduler::spawn([&order, i]() { return record(order, i); }));
+    }
+    for (auto& handle: handles) { co_await handle; }
+    co_return order;
+}
+
+Task<std::string> current_thread_name() {
+    char name[16] = {};
+    ::pthread_getname_np(::pthread_self(), name, sizeof(name));
+    co_return std::string{name};
+}
+}// namespace
+
+TEST_CASE("build runtime", "[Runtime]") {
+    REQUIRE_THROWS_AS(Runtime::builder().worker_threads(0).build(), hucoro::HuCoroGeneralErr);
+    REQUIRE_THROWS_AS(Runtime::builder().task_budget(0).build(), hucoro::HuCoroGeneralErr);
+    REQUIRE_THROWS_AS(Runtime::builder().thread_affinity({-1}).build(), hucoro::HuCoroGeneralErr);
+
+    auto runtime = Runtime::builder().worker_threads(2).task_budget(3).build();
+    REQUIRE(runtime.worker_threads() == 2);
+    REQUIRE(runtime.scheduler_options().task_budget == 3);
+    REQUIRE(runtime.block_on([]() { return spawn_many(10); }).size() == 10);
+}
+
+TEST_CASE("run queue capacity", "[Runtime]") {
+    SingleThreadScheduler rejecting{SchedulerOptions{.queue_capacity = 4}};
+    REQUIRE_THROWS_AS(rejecting.block_on([]() { return spawn_many(5); }), hucoro::HuCoroGeneralErr);
+
+    // the overflowed tasks run inline, so they finish before the queued ones
+    SingleThreadScheduler inlining{SchedulerOptions{.queue_capacity = 4, .overflow = OverflowPolicy::RUN_INLINE}};
+    auto order = inlining.block_on([]() { return spawn_many(6); });
+    REQUIRE(order == std::vector<int>{4, 5, 0, 1, 2, 3});
+    REQUIRE(inlining.overflowed() == 2);
+
+    auto sum = inlining.block_on([]() -> Task<int> {
+        auto join_set = SingleThreadScheduler::spawn_n(6, [](std::size_t i) -> Task<int> {
+            co_return static_cast<int>(i);
+        });
+        std::vector<int> values = co_await join_set.join();
+        int sum = 0;
+        for (int value: values) { sum += value; }
+        co_return sum;
+    });
+    REQUIRE(sum == 15);
+    REQUIRE(inlining.overflowed() == 4);
+}
+
+TEST_CASE("worker threads and hooks", "[Runtime]") {
+    std::mutex mutex;
+    std::set<std::size_t> started;
+    std::set<std::size_t> stopped;
+    auto runtime = Runtime::builder()
+                           .worker_threads(3)
+                           .thread_name("runtime-test")
+                           .thread_affinity({0})
+                           .on_thread_start([&](std::size_t i) {
+                               std::lock_guard lock{mutex};
+                               started.insert(i);
+                           })
+                           .on_thread_stop([&](std::size_t i) {
+                               std::lock_guard lock{mutex};
+                               stopped.insert(i);
+                           })
+                           .build();
+    auto names = runtime.run([](std::size_t) { return current_thread_name(); });
+    REQUIRE(names == std::vector<std::string>{"runtime-test-0", "runtime-test-1", "runtime-test-2"});
+    REQUIRE(started == std::set<std::size_t>{0, 1, 2});
+    REQUIRE(stopped == started);
+
+    std::atomic<int> count = 0;
+    runtime.run([&](std::size_t) -> Task<void> {
+        count += 1;
+        co_return;
+    });
+    REQUIRE(count == 3);
+
+    REQUIRE_THROWS_AS(runtime.run([](std::size_t i) -> Task<int> {
+        if (i == 1) { throw std::runtime_error("err"); }
+        co_return 0;
+    }),
+                      std::runtime_error);
+}
+
+TEST_CASE("park and unpark", "[Runtime]") {
+    int parked = 0;
+    int unparked = 0;
+    auto runtime = Runtime::builder()
+                           .spin_before_park(std::chrono::microseconds(100))
+                           .on_park([&]() { parked += 1; })
+                           .on_unpark([&]() { unparked += 1; })
+                           .build();
+    auto value = runtime.block_on([]() -> Task<int> {
+        co_return co_await hucoro::async_from_callback<int>([](hucoro::Completion<int> completion) {
+            std::thread([completion]() mutable {
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                completion(1);
+            }).detach();
+        });
+    });
+    REQUIRE(value == 1);
+    REQUIRE(parked >= 1);
+    REQUIRE(unparked == parked);
+}
+
+namespace {
+/// Resume the awaiting coroutine directly on another thread after a while
+struct ResumeOnThread {
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) {
+        thread_ = std::thread([handle]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            handle.resume();
+        });
+    }
+    void await_resume() const noexcept {}
+
+    std::thread& thread_;
+};
+}// namespace
+
+TEST_CASE("idle loop parks without I/O", "[Runtime]") {
+    int parked = 0;
+    auto runtime = Runtime::builder().on_park([&]() { parked += 1; }).build();
+    std::thread resumer;
+    // nothing waits on the driver, the root task finishes on the other thread
+    auto value = runtime.block_on([&resumer]() -> Task<int> {
+        co_await ResumeOnThread{resumer};
+        co_return 1;
+    });
+    resumer.join();
+    REQUIRE(value == 1);
+    REQUIRE(parked >= 1);
+}
+
+TEST_CASE("throwing thread stop hook", "[Runtime]") {
+    auto runtime = Runtime::builder()
+                           .worker_threads(2)
+                           .on_thread_stop([](std::size_t) { throw std::runtime_error("stop"); })
+                           .build();
+    REQUIRE_THROWS_AS(runtime.run([](std::size_t) -> Task<void> { co_return; }), std::runtime_error);
+}
+
+TEST_CASE("nested block_on", "[Runtime]") {
+    SingleThreadScheduler outer;
+    auto value = outer.block_on([]() -> Task<int> {
+        auto* scheduler = SingleThreadScheduler::CURRENT_SCHEDULER;
+        SingleThreadScheduler inner;
+        auto inner_value = inner.block_on([]() { return spawn_many(3); }).size();
+        // the outer scheduler is restored
+        auto handle = SingleThreadScheduler::spawn([]() -> Task<int> { co_return 2; });
+        int outer_value = co_await handle;
+        REQUIRE(scheduler == SingleThreadScheduler::CURRENT_SCHEDULER);
+        co_return static_cast<int>(inner_value) * 10 + outer_value;
+    });
+    REQUIRE(value == 32);
+}
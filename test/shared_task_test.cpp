@@ -0,0 +1,169 @@
+//
+// Created by dreamHuang on 2023/3/8.
+//
+
+#include "async_bridge.h"
+#include "catch2/catch_test_macros.hpp"
+#include "counter.h"
+#include "runtime.h"
+#include "shared_task.h"
+#include "single_thread_scheduler.h"
+#include "task.h"
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using hucoro::Runtime;
+using hucoro::SharedTask;
+using hucoro::SingleThreadScheduler;
+using hucoro::Task;
+using hucoro::test::Counter;
+
+// NOTE: do not use lambda with captures as a coroutine which outlives the lambda itself
+SharedTask<int> count_and_return(int& executed, int val) {
+    ++executed;
+    co_return val;
+}
+
+TEST_CASE("SharedTask without running", "[SharedTask]") {
+    int executed = 0;
+    {
+        auto task = count_and_return(executed, 1);
+        auto copy = task;
+        REQUIRE(copy.valid());
+        REQUIRE(!copy.is_ready());
+    }
+    REQUIRE(executed == 0);
+}
+
+TEST_CASE("SharedTask execute once", "[SharedTask]") {
+    SingleThreadScheduler scheduler;
+    int executed = 0;
+    auto shared = count_and_return(executed, 42);
+
+    auto sum = scheduler.block_on([&]() -> Task<int> {
+        auto h1 = SingleThreadScheduler::spawn([shared]() -> Task<int> { co_return co_await shared; });
+        auto h2 = SingleThreadScheduler::spawn([shared]() -> Task<int> { co_return co_await shared; });
+        const int& v = co_await shared;
+        co_return v + co_await h1 + co_await h2;
+    });
+    REQUIRE(sum == 126);
+    REQUIRE(executed == 1);
+    REQUIRE(shared.is_ready());
+}
+
+TEST_CASE("SharedTask suspended awaiters", "[SharedTask]") {
+    SingleThreadScheduler scheduler;
+    int executed = 0;
+    auto sum = scheduler.block_on([&]() -> Task<int> {
+        auto shared = [](int& executed) -> SharedTask<int> {
+            ++executed;
+            // suspend the shared task, so that the later awaiters will be linked
+            co_await SingleThreadScheduler::spawn([]() -> Task<void> { co_return; });
+            co_return 7;
+        }(executed);
+        std::vector<hucoro::JoinHandle<int>> handles;
+        for (int i = 0; i < 4; ++i) {
+            handles.push_back(SingleThreadScheduler::spawn([shared]() -> Task<int> { co_return co_await shared; }));
+        }
+        int sum = 0;
+        for (auto& handle: handles) { sum += co_await handle; }
+        co_return sum;
+    });
+    REQUIRE(sum == 28);
+    REQUIRE(executed == 1);
+}
+
+TEST_CASE("SharedTask result lifetime", "[SharedTask]") {
+    SingleThreadScheduler scheduler;
+    {
+        auto shared = []() -> SharedTask<Counter> { co_return Counter{}; }();
+        scheduler.block_on([&]() -> Task<void> {
+            const Counter& c1 = co_await shared;
+            const Counter& c2 = co_await shared;
+            REQUIRE(&c1 == &c2);
+        });
+        // the result is kept in the promise
+        REQUIRE(Counter::alive_num() == 1);
+    }
+    REQUIRE(Counter::alive_num() == 0);
+}
+
+TEST_CASE("SharedTask exception", "[SharedTask]") {
+    SingleThreadScheduler scheduler;
+    auto shared = []() -> SharedTask<void> {
+        throw std::runtime_error("shared task error");
+        co_return;
+    }();
+    int caught = 0;
+    scheduler.block_on([&]() -> Task<void> {
+        for (int i = 0; i < 2; ++i) {
+            try {
+                co_await shared;
+            } catch (const std::runtime_error&) { ++caught; }
+        }
+    });
+    REQUIRE(caught == 2);
+}
+
+TEST_CASE("make_shared_task", "[SharedTask]") {
+    SingleThreadScheduler scheduler;
+    auto shared = hucoro::make_shared_task([]() -> Task<int> { co_return 5; }());
+    auto copy = shared;
+    auto val = scheduler.block_on([&]() -> Task<int> { co_return co_await shared + co_await copy; });
+    REQUIRE(val == 10);
+}
+
+TEST_CASE("SharedTask concurrent awaiters", "[SharedTask]") {
+    std::atomic<int> executed = 0;
+    auto shared = [](std::atomic<int>& executed) -> SharedTask<int> {
+        executed.fetch_add(1);
+        co_return 3;
+    }(executed);
+
+    std::atomic<int> sum = 0;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&, shared]() {
+            SingleThreadScheduler scheduler;
+            sum += scheduler.block_on([&]() -> Task<int> { co_return co_await shared; });
+        });
+    }
+    for (auto& t: threads) { t.join(); }
+    REQUIRE(executed == 1);
+    REQUIRE(sum == 12);
+}
+
+namespace {
+SharedTask<int> wait_released(std::atomic<bool>& released) {
+    co_await hucoro::poll_until([&released]() { return released.load(); });
+    co_return 5;
+}
+
+Task<bool> await_on_own_worker(SharedTask<int> shared, std::atomic<int>& arrived) {
+    auto* scheduler = SingleThreadScheduler::CURRENT_SCHEDULER;
+    auto thread = std::this_thread::get_id();
+    arrived.fetch_add(1);
+    int val = co_await shared;
+    co_return val == 5 && scheduler == SingleThreadScheduler::CURRENT_SCHEDULER &&
+            thread == std::this_thread::get_id();
+}
+}// namespace
+
+TEST_CASE("SharedTask awaiters on different workers", "[SharedTask]") {
+    std::atomic<bool> released = false;
+    std::atomic<int> arrived = 0;
+    auto shared = wait_released(released);
+    // release the shared task after both workers are suspended on it
+    std::thread releaser([&]() {
+        while (arrived.load() < 2) { std::this_thread::yield(); }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        released = true;
+    });
+    auto runtime = Runtime::builder().worker_threads(2).build();
+    auto resumed = runtime.run([&](std::size_t) { return await_on_own_worker(shared, arrived); });
+    releaser.join();
+    REQUIRE(resumed == std::vector<bool>{true, true});
+}
@@ -0,0 +1,315 @@
+//
+// Created by dreamHuang on 2023/4/7.
+//
+
+#include "async_bridge.h"
+#include "async_file.h"
+#include "catch2/catch_test_macros.hpp"
+#include "counter.h"
+#include "exception.h"
+#include "runtime.h"
+#include "single_thread_scheduler.h"
+#include "task.h"
+#include <atomic>
+#include <chrono>
+#include <fcntl.h>
+#include <mutex>
+#include <optional>
+#include <poll.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+using hucoro::Completion;
+using hucoro::JoinHandle;
+using hucoro::SingleThreadScheduler;
+using hucoro::Task;
+using hucoro::test::Counter;
+
+namespace {
+/// Complete on another thread after `ms`
+Task<void> sleep_on_thread(int ms) {
+    co_await hucoro::async_from_callback<void>([ms](Completion<void> completion) {
+        std::thread([ms, completion]() mutable {
+            std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+            completion();
+        }).detach();
+    });
+}
+
+/// A pipe which is never written, so the readers wait forever
+class IdlePipe {
+public:
+    IdlePipe() { ::pipe2(fds_, O_NONBLOCK); }
+    ~IdlePipe() {
+        ::close(fds_[0]);
+        ::close(fds_[1]);
+    }
+    int read_fd() const noexcept { return fds_[0]; }
+
+private:
+    int fds_[2] = {-1, -1};
+};
+
+Task<void> wait_forever(const IdlePipe& pipe) { co_await hucoro::wait_fd(pipe.read_fd(), hucoro::Interest::READABLE); }
+
+/// Set the flag when destroyed, which may happen on another thread (unlike Counter)
+struct DestroyFlag {
+    ~DestroyFlag() { destroyed_->store(true); }
+    std::atomic<bool>* destroyed_;
+};
+
+/// Wait for the callback completed by `completer` after `ms`
+Task<int> wait_callback(std::thread& completer, int ms, std::atomic<bool>& destroyed) {
+    DestroyFlag flag{&destroyed};
+    co_return co_await hucoro::async_from_callback<int>([&completer, ms](Completion<int> completion) {
+        completer = std::thread([ms, completion]() mutable {
+            std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+            completion(1);
+        });
+    });
+}
+
+/// Wait for the callback whose completion is kept in `pending`, and not completed by anyone
+Task<int> wait_pending(std::optional<Completion<int>>& pending, std::atomic<bool>& destroyed) {
+    DestroyFlag flag{&destroyed};
+    co_return co_await hucoro::async_from_callback<int>([&pending](Completion<int> completion) { pending = completion; });
+}
+
+Task<void> spawn_wait_callback(std::thread& completer, int ms, std::atomic<bool>& destroyed) {
+    SingleThreadScheduler::spawn([&completer, ms, &destroyed]() { return wait_callback(completer, ms, destroyed); });
+    // let it suspend
+    co_await SingleThreadScheduler::spawn([]() -> Task<void> { co_return; });
+}
+}// namespace
+
+TEST_CASE("finished tasks are destroyed by the last reference", "[Shutdown]") {
+    auto alive = Counter::alive_num();
+    {
+        SingleThreadScheduler scheduler;
+        scheduler.block_on([]() -> Task<void> {
+            // finished before joined
+            auto joined = SingleThreadScheduler::spawn([counter = Counter{}]() -> Task<int> { co_return 1; });
+            // finished but never joined
+            auto dropped = SingleThreadScheduler::spawn([counter = Counter{}]() -> Task<int> { co_return 2; });
+            // not joined and never started
+            SingleThreadScheduler::spawn([counter = Counter{}]() -> Task<void> { co_return; });
+            co_await SingleThreadScheduler::spawn([]() -> Task<void> { co_return; });
+            REQUIRE(co_await joined == 1);
+        });
+        REQUIRE(Counter::alive_num() == alive);
+        REQUIRE(scheduler.unfinished_tasks() == 0);
+    }
+    REQUIRE(Counter::alive_num() == alive);
+}
+
+TEST_CASE("shutdown drains and cancels unfinished tasks", "[Shutdown]") {
+    auto alive = Counter::alive_num();
+    IdlePipe pipe;
+    bool rejected = false;
+    {
+        SingleThreadScheduler scheduler;
+        scheduler.block_on([&]() -> Task<void> {
+            // queued when block_on returns
+            for (int i = 0; i < 3; ++i) {
+                SingleThreadScheduler::spawn([counter = Counter{}]() -> Task<void> { co_return; });
+            }
+            SingleThreadScheduler::spawn([&rejected]() -> Task<void> {
+                try {
+                    SingleThreadScheduler::spawn([]() -> Task<void> { co_return; });
+                } catch (const hucoro::HuCoroGeneralErr&) { rejected = true; }
+                co_return;
+            });
+            // waiting for I/O
+            SingleThreadScheduler::spawn([counter = Counter{}]() { return sleep_on_thread(5); });
+            auto blocked = SingleThreadScheduler::spawn([&pipe, counter = Counter{}]() { return wait_forever(pipe); });
+            // waiting for the blocked one
+            SingleThreadScheduler::spawn([blocked = std::move(blocked), counter = Counter{}]() mutable -> Task<void> {
+                auto& handle = blocked;
+                co_await handle;
+            });
+            co_return;
+        });
+        REQUIRE(scheduler.unfinished_tasks() == 7);
+
+        auto report = scheduler.shutdown(std::chrono::milliseconds(200));
+        REQUIRE(report.drained == 5);
+        REQUIRE(report.cancelled == 2);
+        REQUIRE(rejected);
+        REQUIRE(scheduler.unfinished_tasks() == 0);
+        REQUIRE(Counter::alive_num() == alive);
+
+        // the scheduler can be used again
+        REQUIRE(scheduler.block_on([]() -> Task<int> {
+            co_return co_await SingleThreadScheduler::spawn([]() -> Task<int> { co_return 1; });
+        }) == 1);
+        REQUIRE(scheduler.shutdown(std::chrono::milliseconds(0)).drained == 0);
+    }
+    REQUIRE(Counter::alive_num() == alive);
+}
+
+TEST_CASE("cancelled task kept by JoinHandle", "[Shutdown]") {
+    auto alive = Counter::alive_num();
+    IdlePipe pipe;
+    {
+        SingleThreadScheduler scheduler;
+        std::optional<JoinHandle<void>> handle;
+        scheduler.block_on([&]() -> Task<void> {
+            handle.emplace(
+                    SingleThreadScheduler::spawn([&pipe, counter = Counter{}]() { return wait_forever(pipe); }));
+            co_await SingleThreadScheduler::spawn([]() -> Task<void> { co_return; });
+        });
+        auto report = scheduler.shutdown(std::chrono::milliseconds(1));
+        REQUIRE(report.drained == 0);
+        REQUIRE(report.cancelled == 1);
+        // kept by the handle
+        REQUIRE(Counter::alive_num() == alive + 1);
+        REQUIRE_THROWS_AS(scheduler.block_on([&]() -> Task<void> {
+            auto& cancelled = *handle;
+            co_await cancelled;
+        }),
+                          hucoro::HuCoroGeneralErr);
+        handle.reset();
+        REQUIRE(Counter::alive_num() == alive);
+
+        // cancelled by the destructor of scheduler without draining
+        scheduler.block_on([&]() -> Task<void> {
+            SingleThreadScheduler::spawn([&pipe, counter = Counter{}]() { return wait_forever(pipe); });
+            co_await SingleThreadScheduler::spawn([]() -> Task<void> { co_return; });
+        });
+        REQUIRE(scheduler.unfinished_tasks() == 1);
+    }
+    REQUIRE(Counter::alive_num() == alive);
+}
+
+TEST_CASE("join handles dropped on another thread", "[Shutdown]") {
+    SingleThreadScheduler scheduler;
+    std::mutex mutex;
+    std::vector<JoinHandle<int>> handles;
+    bool spawning = true;
+    // the tasks are finished, dropped or destroyed there while the scheduler keeps spawning
+    std::thread dropper([&]() {
+        while (true) {
+            std::vector<JoinHandle<int>> dropped;
+            std::lock_guard lock{mutex};
+            if (!spawning && handles.empty()) { break; }
+            dropped.swap(handles);
+        }
+    });
+    scheduler.block_on([&]() -> Task<void> {
+        for (int i = 0; i < 20000; ++i) {
+            auto handle = SingleThreadScheduler::spawn([i]() -> Task<int> { co_return i; });
+            {
+                std::lock_guard lock{mutex};
+                handles.push_back(std::move(handle));
+            }
+            if (i % 16 == 0) { co_await SingleThreadScheduler::spawn([]() -> Task<void> { co_return; }); }
+        }
+    });
+    {
+        std::lock_guard lock{mutex};
+        spawning = false;
+    }
+    dropper.join();
+    auto report = scheduler.shutdown(std::chrono::milliseconds(1000));
+    REQUIRE(report.cancelled == 0);
+    REQUIRE(scheduler.unfinished_tasks() == 0);
+}
+
+TEST_CASE("cancel tasks waiting for callback", "[Shutdown]") {
+    SingleThreadScheduler scheduler;
+    std::thread completer;
+    std::atomic<bool> destroyed = false;
+
+    // the callback completes after the cancellation, which destroys the frame
+    scheduler.block_on([&]() { return spawn_wait_callback(completer, 50, destroyed); });
+    auto report = scheduler.shutdown(std::chrono::milliseconds(1));
+    REQUIRE(report.cancelled == 1);
+    REQUIRE(report.abandoned == 1);
+    REQUIRE(scheduler.unfinished_tasks() == 0);
+    completer.join();
+    REQUIRE(destroyed);
+
+    // the callback completes before the cancellation, but the task is not resumed
+    destroyed = false;
+    std::optional<Completion<int>> pending;
+    scheduler.block_on([&]() -> Task<void> {
+        SingleThreadScheduler::spawn([&]() { return wait_pending(pending, destroyed); });
+        co_await SingleThreadScheduler::spawn([]() -> Task<void> { co_return; });
+    });
+    (*pending)(1);
+    report = scheduler.shutdown(std::chrono::milliseconds(0));
+    REQUIRE(report.cancelled == 1);
+    REQUIRE(report.abandoned == 0);
+    REQUIRE(destroyed);
+
+    // the destructor waits for the abandoned ones
+    destroyed = false;
+    {
+        SingleThreadScheduler dropped;
+        dropped.block_on([&]() { return spawn_wait_callback(completer, 20, destroyed); });
+    }
+    REQUIRE(destroyed);
+    completer.join();
+}
+
+TEST_CASE("leak the tasks whose callback never completes", "[Shutdown]") {
+    std::optional<Completion<int>> pending;
+    std::atomic<bool> destroyed = false;
+    std::size_t leaked = 0;
+    {
+        hucoro::SchedulerOptions options;
+        options.abandoned_wait = std::chrono::milliseconds(10);
+        options.on_leak = [&leaked](std::size_t n) { leaked = n; };
+        SingleThreadScheduler scheduler{options};
+        scheduler.block_on([&]() -> Task<void> {
+            SingleThreadScheduler::spawn([&]() { return wait_pending(pending, destroyed); });
+            co_await SingleThreadScheduler::spawn([]() -> Task<void> { co_return; });
+        });
+        // the destructor gives up waiting instead of hanging
+    }
+    REQUIRE(leaked == 1);
+    REQUIRE(!destroyed);
+    // a late completion still destroys the leaked frame safely
+    REQUIRE(pending.has_value());
+    (*pending)(1);
+    REQUIRE(destroyed);
+}
+
+TEST_CASE("cancel a task waiting for AIO", "[Shutdown]") {
+    auto alive = Counter::alive_num();
+    IdlePipe pipe;
+    {
+        SingleThreadScheduler scheduler;
+        scheduler.block_on([&]() -> Task<void> {
+            // the poll never completes, so it must be cancelled instead of being waited for
+            SingleThreadScheduler::spawn([&pipe, counter = Counter{}]() -> Task<void> {
+                co_await hucoro::detail::AioAwaiter{SingleThreadScheduler::io_driver(), IOCB_CMD_POLL,
+                                                    pipe.read_fd(), reinterpret_cast<void*>(POLLIN), 0, 0};
+            });
+            co_await SingleThreadScheduler::spawn([]() -> Task<void> { co_return; });
+        });
+        auto report = scheduler.shutdown(std::chrono::milliseconds(1));
+        REQUIRE(report.cancelled == 1);
+        REQUIRE(report.abandoned == 0);
+        REQUIRE(Counter::alive_num() == alive);
+    }
+    REQUIRE(Counter::alive_num() == alive);
+}
+
+TEST_CASE("runtime reports shutdown", "[Shutdown]") {
+    IdlePipe pipe;
+    auto runtime =
+            hucoro::Runtime::builder().worker_threads(2).shutdown_timeout(std::chrono::milliseconds(100)).build();
+    runtime.run([&](std::size_t) -> Task<void> {
+        SingleThreadScheduler::spawn([]() { return sleep_on_thread(1); });
+        SingleThreadScheduler::spawn([&pipe]() { return wait_forever(pipe); });
+        co_return;
+    });
+    REQUIRE(runtime.shutdown_reports().size() == 2);
+    for (const auto& report: runtime.shutdown_reports()) {
+        REQUIRE(report.drained == 1);
+        REQUIRE(report.cancelled == 1);
+    }
+}
@@ -0,0 +1,126 @@
+//
+// Created by dreamHuang on 2023/3/12.
+//
+
+#include "catch2/benchmark/catch_benchmark.hpp"
+#include "catch2/catch_test_macros.hpp"
+#include "counter.h"
+#include "frame_slab.h"
+#include "single_thread_scheduler.h"
+#include "task.h"
+#include <functional>
+#include <list>
+#include <vector>
+
+using hucoro::SingleThreadScheduler;
+using hucoro::Task;
+using hucoro::test::Counter;
+
+TEST_CASE("spawn_n", "[Spawn]") {
+    SingleThreadScheduler scheduler;
+    auto results = scheduler.block_on([]() -> Task<std::vector<int>> {
+        auto join_set = SingleThreadScheduler::spawn_n(
+                100, [](std::size_t i) -> Task<int> { co_return static_cast<int>(i * 2); });
+        REQUIRE(join_set.size() == 100);
+        co_return co_await join_set.join();
+    });
+    REQUIRE(results.size() == 100);
+    for (std::size_t i = 0; i < results.size(); ++i) { REQUIRE(results[i] == static_cast<int>(i * 2)); }
+}
+
+TEST_CASE("spawn_n void", "[Spawn]") {
+    SingleThreadScheduler scheduler;
+    int sum = 0;
+    scheduler.block_on([&]() -> Task<void> {
+        auto join_set = SingleThreadScheduler::spawn_n(10, [&](std::size_t i) -> Task<void> {
+            sum += i;
+            co_return;
+        });
+        co_await join_set.join();
+    });
+    REQUIRE(sum == 45);
+}
+
+TEST_CASE("spawn_n mutable callable", "[Spawn]") {
+    SingleThreadScheduler scheduler;
+    auto results = scheduler.block_on([]() -> Task<std::vector<std::size_t>> {
+        // each task owns a copy of the callable, so every call sees its own `calls`
+        auto join_set = SingleThreadScheduler::spawn_n(4, [calls = std::size_t{0}](std::size_t i) mutable {
+            ++calls;
+            return [](std::size_t val) -> Task<std::size_t> { co_return val; }(i * 10 + calls);
+        });
+        co_return co_await join_set.join();
+    });
+    REQUIRE(results == std::vector<std::size_t>{1, 11, 21, 31});
+}
+
+TEST_CASE("spawn_many", "[Spawn]") {
+    using hucoro::detail::FrameSlab;
+    SingleThreadScheduler scheduler;
+    std::vector<std::function<Task<Counter>()>> funcs;
+    for (int i = 0; i < 8; ++i) {
+        funcs.push_back([]() -> Task<Counter> { co_return Counter{}; });
+    }
+    auto alive_before = Counter::alive_num();
+    auto slabs_before = FrameSlab::alive_num();
+    auto alive = scheduler.block_on([&]() -> Task<std::size_t> {
+        auto join_set = SingleThreadScheduler::spawn_many(funcs);
+        // the spawn scope has dropped its reference, the slab is kept alive by the frames
+        REQUIRE(FrameSlab::alive_num() == slabs_before + 1);
+        auto counters = co_await join_set.join();
+        co_return counters.size();
+    });
+    REQUIRE(alive == 8);
+    REQUIRE(Counter::alive_num() == alive_before);
+    // the slab is freed with the last frame
+    REQUIRE(FrameSlab::alive_num() == slabs_before);
+}
+
+TEST_CASE("spawn_many temporary range", "[Spawn]") {
+    SingleThreadScheduler scheduler;
+    auto sum = scheduler.block_on([]() -> Task<int> {
+        // the callables are moved into the tasks, the list is destroyed before they run
+        std::list<std::function<Task<int>()>> funcs;
+        for (int i = 0; i < 8; ++i) {
+            funcs.push_back([i]() -> Task<int> { co_return i; });
+        }
+        auto join_set = SingleThreadScheduler::spawn_many(std::move(funcs));
+        funcs.clear();
+        auto values = co_await join_set.join();
+        int sum = 0;
+        for (int value: values) { sum += value; }
+        co_return sum;
+    });
+    REQUIRE(sum == 28);
+}
+
+TEST_CASE("spawn_n outside scheduler", "[Spawn]") {
+    REQUIRE_THROWS(SingleThreadScheduler::spawn_n(1, [](std::size_t) -> Task<void> { co_return; }));
+}
+
+TEST_CASE("spawn_n benchmark", "[.][benchmark]") {
+    constexpr std::size_t N = 10000;
+    SingleThreadScheduler scheduler;
+
+    BENCHMARK("loop of spawn") {
+        return scheduler.block_on([]() -> Task<std::size_t> {
+            std::vector<hucoro::JoinHandle<std::size_t>> handles;
+            handles.reserve(N);
+            for (std::size_t i = 0; i < N; ++i) {
+                handles.push_back(SingleThreadScheduler::spawn([i]() -> Task<std::size_t> { co_return i; }));
+            }
+            std::size_t sum = 0;
+            for (auto& handle: handles) { sum += co_await handle; }
+            co_return sum;
+        });
+    };
+
+    BENCHMARK("spawn_n") {
+        return scheduler.block_on([]() -> Task<std::size_t> {
+            auto join_set = SingleThreadScheduler::spawn_n(N, [](std::size_t i) -> Task<std::size_t> { co_return i; });
+            std::size_t sum = 0;
+            for (auto& handle: join_set) { sum += co_await handle; }
+            co_return sum;
+        });
+    };
+}
@@ -0,0 +1,101 @@
+//
+// Created by dreamHuang on 2023/3/18.
+//
+
+#include "catch2/catch_test_macros.hpp"
+#include "shared_task.h"
+#include "single_thread_scheduler.h"
+#include "task.h"
+#include "task_local.h"
+#include <string>
+#include <vector>
+
+using hucoro::SharedTask;
+using hucoro::SingleThreadScheduler;
+using hucoro::SpawnOptions;
+using hucoro::Task;
+using hucoro::TaskLocal;
+
+namespace {
+TaskLocal<int> REQUEST_ID;
+TaskLocal<std::string> SPAN;
+
+Task<int> read_request_id() {
+    auto* id = REQUEST_ID.get();
+    co_return id ? *id : -1;
+}
+
+Task<int> handle_request(int id) {
+    REQUEST_ID.set(id);
+    // yield to other tasks, so that the tasks interleave
+    co_await SingleThreadScheduler::spawn([]() -> Task<void> { co_return; });
+    co_return co_await read_request_id();
+}
+}// namespace
+
+TEST_CASE("TaskLocal out of task", "[TaskLocal]") {
+    REQUIRE(REQUEST_ID.get() == nullptr);
+    REQUIRE_THROWS(REQUEST_ID.set(1));
+}
+
+TEST_CASE("TaskLocal isolated between interleaving tasks", "[TaskLocal]") {
+    SingleThreadScheduler scheduler;
+    auto ids = scheduler.block_on([]() -> Task<std::vector<int>> {
+        std::vector<hucoro::JoinHandle<int>> handles;
+        for (int i = 0; i < 4; ++i) {
+            handles.push_back(SingleThreadScheduler::spawn([i]() { return handle_request(i); }));
+        }
+        std::vector<int> ids;
+        for (auto& handle: handles) { ids.push_back(co_await handle); }
+        // the root task does not see the variables of spawned tasks
+        ids.push_back(co_await read_request_id());
+        co_return ids;
+    });
+    REQUIRE(ids == std::vector<int>{0, 1, 2, 3, -1});
+}
+
+TEST_CASE("TaskLocal inherited by spawned task", "[TaskLocal]") {
+    SingleThreadScheduler scheduler;
+    auto ids = scheduler.block_on([]() -> Task<std::vector<int>> {
+        REQUEST_ID.set(42);
+        SPAN.set("root");
+        auto inherited = SingleThreadScheduler::spawn(
+                []() -> Task<int> {
+                    // overwrite in child does not affect parent
+                    SPAN.set("child");
+                    co_return co_await read_request_id();
+                },
+                SpawnOptions{.inherit_task_locals = true});
+        auto not_inherited = SingleThreadScheduler::spawn([]() { return read_request_id(); });
+        std::vector<int> ids;
+        ids.push_back(co_await inherited);
+        ids.push_back(co_await not_inherited);
+        // the context is restored after being resumed by the spawned task
+        ids.push_back(co_await read_request_id());
+        REQUIRE(*SPAN.get() == "root");
+        co_return ids;
+    });
+    REQUIRE(ids == std::vector<int>{42, -1, 42});
+}
+
+TEST_CASE("TaskLocal restored after SharedTask", "[TaskLocal]") {
+    SingleThreadScheduler scheduler;
+    auto ids = scheduler.block_on([]() -> Task<std::vector<int>> {
+        auto shared = []() -> SharedTask<int> {
+            co_await SingleThreadScheduler::spawn([]() -> Task<void> { co_return; });
+            co_return 0;
+        }();
+        auto waiter = [](SharedTask<int> shared, int id) -> Task<int> {
+            REQUEST_ID.set(id);
+            co_await shared;
+            co_return co_await read_request_id();
+        };
+        auto h1 = SingleThreadScheduler::spawn([=]() { return waiter(shared, 1); });
+        auto h2 = SingleThreadScheduler::spawn([=]() { return waiter(shared, 2); });
+        std::vector<int> ids;
+        ids.push_back(co_await h1);
+        ids.push_back(co_await h2);
+        co_return ids;
+    });
+    REQUIRE(ids == std::vector<int>{1, 2});
+}
@@ -0,0 +1,118 @@
+//
+// Created by dreamHuang on 2023/3/30.
+//
+
+#include "catch2/catch_test_macros.hpp"
+#include "io_driver.h"
+#include "single_thread_scheduler.h"
+#include "task.h"
+#include "task_registry.h"
+#include <fcntl.h>
+#include <optional>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using hucoro::SingleThreadScheduler;
+using hucoro::Task;
+using hucoro::TaskRegistry;
+using hucoro::TaskSnapshot;
+
+namespace {
+Task<int> wait_readable(int fd) {
+    hucoro::IoRegistration registration(SingleThreadScheduler::io_driver(), fd);
+    char c;
+    while (::read(fd, &c, 1) < 0) {
+        registration.clear_ready(hucoro::Interest::READABLE);
+        co_await registration.ready(hucoro::Interest::READABLE);
+    }
+    co_return c;
+}
+
+std::optional<TaskSnapshot> find_task(unsigned line) {
+    for (auto& task: TaskRegistry::snapshot()) {
+        if (task.location.line() == line) { return task; }
+    }
+    return std::nullopt;
+}
+
+Task<void> yield() { co_return; }
+
+Task<std::vector<std::string>> spawn_and_inspect(int read_fd, int write_fd) {
+    unsigned line = __LINE__ + 1;
+    auto reader = SingleThreadScheduler::spawn([read_fd]() { return wait_readable(read_fd); });
+    // let the reader run until it is suspended on the pipe
+    co_await SingleThreadScheduler::spawn(yield);
+
+    std::vector<std::string> states;
+    auto task = find_task(line);
+    if (!task) { co_return states; }
+    states.push_back(task->state);
+    states.push_back(task->awaiter);
+    states.push_back(TaskRegistry::dump());
+
+    ::write(write_fd, "x", 1);
+    co_await reader;
+    task = find_task(line);
+    states.push_back(task ? task->state : "destroyed");
+    co_return states;
+}
+
+// return the awaiter recorded for itself while running, after being resumed from the pipe
+Task<std::string> inspect_self(int read_fd, unsigned line) {
+    co_await wait_readable(read_fd);
+    auto task = find_task(line);
+    co_return task ? task->awaiter : "not found";
+}
+
+Task<std::string> spawn_and_resume(int read_fd, int write_fd) {
+    unsigned line = __LINE__ + 1;
+    auto handle = SingleThreadScheduler::spawn([read_fd, line]() { return inspect_self(read_fd, line); });
+    co_await SingleThreadScheduler::spawn(yield);
+    ::write(write_fd, "x", 1);
+    co_return co_await handle;
+}
+
+Task<void> spawn_one() { co_await SingleThreadScheduler::spawn(yield); }
+}// namespace
+
+TEST_CASE("task registry is disabled by default", "[TaskRegistry]") {
+    REQUIRE_FALSE(TaskRegistry::enabled());
+    SingleThreadScheduler scheduler;
+    auto before = TaskRegistry::size();
+    scheduler.block_on(spawn_one);
+    REQUIRE(TaskRegistry::size() == before);
+}
+
+TEST_CASE("task registry records state and awaiter", "[TaskRegistry]") {
+    int fds[2];
+    REQUIRE(::pipe2(fds, O_NONBLOCK) == 0);
+    TaskRegistry::enable();
+    SingleThreadScheduler scheduler;
+    auto read_fd = fds[0], write_fd = fds[1];
+    auto states = scheduler.block_on([=]() { return spawn_and_inspect(read_fd, write_fd); });
+    REQUIRE(states.size() == 4);
+    // started but not joined yet, and suspended on the readiness of pipe
+    REQUIRE(states[0] == std::string{"IN_PROGRESS"});
+    REQUIRE(states[1].find("ReadyAwaiter") != std::string::npos);
+    REQUIRE(states[2].find("task_registry_test.cpp") != std::string::npos);
+    REQUIRE((states[3] == std::string{"FINISH"} || states[3] == std::string{"destroyed"}));
+    // the finished tasks are removed once destroyed
+    REQUIRE(TaskRegistry::size() == 0);
+    TaskRegistry::enable(false);
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+TEST_CASE("task registry clears awaiter on resume", "[TaskRegistry]") {
+    int fds[2];
+    REQUIRE(::pipe2(fds, O_NONBLOCK) == 0);
+    TaskRegistry::enable();
+    SingleThreadScheduler scheduler;
+    auto read_fd = fds[0], write_fd = fds[1];
+    auto awaiter = scheduler.block_on([=]() { return spawn_and_resume(read_fd, write_fd); });
+    REQUIRE(awaiter.empty());
+    TaskRegistry::enable(false);
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
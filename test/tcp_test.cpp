@@ -0,0 +1,162 @@
+//
+// Created by dreamHuang on 2023/3/24.
+//
+
+#include "catch2/catch_test_macros.hpp"
+#include "run_queue.h"
+#include "single_thread_scheduler.h"
+#include "task.h"
+#include "tcp.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+using hucoro::SingleThreadScheduler;
+using hucoro::Task;
+using hucoro::TcpListener;
+using hucoro::TcpStream;
+
+namespace {
+Task<void> echo(TcpStream stream) {
+    char buf[256];
+    std::size_t n;
+    while ((n = co_await stream.read(buf, sizeof(buf))) > 0) { co_await stream.write(buf, n); }
+}
+
+Task<std::string> echo_round_trip(std::string data) {
+    auto listener = TcpListener::bind("127.0.0.1", 0);
+    auto server = SingleThreadScheduler::spawn([&listener]() { return listener.serve(echo, 1); });
+    auto client = co_await TcpStream::connect("127.0.0.1", listener.local_port());
+    client.set_nodelay(true);
+
+    hucoro::IOBuf out;
+    out.append(data.data(), data.size(), SingleThreadScheduler::buffer_pool());
+    co_await client.write(out);
+
+    hucoro::IOBuf in;
+    while (in.length() < data.size()) {
+        if (co_await client.read(in) == 0) { break; }
+    }
+    co_await client.shutdown();
+    co_await server;
+    co_return in.to_string();
+}
+}// namespace
+
+TEST_CASE("tcp echo", "[Tcp]") {
+    SingleThreadScheduler scheduler;
+    std::string data(100000, 'x');
+    for (std::size_t i = 0; i < data.size(); ++i) { data[i] = static_cast<char>('a' + i % 26); }
+    REQUIRE(scheduler.block_on([&data]() { return echo_round_trip(data); }) == data);
+}
+
+TEST_CASE("tcp listener reuse port", "[Tcp]") {
+    auto first = TcpListener::bind("127.0.0.1", 0);
+    auto port = first.local_port();
+    // the listeners of each scheduler thread share the same port
+    REQUIRE_NOTHROW(TcpListener::bind("127.0.0.1", port));
+    REQUIRE_THROWS_AS(TcpListener::bind("127.0.0.1", port, TcpListener::Options{.reuse_port = false}),
+                      std::system_error);
+}
+
+TEST_CASE("tcp connect refused", "[Tcp]") {
+    std::uint16_t port;
+    {
+        auto listener = TcpListener::bind("127.0.0.1", 0);
+        port = listener.local_port();
+    }
+    SingleThreadScheduler scheduler;
+    auto connect = [port]() -> Task<void> { co_await TcpStream::connect("127.0.0.1", port); };
+    REQUIRE_THROWS_AS(scheduler.block_on(connect), std::system_error);
+}
+
+namespace {
+constexpr char RESPONSE[] = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+constexpr char REQUEST[] = "GET / HTTP/1.1\r\nHost: hucoro\r\n\r\n";
+
+// keep-alive: respond to every request until the client closes
+Task<void> http_handler(TcpStream stream) {
+    stream.set_nodelay(true);
+    std::string pending;
+    char buf[1024];
+    std::size_t n;
+    while ((n = co_await stream.read(buf, sizeof(buf))) > 0) {
+        pending.append(buf, n);
+        std::size_t end;
+        while ((end = pending.find("\r\n\r\n")) != std::string::npos) {
+            pending.erase(0, end + 4);
+            co_await stream.write(RESPONSE, sizeof(RESPONSE) - 1);
+        }
+    }
+}
+
+Task<void> serve_http(TcpListener& listener, std::size_t connections) {
+    std::vector<hucoro::JoinHandle<void>> handlers;
+    for (std::size_t i = 0; i < connections; ++i) {
+        auto stream = co_await listener.accept();
+        handlers.push_back(SingleThreadScheduler::spawn(
+                [stream = std::move(stream)]() mutable { return http_handler(std::move(stream)); }));
+    }
+    for (auto& handler: handlers) { co_await handler; }
+}
+
+Task<void> http_client(std::uint16_t port, std::size_t requests, hucoro::QueueDelayStats* latency) {
+    auto stream = co_await TcpStream::connect("127.0.0.1", port);
+    stream.set_nodelay(true);
+    char buf[1024];
+    for (std::size_t i = 0; i < requests; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        co_await stream.write(REQUEST, sizeof(REQUEST) - 1);
+        std::size_t received = 0;
+        while (received < sizeof(RESPONSE) - 1) {
+            auto n = co_await stream.read(buf, sizeof(buf));
+            if (n == 0) { co_return; }
+            received += n;
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        latency->record(static_cast<std::uint64_t>(std::chrono::nanoseconds(elapsed).count()));
+    }
+}
+
+Task<void> load(std::uint16_t port, std::size_t connections, std::size_t requests,
+                hucoro::QueueDelayStats* latency) {
+    auto clients = SingleThreadScheduler::spawn_n(
+            connections, [=](std::size_t) { return http_client(port, requests / connections, latency); });
+    co_await clients.join();
+}
+}// namespace
+
+// A loopback HTTP-style load generator: a server thread accepts the connections, and the client
+// thread keeps `connections` connections busy with request/response.
+TEST_CASE("tcp http load", "[.][benchmark]") {
+    constexpr std::size_t REQUESTS = 50000;
+    const std::size_t connection_nums[] = {1, 16, 64, 256};
+    std::size_t total_connections = 0;
+    for (auto num: connection_nums) { total_connections += num; }
+
+    auto listener = TcpListener::bind("127.0.0.1", 0);
+    auto port = listener.local_port();
+    std::thread server([&]() {
+        SingleThreadScheduler scheduler;
+        // the listener is registered to this scheduler, so it should be destroyed first
+        auto server_listener = std::move(listener);
+        scheduler.block_on([&]() { return serve_http(server_listener, total_connections); });
+    });
+
+    SingleThreadScheduler scheduler;
+    for (auto connections: connection_nums) {
+        hucoro::QueueDelayStats latency;
+        auto start = std::chrono::steady_clock::now();
+        scheduler.block_on([&]() { return load(port, connections, REQUESTS, &latency); });
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::printf("%4zu connections: %9.0f req/s, mean %7.1f us, p50 <= %7.1f us, p99 <= %7.1f us\n",
+                    connections, static_cast<double>(latency.count) / elapsed.count(), latency.mean_ns() / 1e3,
+                    latency.percentile_ns(0.5) / 1e3, latency.percentile_ns(0.99) / 1e3);
+        REQUIRE(latency.count == REQUESTS / connections * connections);
+    }
+    server.join();
+}